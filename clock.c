@@ -19,11 +19,12 @@
 #include <errno.h>
 #include <time.h>
 #include <linux/net_tstamp.h>
-#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/queue.h>
+#include <unistd.h>
 
 #include "address.h"
 #include "bmc.h"
@@ -37,15 +38,18 @@
 #include "phc.h"
 #include "port.h"
 #include "servo.h"
+#include "state_shm.h"
 #include "stats.h"
 #include "print.h"
 #include "rtnl.h"
 #include "tlv.h"
 #include "tsproc.h"
+#include "twheel.h"
 #include "uds.h"
 #include "util.h"
 
-#define N_CLOCK_PFD (N_POLLFD + 1) /* one extra per port, for the fault timer */
+/* Two extra per port, for the fault and transmit time stamp timers. */
+#define N_CLOCK_PFD (N_POLLFD + 2)
 
 struct interface {
 	STAILQ_ENTRY(interface) list;
@@ -55,6 +59,27 @@ struct port {
 	LIST_ENTRY(port) list;
 };
 
+struct clock_pfd;
+
+struct clock_pfd_slot {
+	struct clock_pfd *pfd;
+	int index;
+};
+
+/*
+ * The descriptors of one port as currently registered with epoll,
+ * along with the events reported for them by the last epoll_wait().
+ */
+struct clock_pfd {
+	LIST_ENTRY(clock_pfd) list;
+	struct clock_pfd *next_ready;
+	struct port *port;
+	int ready;
+	int fd[N_CLOCK_PFD];
+	uint32_t revents[N_CLOCK_PFD];
+	struct clock_pfd_slot slot[N_CLOCK_PFD];
+};
+
 struct freq_estimator {
 	tmv_t origin1;
 	tmv_t ingress1;
@@ -95,8 +120,13 @@ struct clock {
 	struct ClockIdentity best_id;
 	LIST_HEAD(ports_head, port) ports;
 	struct port *uds_port;
-	struct pollfd *pollfd;
-	int pollfd_valid;
+	LIST_HEAD(clock_pfd_head, clock_pfd) pfds;
+	struct clock_pfd *uds_pfd;
+	struct epoll_event *events;
+	int epfd;
+	int epoll_valid;
+	struct twheel *wheel;
+	struct clock_pfd_slot wheel_slot;
 	int nports; /* does not include the UDS port */
 	int last_port_number;
 	int sde;
@@ -115,6 +145,7 @@ struct clock {
 	UInteger8 max_steps_removed;
 	enum servo_state servo_state;
 	enum timestamp_type timestamping;
+	double freq; /* last frequency adjustment */
 	tmv_t master_offset;
 	tmv_t path_delay;
 	tmv_t ingress_ts;
@@ -132,12 +163,17 @@ struct clock {
 	struct syfu_relay_info syfu_relay;
 	LIST_HEAD(clock_subscribers_head, clock_subscriber) subscribers;
 	struct monitor *slave_event_monitor;
+	struct state_shm *state_shm;
+	/* Set when the published state may be out of date. */
+	int state_changed;
 };
 
 struct clock the_clock;
 
 static void handle_state_decision_event(struct clock *c);
-static int clock_resize_pollfd(struct clock *c, int new_nports);
+static int clock_resize_events(struct clock *c, int new_nports);
+static struct clock_pfd *clock_pfd_create(struct clock *c, struct port *p);
+static void clock_pfd_destroy(struct clock_pfd *pfd);
 static void clock_remove_port(struct clock *c, struct port *p);
 static void clock_stats_display(struct clock_stats *s);
 
@@ -240,6 +276,19 @@ static void clock_prune_subscriptions(struct clock *c)
 	}
 }
 
+static int clock_event_subscribed(struct clock *c, enum notification event)
+{
+	unsigned int event_pos = event / 8;
+	uint8_t mask = 1 << (event % 8);
+	struct clock_subscriber *s;
+
+	LIST_FOREACH(s, &c->subscribers, list) {
+		if (s->events[event_pos] & mask)
+			return 1;
+	}
+	return 0;
+}
+
 void clock_send_notification(struct clock *c, struct ptp_message *msg,
 			     enum notification event)
 {
@@ -273,8 +322,20 @@ void clock_destroy(struct clock *c)
 		clock_remove_port(c, p);
 	}
 	monitor_destroy(c->slave_event_monitor);
+	if (c->state_shm) {
+		state_shm_destroy(c->state_shm);
+	}
+	if (c->uds_pfd) {
+		clock_pfd_destroy(c->uds_pfd);
+	}
 	port_close(c->uds_port);
-	free(c->pollfd);
+	if (c->wheel) {
+		twheel_destroy(c->wheel);
+	}
+	free(c->events);
+	if (c->epfd >= 0) {
+		close(c->epfd);
+	}
 	if (c->clkid != CLOCK_REALTIME) {
 		phc_close(c->clkid);
 	}
@@ -340,6 +401,7 @@ static int clock_management_fill_response(struct clock *c, struct port *p,
 {
 	struct grandmaster_settings_np *gsn;
 	struct management_tlv_datum *mtd;
+	struct message_pool_np *mpn;
 	struct subscribe_events_np *sen;
 	struct management_tlv *tlv;
 	struct time_status_np *tsn;
@@ -455,6 +517,11 @@ static int clock_management_fill_response(struct clock *c, struct port *p,
 		mtd->val = c->local_sync_uncertain;
 		datalen = sizeof(*mtd);
 		break;
+	case TLV_MESSAGE_POOL_NP:
+		mpn = (struct message_pool_np *) tlv->data;
+		msg_pool_stats(mpn);
+		datalen = sizeof(*mpn);
+		break;
 	default:
 		/* The caller should *not* respond to this message. */
 		tlv_extra_recycle(extra);
@@ -682,7 +749,7 @@ static void clock_update_slave(struct clock *c)
 	if (!c->best)
 		return;
 
-	msg                            = TAILQ_FIRST(&c->best->messages);
+	msg                            = fc_latest(c->best);
 	c->cur.stepsRemoved            = 1 + c->best->dataset.stepsRemoved;
 	pds->parentPortIdentity        = c->best->dataset.sender;
 	pds->grandmasterIdentity       = msg->announce.grandmasterIdentity;
@@ -818,13 +885,17 @@ static int clock_add_port(struct clock *c, const char *phc_device,
 {
 	struct port *p, *piter, *lastp = NULL;
 
-	if (clock_resize_pollfd(c, c->nports + 1)) {
+	if (clock_resize_events(c, c->nports + 1)) {
 		return -1;
 	}
 	p = port_open(phc_device, phc_index, timestamping,
 		      ++c->last_port_number, iface, c);
 	if (!p) {
-		/* No need to shrink pollfd */
+		/* No need to shrink the event array */
+		return -1;
+	}
+	if (!clock_pfd_create(c, p)) {
+		port_close(p);
 		return -1;
 	}
 	LIST_FOREACH(piter, &c->ports, list) {
@@ -843,11 +914,20 @@ static int clock_add_port(struct clock *c, const char *phc_device,
 
 static void clock_remove_port(struct clock *c, struct port *p)
 {
-	/* Do not call clock_resize_pollfd, it's pointless to shrink
+	struct clock_pfd *pfd;
+
+	/* Do not call clock_resize_events, it's pointless to shrink
 	 * the allocated memory at this point, clock_destroy will free
 	 * it all anyway. This function is usable from other parts of
-	 * the code, but even then we don't mind if pollfd is larger
-	 * than necessary. */
+	 * the code, but even then we don't mind if the event array is
+	 * larger than necessary. Closing the port's descriptors drops
+	 * their epoll registrations. */
+	LIST_FOREACH(pfd, &c->pfds, list) {
+		if (pfd->port == p) {
+			clock_pfd_destroy(pfd);
+			break;
+		}
+	}
 	LIST_REMOVE(p, list);
 	c->nports--;
 	clock_fda_changed(c);
@@ -888,6 +968,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 {
 	enum servo_type servo = config_get_int(config, NULL, "clock_servo");
 	char ts_label[IF_NAMESIZE], phc[32], *tmp;
+	const char *shm_name;
 	enum timestamp_type timestamping;
 	int fadj = 0, max_adj = 0, sw_ts;
 	int phc_index, required_modes = 0;
@@ -896,6 +977,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	struct port *p;
 	unsigned char oui[OUI_LEN];
 	struct interface *iface;
+	struct epoll_event ev;
 	struct timespec ts;
 	int sfl;
 
@@ -1174,10 +1256,31 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 
 	LIST_INIT(&c->subscribers);
 	LIST_INIT(&c->ports);
+	LIST_INIT(&c->pfds);
 	c->last_port_number = 0;
 
-	if (clock_resize_pollfd(c, 0)) {
-		pr_err("failed to allocate pollfd");
+	c->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (c->epfd < 0) {
+		pr_err("epoll_create1: %m");
+		return NULL;
+	}
+	c->wheel = twheel_create();
+	if (!c->wheel) {
+		pr_err("failed to create timing wheel");
+		return NULL;
+	}
+	/* The wheel's slot has no port, which tells it apart. */
+	c->wheel_slot.pfd = NULL;
+	c->wheel_slot.index = 0;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = &c->wheel_slot;
+	if (epoll_ctl(c->epfd, EPOLL_CTL_ADD, twheel_fd(c->wheel), &ev)) {
+		pr_err("failed to register timing wheel: %m");
+		return NULL;
+	}
+	if (clock_resize_events(c, 0)) {
+		pr_err("failed to allocate epoll events");
 		return NULL;
 	}
 
@@ -1187,6 +1290,11 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		pr_err("failed to open the UDS port");
 		return NULL;
 	}
+	c->uds_pfd = clock_pfd_create(c, c->uds_port);
+	if (!c->uds_pfd) {
+		pr_err("failed to allocate UDS port descriptors");
+		return NULL;
+	}
 	clock_fda_changed(c);
 
 	c->slave_event_monitor = monitor_create(config, c->uds_port);
@@ -1205,6 +1313,19 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 
 	c->dds.numberPorts = c->nports;
 
+	shm_name = config_get_string(config, NULL, "state_shm_name");
+	if (shm_name[0]) {
+		c->state_shm = state_shm_create(shm_name);
+		if (!c->state_shm) {
+			return NULL;
+		}
+		c->state_changed = 1;
+		if (c->nports > STATE_SHM_MAX_PORTS) {
+			pr_warning("publishing the state of the first %d ports only",
+				   STATE_SHM_MAX_PORTS);
+		}
+	}
+
 	LIST_FOREACH(p, &c->ports, list) {
 		port_dispatch(p, EV_INITIALIZE, 0);
 	}
@@ -1284,54 +1405,123 @@ struct ClockIdentity clock_identity(struct clock *c)
 	return c->dds.clockIdentity;
 }
 
-static int clock_resize_pollfd(struct clock *c, int new_nports)
+static int clock_resize_events(struct clock *c, int new_nports)
 {
-	struct pollfd *new_pollfd;
+	struct epoll_event *new_events;
 
-	/* Need to allocate one whole extra block of fds for UDS. */
-	new_pollfd = realloc(c->pollfd,
+	/* Need to allocate one whole extra block of events for UDS. */
+	new_events = realloc(c->events,
 			     (new_nports + 1) * N_CLOCK_PFD *
-			     sizeof(struct pollfd));
-	if (!new_pollfd) {
+			     sizeof(struct epoll_event));
+	if (!new_events) {
 		return -1;
 	}
-	c->pollfd = new_pollfd;
+	c->events = new_events;
 	return 0;
 }
 
-static void clock_fill_pollfd(struct pollfd *dest, struct port *p)
+static struct clock_pfd *clock_pfd_create(struct clock *c, struct port *p)
 {
-	struct fdarray *fda;
+	struct clock_pfd *pfd;
 	int i;
 
-	fda = port_fda(p);
-	for (i = 0; i < N_POLLFD; i++) {
-		dest[i].fd = fda->fd[i];
-		dest[i].events = POLLIN|POLLPRI;
+	pfd = calloc(1, sizeof(*pfd));
+	if (!pfd) {
+		return NULL;
+	}
+	pfd->port = p;
+	for (i = 0; i < N_CLOCK_PFD; i++) {
+		pfd->fd[i] = -1;
+		pfd->slot[i].pfd = pfd;
+		pfd->slot[i].index = i;
 	}
-	dest[i].fd = port_fault_fd(p);
-	dest[i].events = POLLIN|POLLPRI;
+	port_attach_timers(p, c->wheel, pfd);
+	LIST_INSERT_HEAD(&c->pfds, pfd, list);
+	return pfd;
 }
 
-static void clock_check_pollfd(struct clock *c)
+static void clock_pfd_destroy(struct clock_pfd *pfd)
 {
-	struct port *p;
-	struct pollfd *dest = c->pollfd;
+	LIST_REMOVE(pfd, list);
+	free(pfd);
+}
+
+static int clock_pfd_source(struct clock_pfd *pfd, int index)
+{
+	/* The timers, including the fault timer, live on the wheel. */
+	if (index < N_POLLFD) {
+		return port_fda(pfd->port)->fd[index];
+	}
+	return -1;
+}
+
+static int clock_pfd_register(struct clock *c, struct clock_pfd *pfd,
+			      int index, int fd)
+{
+	struct epoll_event ev;
+	int err;
+
+	ev.events = EPOLLIN | EPOLLPRI;
+	ev.data.ptr = &pfd->slot[index];
+
+	/*
+	 * A descriptor that was closed and reopened under the same
+	 * number has silently lost its registration, so an unchanged
+	 * number still needs to be confirmed with the kernel.
+	 */
+	if (pfd->fd[index] == fd) {
+		err = epoll_ctl(c->epfd, EPOLL_CTL_MOD, fd, &ev);
+		if (!err || errno != ENOENT) {
+			return err;
+		}
+	}
+	return epoll_ctl(c->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
 
-	if (c->pollfd_valid) {
+static void clock_check_epoll(struct clock *c)
+{
+	struct clock_pfd *pfd;
+	int fd, i;
+
+	if (c->epoll_valid) {
 		return;
 	}
-	LIST_FOREACH(p, &c->ports, list) {
-		clock_fill_pollfd(dest, p);
-		dest += N_CLOCK_PFD;
+	/*
+	 * Drop all stale registrations before adding any new ones, as
+	 * a descriptor number released by one port may have already
+	 * been taken by another.
+	 */
+	LIST_FOREACH(pfd, &c->pfds, list) {
+		for (i = 0; i < N_CLOCK_PFD; i++) {
+			fd = clock_pfd_source(pfd, i);
+			if (pfd->fd[i] >= 0 && pfd->fd[i] != fd) {
+				epoll_ctl(c->epfd, EPOLL_CTL_DEL, pfd->fd[i], NULL);
+				pfd->fd[i] = -1;
+			}
+		}
+	}
+	c->epoll_valid = 1;
+	LIST_FOREACH(pfd, &c->pfds, list) {
+		for (i = 0; i < N_CLOCK_PFD; i++) {
+			fd = clock_pfd_source(pfd, i);
+			if (fd < 0) {
+				continue;
+			}
+			if (clock_pfd_register(c, pfd, i, fd)) {
+				pr_err("port %d: failed to register fd %d: %m",
+				       port_number(pfd->port), fd);
+				pfd->fd[i] = -1;
+				c->epoll_valid = 0;
+				continue;
+			}
+			pfd->fd[i] = fd;
+		}
 	}
-	clock_fill_pollfd(dest, c->uds_port);
-	c->pollfd_valid = 1;
 }
 
 void clock_fda_changed(struct clock *c)
 {
-	c->pollfd_valid = 0;
+	c->epoll_valid = 0;
 }
 
 static int clock_do_forward_mgmt(struct clock *c,
@@ -1360,26 +1550,48 @@ static int clock_do_forward_mgmt(struct clock *c,
 	return port_forward(out, msg);
 }
 
-static void clock_forward_mgmt_msg(struct clock *c, struct port *p, struct ptp_message *msg)
+/*
+ * Relays a management message. When the port kept the wire image of
+ * the message, only its boundaryHops octet differs from what came in,
+ * so the image is patched once and sent as is. Otherwise the message
+ * itself is converted to network byte order and back again.
+ */
+static void clock_forward_mgmt_msg(struct clock *c, struct port *p,
+				   struct ptp_message *msg,
+				   struct ptp_message *wire)
 {
+	struct ptp_message *fwd = wire ? wire : msg;
+	int pdulen, pre_sent = wire ? 1 : 0;
 	struct port *piter;
-	int pdulen = 0, msg_ready = 0;
 
-	if (forwarding(c, p) && msg->management.boundaryHops) {
-		pdulen = msg->header.messageLength;
-		msg->management.boundaryHops--;
-		LIST_FOREACH(piter, &c->ports, list) {
-			if (clock_do_forward_mgmt(c, p, piter, msg, &msg_ready))
-				pr_err("port %d: management forward failed",
-				       port_number(piter));
-		}
-		if (clock_do_forward_mgmt(c, p, c->uds_port, msg, &msg_ready))
-			pr_err("uds port: management forward failed");
-		if (msg_ready) {
-			msg_post_recv(msg, pdulen);
-			msg->management.boundaryHops++;
-		}
+	if (!forwarding(c, p) || !msg->management.boundaryHops)
+		return;
+
+	pdulen = msg->header.messageLength;
+	fwd->management.boundaryHops--;
+	LIST_FOREACH(piter, &c->ports, list) {
+		if (clock_do_forward_mgmt(c, p, piter, fwd, &pre_sent))
+			pr_err("port %d: management forward failed",
+			       port_number(piter));
+	}
+	if (clock_do_forward_mgmt(c, p, c->uds_port, fwd, &pre_sent))
+		pr_err("uds port: management forward failed");
+	if (!wire && pre_sent)
+		msg_post_recv(msg, pdulen);
+	fwd->management.boundaryHops++;
+}
+
+int clock_forwards_mgmt(struct clock *c, struct port *p)
+{
+	struct port *piter;
+
+	if (!forwarding(c, p))
+		return 0;
+	LIST_FOREACH(piter, &c->ports, list) {
+		if (piter != p && forwarding(c, piter))
+			return 1;
 	}
+	return p != c->uds_port && forwarding(c, c->uds_port);
 }
 
 tmv_t clock_ingress_time(struct clock *c)
@@ -1387,7 +1599,8 @@ tmv_t clock_ingress_time(struct clock *c)
 	return c->ingress_ts;
 }
 
-int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg)
+int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg,
+		 struct ptp_message *wire)
 {
 	int changed = 0, res, answers;
 	struct port *piter;
@@ -1397,7 +1610,7 @@ int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg)
 	};
 
 	/* Forward this message out all eligible ports. */
-	clock_forward_mgmt_msg(c, p, msg);
+	clock_forward_mgmt_msg(c, p, msg, wire);
 
 	/* Apply this message to the local clock and ports. */
 	tcid = &msg->management.targetPortIdentity.clockIdentity;
@@ -1483,6 +1696,7 @@ int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg)
 	case TLV_GRANDMASTER_SETTINGS_NP:
 	case TLV_SUBSCRIBE_EVENTS_NP:
 	case TLV_SYNCHRONIZATION_UNCERTAIN_NP:
+	case TLV_MESSAGE_POOL_NP:
 		clock_management_send_error(p, msg, TLV_NOT_SUPPORTED);
 		break;
 	default:
@@ -1511,8 +1725,14 @@ void clock_notify_event(struct clock *c, enum notification event)
 	struct ptp_message *msg;
 	int id;
 
+	if (!clock_event_subscribed(c, event))
+		return;
+
 	switch (event) {
 	/* set id */
+	case NOTIFY_TIME_SYNC:
+		id = TLV_TIME_STATUS_NP;
+		break;
 	default:
 		return;
 	}
@@ -1545,86 +1765,199 @@ void clock_set_sde(struct clock *c, int sde)
 	c->sde = sde;
 }
 
-int clock_poll(struct clock *c)
+void clock_state_changed(struct clock *c)
 {
-	int cnt, i;
-	enum fsm_event event;
-	struct pollfd *cur;
-	struct port *p;
+	c->state_changed = 1;
+}
 
-	clock_check_pollfd(c);
-	cnt = poll(c->pollfd, (c->nports + 1) * N_CLOCK_PFD, -1);
-	if (cnt < 0) {
-		if (EINTR == errno) {
-			return 0;
-		} else {
-			pr_emerg("poll failed");
-			return -1;
-		}
-	} else if (!cnt) {
-		return 0;
+static int clock_port_event(struct clock *c, struct port *p,
+			    enum fsm_event event)
+{
+	if (EV_STATE_DECISION_EVENT == event) {
+		c->sde = 1;
 	}
+	if (EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES == event) {
+		c->sde = 1;
+	}
+	if (EV_FAULT_DETECTED == event) {
+		c->sde = 1;
+	}
+	port_dispatch(p, event, 0);
+	/* Clear any fault after a little while. */
+	if (PS_FAULTY == port_state(p)) {
+		clock_fault_timeout(p, 1);
+		return -1;
+	}
+	return 0;
+}
 
-	cur = c->pollfd;
+static void clock_pfd_dispatch(struct clock *c, struct clock_pfd *pfd)
+{
+	enum fsm_event event;
+	struct port *p = pfd->port;
+	uint32_t *revents = pfd->revents;
+	int faulty = 0, i;
 
-	LIST_FOREACH(p, &c->ports, list) {
-		/* Let the ports handle their events. */
-		for (i = 0; i < N_POLLFD; i++) {
-			if (cur[i].revents & (POLLIN|POLLPRI|POLLERR)) {
-				if (cur[i].revents & POLLERR) {
-					pr_err("port %d: unexpected socket error",
-					       port_number(p));
-					event = EV_FAULT_DETECTED;
-				} else {
-					event = port_event(p, i);
-				}
-				if (EV_STATE_DECISION_EVENT == event) {
-					c->sde = 1;
-				}
-				if (EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES == event) {
-					c->sde = 1;
-				}
-				if (EV_FAULT_DETECTED == event) {
-					c->sde = 1;
-				}
-				port_dispatch(p, event, 0);
-				/* Clear any fault after a little while. */
-				if (PS_FAULTY == port_state(p)) {
-					clock_fault_timeout(p, 1);
-					break;
-				}
+	/*
+	 * Handle the ready descriptors in index order, just as a full
+	 * scan would, since fd.h relies on that ordering.
+	 */
+	for (i = 0; i < N_POLLFD; i++) {
+		if (!(revents[i] & (EPOLLIN|EPOLLPRI|EPOLLERR))) {
+			continue;
+		}
+		if (revents[i] & EPOLLERR) {
+			/* Keyed transmit time stamps arrive as errors. */
+			event = EV_FAULT_DETECTED;
+			if (i == FD_EVENT) {
+				event = port_txts_event(p);
+			}
+			if (EV_FAULT_DETECTED == event) {
+				pr_err("port %d: unexpected socket error",
+				       port_number(p));
 			}
+		} else {
+			event = port_event(p, i);
 		}
+		faulty = clock_port_event(c, p, event);
 
-		/*
-		 * When the fault timer expires we clear the fault,
-		 * but only if the link is up.
-		 */
-		if (cur[N_POLLFD].revents & (POLLIN|POLLPRI)) {
-			clock_fault_timeout(p, 0);
-			if (port_link_status_get(p)) {
-				port_dispatch(p, EV_FAULT_CLEARED, 0);
-			}
+		/* Hand over the rest of a batched read without polling. */
+		while (!faulty && port_rx_pending(p, i)) {
+			faulty = clock_port_event(c, p, port_event(p, i));
 		}
+		if (faulty) {
+			break;
+		}
+	}
 
-		cur += N_CLOCK_PFD;
+	if (!faulty && revents[N_POLLFD + 1] & (EPOLLIN|EPOLLPRI)) {
+		clock_port_event(c, p, port_txts_timeout(p));
 	}
 
-	/* Check the UDS port. */
+	/*
+	 * When the fault timer expires we clear the fault,
+	 * but only if the link is up.
+	 */
+	if (revents[N_POLLFD] & (EPOLLIN|EPOLLPRI)) {
+		clock_fault_timeout(p, 0);
+		if (port_link_status_get(p)) {
+			port_dispatch(p, EV_FAULT_CLEARED, 0);
+		}
+	}
+}
+
+static void clock_uds_dispatch(struct clock *c, struct clock_pfd *pfd)
+{
+	enum fsm_event event;
+	int i;
+
 	for (i = 0; i < N_POLLFD; i++) {
-		if (cur[i].revents & (POLLIN|POLLPRI)) {
+		if (pfd->revents[i] & (EPOLLIN|EPOLLPRI)) {
 			event = port_event(c->uds_port, i);
 			if (EV_STATE_DECISION_EVENT == event) {
 				c->sde = 1;
 			}
 		}
 	}
+}
+
+static void clock_publish_state(struct clock *c)
+{
+	struct state_shm_snapshot snap;
+	struct port *p;
+	int n;
+
+	snap.numberPorts = c->nports;
+	memset(&snap, 0, state_shm_snapshot_size(&snap));
+
+	snap.alive = 1;
+	snap.numberPorts = c->nports;
+	snap.clockIdentity = c->dds.clockIdentity;
+	snap.parent = c->dad.pds;
+	snap.timeprop = c->tds;
+	snap.servo_state = c->servo_state;
+	snap.master_offset = tmv_to_nanoseconds(c->master_offset);
+	snap.path_delay = tmv_to_nanoseconds(c->path_delay);
+	snap.freq = c->freq;
+
+	LIST_FOREACH(p, &c->ports, list) {
+		n = port_number(p);
+		if (n < 1 || n > STATE_SHM_MAX_PORTS) {
+			continue;
+		}
+		port_state_snapshot(p, &snap.port[n - 1]);
+	}
+	state_shm_publish(c->state_shm, &snap);
+}
+
+int clock_poll(struct clock *c)
+{
+	struct clock_pfd *pfd, *ready = NULL;
+	struct clock_pfd_slot *slot;
+	struct twheel_timer *t;
+	int cnt, i, timeout;
+
+	clock_check_epoll(c);
+	/* Expired timers stay pending until their ports rearm them. */
+	timeout = twheel_expired(c->wheel) ? 0 : -1;
+	cnt = epoll_wait(c->epfd, c->events, (c->nports + 1) * N_CLOCK_PFD,
+			 timeout);
+	if (cnt < 0) {
+		if (EINTR == errno) {
+			return 0;
+		} else {
+			pr_emerg("epoll_wait failed");
+			return -1;
+		}
+	}
+
+	/* Gather the ready descriptors by port. */
+	for (i = 0; i < cnt; i++) {
+		slot = c->events[i].data.ptr;
+		pfd = slot->pfd;
+		if (!pfd) {
+			if (twheel_run(c->wheel)) {
+				return -1;
+			}
+			continue;
+		}
+		pfd->revents[slot->index] = c->events[i].events;
+		if (!pfd->ready && pfd != c->uds_pfd) {
+			pfd->ready = 1;
+			pfd->next_ready = ready;
+			ready = pfd;
+		}
+	}
+	for (t = twheel_expired(c->wheel); t; t = LIST_NEXT(t, list)) {
+		pfd = t->owner;
+		pfd->revents[t->id] |= EPOLLIN;
+		if (!pfd->ready && pfd != c->uds_pfd) {
+			pfd->ready = 1;
+			pfd->next_ready = ready;
+			ready = pfd;
+		}
+	}
+
+	/* Let the ports handle their events. */
+	for (pfd = ready; pfd; pfd = pfd->next_ready) {
+		clock_pfd_dispatch(c, pfd);
+		memset(pfd->revents, 0, sizeof(pfd->revents));
+		pfd->ready = 0;
+	}
+
+	/* Check the UDS port. */
+	clock_uds_dispatch(c, c->uds_pfd);
+	memset(c->uds_pfd->revents, 0, sizeof(c->uds_pfd->revents));
 
 	if (c->sde) {
 		handle_state_decision_event(c);
 		c->sde = 0;
 	}
 	clock_prune_subscriptions(c);
+	if (c->state_shm && c->state_changed) {
+		clock_publish_state(c);
+		c->state_changed = 0;
+	}
 	return 0;
 }
 
@@ -1737,6 +2070,7 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 	int64_t offset;
 
 	c->ingress_ts = ingress;
+	c->state_changed = 1;
 
 	tsproc_down_ts(c->tsproc, origin, ingress);
 
@@ -1762,6 +2096,7 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 	adj = servo_sample(c->servo, offset, tmv_to_nanoseconds(ingress),
 			   weight, &state);
 	c->servo_state = state;
+	c->freq = adj;
 
 	tsproc_set_clock_rate_ratio(c->tsproc, clock_rate_ratio(c));
 
@@ -1792,6 +2127,11 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 		break;
 	}
 
+	/* Let subscribers like phc2sys sample the clock right away. */
+	if (state != SERVO_UNLOCKED) {
+		clock_notify_event(c, NOTIFY_TIME_SYNC);
+	}
+
 	if (c->stats.max_count > 1) {
 		clock_stats_update(&c->stats, tmv_dbl(c->master_offset), adj);
 	} else {
@@ -1859,6 +2199,8 @@ static void handle_state_decision_event(struct clock *c)
 	struct port *piter;
 	int fresh_best = 0;
 
+	c->state_changed = 1;
+
 	LIST_FOREACH(piter, &c->ports, list) {
 		fc = port_compute_best(piter);
 		if (!fc)
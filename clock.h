@@ -176,7 +176,7 @@ struct ClockIdentity clock_identity(struct clock *c);
 
 /**
  * Informs clock that a file descriptor of one of its ports changed. The
- * clock will rebuild its array of file descriptors to poll.
+ * clock will update its epoll registrations before the next poll.
  * @param c    The clock instance.
  */
 void clock_fda_changed(struct clock *c);
@@ -188,15 +188,28 @@ void clock_fda_changed(struct clock *c);
  */
 tmv_t clock_ingress_time(struct clock *c);
 
+/**
+ * Tells whether a management message arriving on a given port would be
+ * relayed to at least one other port.
+ * @param c  The clock instance.
+ * @param p  The port on which the message arrives.
+ * @return   One if the message may be relayed, zero otherwise.
+ */
+int clock_forwards_mgmt(struct clock *c, struct port *p);
+
 /**
  * Manage the clock according to a given message.
- * @param c    The clock instance.
- * @param p    The port on which the message arrived.
- * @param msg  A management message.
- * @return     One if the management action caused a change that
- *             implies a state decision event, zero otherwise.
+ * @param c     The clock instance.
+ * @param p     The port on which the message arrived.
+ * @param msg   A management message.
+ * @param wire  The same message as received, still in network byte
+ *              order, to be relayed to the other ports. May be NULL,
+ *              in which case 'msg' itself is relayed.
+ * @return      One if the management action caused a change that
+ *              implies a state decision event, zero otherwise.
  */
-int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg);
+int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg,
+		 struct ptp_message *wire);
 
 /**
  * Send notification about an event to all subscribers.
@@ -271,6 +284,12 @@ double clock_get_nrr(struct clock *c);
  */
 void clock_set_sde(struct clock *c, int sde);
 
+/**
+ * Marks the state published via shared memory as out of date.
+ * @param c     A pointer to a clock instance obtained with clock_create().
+ */
+void clock_state_changed(struct clock *c);
+
 /**
  * Poll for events and dispatch them.
  * @param c A pointer to a clock instance obtained with clock_create().
@@ -27,6 +27,9 @@
  * ANNOUNCE and SYNC_RX timers in order to correctly handle the case
  * when the DELAY timer and one of the other two expire during the
  * same call to poll().
+ *
+ * The timers are not descriptors of their own, but rather live on the
+ * clock's timing wheel, and so their entries in the fdarray are unused.
  */
 enum {
 	FD_EVENT,
@@ -18,8 +18,10 @@
  */
 
 #include "filter_private.h"
+#include "hmedian.h"
 #include "mave.h"
 #include "mmedian.h"
+#include "mmin.h"
 
 struct filter *filter_create(enum filter_type type, int length)
 {
@@ -28,6 +30,12 @@ struct filter *filter_create(enum filter_type type, int length)
 		return mave_create(length);
 	case FILTER_MOVING_MEDIAN:
 		return mmedian_create(length);
+	case FILTER_HEAP_MEDIAN:
+		return hmedian_create(length);
+	case FILTER_MOVING_MINIMUM:
+		return mmin_create(length);
+	case FILTER_LOWER_MEAN:
+		return lmean_create(length);
 	default:
 		return NULL;
 	}
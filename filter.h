@@ -31,6 +31,9 @@ struct filter;
 enum filter_type {
 	FILTER_MOVING_AVERAGE,
 	FILTER_MOVING_MEDIAN,
+	FILTER_HEAP_MEDIAN,
+	FILTER_MOVING_MINIMUM,
+	FILTER_LOWER_MEAN,
 };
 
 /**
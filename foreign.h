@@ -20,6 +20,7 @@
 #ifndef HAVE_FOREIGN_H
 #define HAVE_FOREIGN_H
 
+#include <stdint.h>
 #include <sys/queue.h>
 
 #include "ds.h"
@@ -27,6 +28,12 @@
 
 #define FOREIGN_MASTER_THRESHOLD 2
 
+/*
+ * Capacity of the announce message ring of a foreign clock. Must be a
+ * power of two, larger than FOREIGN_MASTER_THRESHOLD.
+ */
+#define FOREIGN_MASTER_RING 4
+
 struct foreign_clock {
 	/**
 	 * Pointer to next foreign_clock in list.
@@ -34,19 +41,35 @@ struct foreign_clock {
 	LIST_ENTRY(foreign_clock) list;
 
 	/**
-	 * A list of received announce messages.
+	 * Pointer to next foreign_clock in the same hash bucket.
+	 */
+	LIST_ENTRY(foreign_clock) hash;
+
+	/**
+	 * A ring of received announce messages, the latest at 'head'.
 	 *
 	 * The data set field, foreignMasterPortIdentity, is the
 	 * sourcePortIdentity of the first message.
 	 */
-	TAILQ_HEAD(messages, ptp_message) messages;
+	struct ptp_message *ring[FOREIGN_MASTER_RING];
 
 	/**
-	 * Number of elements in the message list,
+	 * Index of the latest message in the ring.
+	 */
+	unsigned int head;
+
+	/**
+	 * Number of elements in the message ring,
 	 * aka foreignMasterAnnounceMessages.
 	 */
 	unsigned int n_messages;
 
+	/**
+	 * Time at which the latest announce message, counted or not,
+	 * ceases to be current, in nanoseconds of CLOCK_MONOTONIC.
+	 */
+	int64_t expiry;
+
 	/**
 	 * Pointer to the associated port.
 	 */
@@ -59,4 +82,39 @@ struct foreign_clock {
 	struct dataset dataset;
 };
 
+/**
+ * Obtain the most recently received announce message of a foreign clock.
+ * @param fc  A foreign clock.
+ * @return    The latest message, or NULL if there are none.
+ */
+static inline struct ptp_message *fc_latest(struct foreign_clock *fc)
+{
+	return fc->n_messages ? fc->ring[fc->head] : NULL;
+}
+
+/**
+ * Obtain the announce message received just before the latest one.
+ * @param fc  A foreign clock.
+ * @return    The previous message, or NULL if there is none.
+ */
+static inline struct ptp_message *fc_previous(struct foreign_clock *fc)
+{
+	unsigned int i = (fc->head - 1) & (FOREIGN_MASTER_RING - 1);
+
+	return fc->n_messages > 1 ? fc->ring[i] : NULL;
+}
+
+/**
+ * Obtain the oldest announce message of a foreign clock.
+ * @param fc  A foreign clock.
+ * @return    The oldest message, or NULL if there are none.
+ */
+static inline struct ptp_message *fc_oldest(struct foreign_clock *fc)
+{
+	unsigned int i = (fc->head - fc->n_messages + 1) &
+		(FOREIGN_MASTER_RING - 1);
+
+	return fc->n_messages ? fc->ring[i] : NULL;
+}
+
 #endif
@@ -0,0 +1,254 @@
+/**
+ * @file hmedian.c
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
+ */
+#include <stdlib.h>
+
+#include "hmedian.h"
+#include "filter_private.h"
+
+/*
+ * The smaller samples are kept in a max-heap, the larger ones in a
+ * min-heap. For the median, the lower heap holds half of the samples,
+ * plus the extra one when the count is odd, and the median is found at
+ * the tops. For the lower mean, the lower heap holds a quarter of the
+ * samples, rounded up, and the output is their average.
+ */
+struct heap {
+	/* Indices into the circular buffer, in heap order. */
+	int *slot;
+	int n;
+	/* One (1) for a max-heap, minus one (-1) for a min-heap. */
+	int dir;
+};
+
+struct hmedian {
+	struct filter filter;
+	int lower_mean;
+	tmv_t lo_sum;
+	int cnt;
+	int len;
+	int index;
+	struct heap lo;
+	struct heap hi;
+	/* Heap position of each sample, negative within 'hi'. */
+	int *pos;
+	/* Values stored in circular buffer. */
+	tmv_t *samples;
+};
+
+static void heap_set(struct hmedian *m, struct heap *h, int i, int slot)
+{
+	h->slot[i] = slot;
+	m->pos[slot] = h == &m->lo ? i : -1 - i;
+}
+
+static int heap_above(struct hmedian *m, struct heap *h, int a, int b)
+{
+	return h->dir * tmv_cmp(m->samples[h->slot[a]],
+				m->samples[h->slot[b]]) > 0;
+}
+
+static void heap_swap(struct hmedian *m, struct heap *h, int a, int b)
+{
+	int tmp = h->slot[a];
+
+	heap_set(m, h, a, h->slot[b]);
+	heap_set(m, h, b, tmp);
+}
+
+static int heap_up(struct hmedian *m, struct heap *h, int i)
+{
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!heap_above(m, h, i, parent))
+			break;
+		heap_swap(m, h, i, parent);
+		i = parent;
+	}
+	return i;
+}
+
+static void heap_down(struct hmedian *m, struct heap *h, int i)
+{
+	int child, top;
+
+	while (1) {
+		top = i;
+		child = 2 * i + 1;
+		if (child < h->n && heap_above(m, h, child, top))
+			top = child;
+		child++;
+		if (child < h->n && heap_above(m, h, child, top))
+			top = child;
+		if (top == i)
+			break;
+		heap_swap(m, h, i, top);
+		i = top;
+	}
+}
+
+static void heap_push(struct hmedian *m, struct heap *h, int slot)
+{
+	if (h == &m->lo)
+		m->lo_sum = tmv_add(m->lo_sum, m->samples[slot]);
+	heap_set(m, h, h->n, slot);
+	heap_up(m, h, h->n++);
+}
+
+static int heap_pop(struct hmedian *m, struct heap *h)
+{
+	int top = h->slot[0];
+
+	if (h == &m->lo)
+		m->lo_sum = tmv_sub(m->lo_sum, m->samples[top]);
+	h->n--;
+	if (h->n) {
+		heap_set(m, h, 0, h->slot[h->n]);
+		heap_down(m, h, 0);
+	}
+	return top;
+}
+
+static tmv_t heap_top(struct hmedian *m, struct heap *h)
+{
+	return m->samples[h->slot[0]];
+}
+
+/* Returns the number of samples belonging in the lower heap. */
+static int lo_size(struct hmedian *m)
+{
+	return m->lower_mean ? (m->cnt + 3) / 4 : (m->cnt + 1) / 2;
+}
+
+static void hmedian_destroy(struct filter *filter)
+{
+	struct hmedian *m = container_of(filter, struct hmedian, filter);
+	free(m->lo.slot);
+	free(m->hi.slot);
+	free(m->pos);
+	free(m->samples);
+	free(m);
+}
+
+static tmv_t hmedian_sample(struct filter *filter, tmv_t sample)
+{
+	struct hmedian *m = container_of(filter, struct hmedian, filter);
+	int lo, hi, p;
+
+	if (m->cnt < m->len) {
+		m->samples[m->index] = sample;
+		m->cnt++;
+		if (m->lo.n && tmv_cmp(sample, heap_top(m, &m->lo)) > 0)
+			heap_push(m, &m->hi, m->index);
+		else
+			heap_push(m, &m->lo, m->index);
+
+		if (m->lo.n > lo_size(m))
+			heap_push(m, &m->hi, heap_pop(m, &m->lo));
+		else if (m->lo.n < lo_size(m))
+			heap_push(m, &m->lo, heap_pop(m, &m->hi));
+	} else {
+		/*
+		 * The new value takes the place of the oldest one in its
+		 * heap. At most one pair of samples then sits on the wrong
+		 * side, namely the two tops.
+		 */
+		p = m->pos[m->index];
+		if (p >= 0) {
+			m->lo_sum = tmv_sub(m->lo_sum, m->samples[m->index]);
+			m->lo_sum = tmv_add(m->lo_sum, sample);
+			m->samples[m->index] = sample;
+			heap_down(m, &m->lo, heap_up(m, &m->lo, p));
+		} else {
+			m->samples[m->index] = sample;
+			heap_down(m, &m->hi, heap_up(m, &m->hi, -1 - p));
+		}
+
+		if (m->hi.n &&
+		    tmv_cmp(heap_top(m, &m->lo), heap_top(m, &m->hi)) > 0) {
+			lo = m->lo.slot[0];
+			hi = m->hi.slot[0];
+			m->lo_sum = tmv_sub(m->lo_sum, m->samples[lo]);
+			m->lo_sum = tmv_add(m->lo_sum, m->samples[hi]);
+			heap_set(m, &m->lo, 0, hi);
+			heap_set(m, &m->hi, 0, lo);
+			heap_down(m, &m->lo, 0);
+			heap_down(m, &m->hi, 0);
+		}
+	}
+
+	m->index = (1 + m->index) % m->len;
+
+	if (m->lower_mean)
+		return tmv_div(m->lo_sum, m->lo.n);
+	if (m->cnt % 2)
+		return heap_top(m, &m->lo);
+	else
+		return tmv_div(tmv_add(heap_top(m, &m->lo),
+				       heap_top(m, &m->hi)), 2);
+}
+
+static void hmedian_reset(struct filter *filter)
+{
+	struct hmedian *m = container_of(filter, struct hmedian, filter);
+	m->cnt = 0;
+	m->index = 0;
+	m->lo.n = 0;
+	m->hi.n = 0;
+	m->lo_sum = tmv_zero();
+}
+
+static struct filter *heap_filter_create(int length, int lower_mean)
+{
+	struct hmedian *m;
+
+	if (length < 1)
+		return NULL;
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return NULL;
+	m->filter.destroy = hmedian_destroy;
+	m->filter.sample = hmedian_sample;
+	m->filter.reset = hmedian_reset;
+	m->lower_mean = lower_mean;
+	m->lo.dir = 1;
+	m->hi.dir = -1;
+	/* Either heap briefly holds one extra sample while rebalancing. */
+	m->lo.slot = calloc(1, (length + 1) * sizeof(*m->lo.slot));
+	m->hi.slot = calloc(1, (length + 1) * sizeof(*m->hi.slot));
+	m->pos = calloc(1, length * sizeof(*m->pos));
+	m->samples = calloc(1, length * sizeof(*m->samples));
+	if (!m->lo.slot || !m->hi.slot || !m->pos || !m->samples) {
+		hmedian_destroy(&m->filter);
+		return NULL;
+	}
+	m->len = length;
+	return &m->filter;
+}
+
+struct filter *hmedian_create(int length)
+{
+	return heap_filter_create(length, 0);
+}
+
+struct filter *lmean_create(int length)
+{
+	return heap_filter_create(length, 1);
+}
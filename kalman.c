@@ -0,0 +1,314 @@
+/**
+ * @file kalman.c
+ * @brief Implements a clock servo based on a Kalman filter.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
+ */
+#include <stdlib.h>
+#include <math.h>
+
+#include "kalman.h"
+#include "print.h"
+#include "servo_private.h"
+
+/* Initial standard deviation of the measured offset, in ns */
+#define HWTS_NOISE 20.0
+#define SWTS_NOISE 1000.0
+/* Lower bound of the standard deviation of the measured offset, in ns */
+#define MIN_NOISE 1.0
+/*
+ * Initial random walk of the frequency of the oscillator and its
+ * bounds, in ppb per sqrt(s)
+ */
+#define FREQ_WANDER 3.0
+#define MIN_FREQ_WANDER 0.01
+#define MAX_FREQ_WANDER 1000.0
+/* Rate at which the random walk of the frequency adapts */
+#define WANDER_GAIN 0.05
+/* Random walk of the phase of the oscillator, in ns per sqrt(s) */
+#define PHASE_WANDER 1.0
+/* Smoothing factor of the estimates of the noise and of the innovations */
+#define NOISE_SMOOTH 0.02
+/*
+ * Innovations beyond this many standard deviations are suspect. After
+ * two in a row, the frequency is taken to have changed.
+ */
+#define GATE 4.0
+/* Number of sync intervals over which to correct the estimated offset */
+#define CORR_INTERVALS 1.0
+
+struct kalman_servo {
+	struct servo servo;
+	/* Estimated offset (ns) and frequency offset (ppb) of the clock */
+	double phase;
+	double freq;
+	/* Covariance of the estimate */
+	double p[2][2];
+	/* Variance of the measured offset */
+	double noise;
+	/* Variance of the random walk of the frequency per second */
+	double wander;
+	/* Variance of the innovations and the latest normalized one */
+	double innov_var;
+	double last_innov;
+	double initial_noise;
+	/* Number of consecutive suspect innovations */
+	int misses;
+	/* Latest measurement */
+	int64_t offset;
+	uint64_t local;
+	/* Frequency adjustment currently applied to the clock */
+	double last_freq;
+	/* Expected interval between updates */
+	double update_interval;
+	int count;
+};
+
+static void kalman_destroy(struct servo *servo)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+	free(s);
+}
+
+static void kalman_predict(struct kalman_servo *s, double t)
+{
+	double q_phase, q_freq, p00, p01, p11;
+
+	/* The clock drifts by its frequency offset less the correction. */
+	s->phase += (s->freq - s->last_freq) * t;
+
+	q_phase = PHASE_WANDER * PHASE_WANDER;
+	q_freq = s->wander;
+
+	p00 = s->p[0][0] + t * (2 * s->p[0][1] + t * s->p[1][1]);
+	p01 = s->p[0][1] + t * s->p[1][1];
+	p11 = s->p[1][1];
+
+	s->p[0][0] = p00 + q_phase * t + q_freq * t * t * t / 3;
+	s->p[0][1] = p01 + q_freq * t * t / 2;
+	s->p[1][0] = s->p[0][1];
+	s->p[1][1] = p11 + q_freq * t;
+}
+
+static void kalman_update(struct kalman_servo *s, int64_t offset,
+			  double weight, double t)
+{
+	double innov, limit, nu, r, var, k0, k1, p00, p01, p11;
+
+	innov = offset - s->phase;
+	if (weight <= 0.0)
+		weight = 1.0;
+
+	r = s->noise / weight;
+	limit = GATE * GATE * (s->p[0][0] + r);
+
+	if (innov * innov > limit) {
+		s->misses++;
+	} else {
+		s->misses = 0;
+	}
+	if (s->misses >= 2) {
+		/*
+		 * The clock no longer follows the model, for example
+		 * after a change of master. Let go of the estimate, so
+		 * that the following samples quickly take over.
+		 */
+		s->p[0][0] += innov * innov;
+		s->p[1][1] += innov * innov / (t * t);
+		s->last_innov = 0.0;
+	} else {
+		/*
+		 * Track the measurement noise from the innovations, whose
+		 * variance is that of the prediction plus that of the
+		 * measurement. Samples of low weight count as noisier.
+		 * A lone suspect innovation, likely an outlier, counts
+		 * only up to the limit, here and in the update below.
+		 */
+		if (innov * innov > limit)
+			innov = innov > 0 ? sqrt(limit) : -sqrt(limit);
+
+		/*
+		 * With the right random walk of the frequency the
+		 * innovations are white. Too little of it makes the
+		 * estimate lag behind, and consecutive innovations tend
+		 * to agree in sign. Too much of it chases the noise, and
+		 * they tend to alternate.
+		 */
+		s->innov_var += NOISE_SMOOTH * (innov * innov - s->innov_var);
+		nu = innov / sqrt(s->innov_var);
+		s->wander *= exp(WANDER_GAIN * nu * s->last_innov);
+		if (s->wander < MIN_FREQ_WANDER * MIN_FREQ_WANDER)
+			s->wander = MIN_FREQ_WANDER * MIN_FREQ_WANDER;
+		else if (s->wander > MAX_FREQ_WANDER * MAX_FREQ_WANDER)
+			s->wander = MAX_FREQ_WANDER * MAX_FREQ_WANDER;
+		s->last_innov = nu;
+
+		var = weight * (innov * innov - s->p[0][0]);
+		if (var < MIN_NOISE * MIN_NOISE)
+			var = MIN_NOISE * MIN_NOISE;
+		s->noise += NOISE_SMOOTH * (var - s->noise);
+		r = s->noise / weight;
+	}
+
+	p00 = s->p[0][0];
+	p01 = s->p[0][1];
+	p11 = s->p[1][1];
+
+	k0 = p00 / (p00 + r);
+	k1 = p01 / (p00 + r);
+
+	s->phase += k0 * innov;
+	s->freq += k1 * innov;
+
+	s->p[0][0] = (1 - k0) * p00;
+	s->p[0][1] = (1 - k0) * p01;
+	s->p[1][0] = s->p[0][1];
+	s->p[1][1] = p11 - k1 * p01;
+}
+
+static double kalman_sample(struct servo *servo,
+			    int64_t offset,
+			    uint64_t local_ts,
+			    double weight,
+			    enum servo_state *state)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+	double ppb = s->last_freq, t;
+
+	switch (s->count) {
+	case 0:
+		s->offset = offset;
+		s->local = local_ts;
+		*state = SERVO_UNLOCKED;
+		s->count = 1;
+		break;
+	case 1:
+		/* Make sure the first sample is older than the second. */
+		if (s->local >= local_ts) {
+			*state = SERVO_UNLOCKED;
+			s->count = 0;
+			break;
+		}
+
+		/*
+		 * Start from the frequency offset measured between the two
+		 * samples, whose uncertainty follows from the noise of the
+		 * two offsets.
+		 */
+		t = (local_ts - s->local) / 1e9;
+		s->freq = s->last_freq +
+			(1e9 - s->last_freq) * (offset - s->offset) /
+			(local_ts - s->local);
+		s->phase = offset;
+		s->noise = s->initial_noise;
+		s->innov_var = 2 * s->noise;
+		s->p[0][0] = s->noise;
+		s->p[0][1] = s->noise / t;
+		s->p[1][0] = s->p[0][1];
+		s->p[1][1] = 2 * s->noise / (t * t);
+
+		if ((servo->first_update &&
+		     servo->first_step_threshold &&
+		     servo->first_step_threshold < llabs(offset)) ||
+		    (servo->step_threshold &&
+		     servo->step_threshold < llabs(offset))) {
+			/* The clock will be stepped by offset */
+			s->phase = 0.0;
+			local_ts -= offset;
+			*state = SERVO_JUMP;
+		} else {
+			*state = SERVO_LOCKED;
+		}
+
+		s->local = local_ts;
+		s->count = 2;
+		ppb = s->freq;
+		break;
+	case 2:
+		/*
+		 * As with the PI servo, start over when the offset is
+		 * larger than the step threshold.
+		 */
+		if (servo->step_threshold &&
+		    servo->step_threshold < llabs(offset)) {
+			*state = SERVO_UNLOCKED;
+			s->count = 0;
+			break;
+		}
+
+		t = local_ts > s->local ?
+			(local_ts - s->local) / 1e9 : s->update_interval;
+		s->local = local_ts;
+
+		kalman_predict(s, t);
+		kalman_update(s, offset, weight, t);
+
+		/*
+		 * Dial in the estimated frequency offset and correct the
+		 * estimated phase offset over the next few updates.
+		 */
+		ppb = s->freq + s->phase / (CORR_INTERVALS * s->update_interval);
+
+		pr_debug("kalman: phase %.0f freq %.3f noise %.0f wander %.2f",
+			 s->phase, s->freq, sqrt(s->noise), sqrt(s->wander));
+		*state = SERVO_LOCKED;
+		break;
+	}
+
+	if (ppb < -servo->max_frequency)
+		ppb = -servo->max_frequency;
+	else if (ppb > servo->max_frequency)
+		ppb = servo->max_frequency;
+
+	s->last_freq = ppb;
+	return ppb;
+}
+
+static void kalman_sync_interval(struct servo *servo, double interval)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+
+	s->update_interval = interval;
+}
+
+static void kalman_reset(struct servo *servo)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+
+	s->count = 0;
+}
+
+struct servo *kalman_servo_create(int fadj, int sw_ts)
+{
+	struct kalman_servo *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+
+	s->servo.destroy = kalman_destroy;
+	s->servo.sample = kalman_sample;
+	s->servo.sync_interval = kalman_sync_interval;
+	s->servo.reset = kalman_reset;
+
+	s->last_freq = fadj;
+	s->update_interval = 1.0;
+	s->wander = FREQ_WANDER * FREQ_WANDER;
+	s->initial_noise = sw_ts ? SWTS_NOISE * SWTS_NOISE :
+		HWTS_NOISE * HWTS_NOISE;
+
+	return &s->servo;
+}
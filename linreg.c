@@ -45,7 +45,18 @@ struct point {
 	double w;
 };
 
+/* Weighted sums over the points of one regression window */
+struct sums {
+	double x;
+	double y;
+	double xy;
+	double x2;
+	double w;
+};
+
 struct result {
+	/* Running sums over the points of this size */
+	struct sums sums;
 	/* Slope and intercept from latest regression */
 	double slope;
 	double intercept;
@@ -65,6 +76,10 @@ struct linreg_servo {
 	unsigned int num_points;
 	/* Index of the newest point */
 	unsigned int last_point;
+	/* Origin of the coordinates of the running sums */
+	struct point anchor;
+	/* Number of points added since the sums were recomputed */
+	unsigned int sum_updates;
 	/* Remainder from last update of reference.x */
 	double x_remainder;
 	/* Local time stamp of last update */
@@ -123,29 +138,91 @@ static void update_reference(struct linreg_servo *s, uint64_t local_ts)
 	s->last_update = local_ts;
 }
 
+static void sums_add(struct linreg_servo *s, struct sums *sums,
+		     struct point *p, double sign)
+{
+	double x, y, w;
+
+	x = (int64_t)(p->x - s->anchor.x);
+	y = (int64_t)(p->y - s->anchor.y);
+	w = sign * p->w;
+
+	sums->x += x * w;
+	sums->y += y * w;
+	sums->xy += x * y * w;
+	sums->x2 += x * x * w;
+	sums->w += w;
+}
+
+/*
+ * Recomputes the running sums of all sizes from the stored points,
+ * which discards the rounding errors accumulated by the updates and
+ * keeps the coordinates near the origin.
+ */
+static void sums_refresh(struct linreg_servo *s)
+{
+	struct sums sums = { 0 };
+	unsigned int i, l, size;
+
+	s->anchor = s->reference;
+	s->sum_updates = 0;
+
+	for (i = 0, size = MIN_SIZE; size <= MAX_SIZE; size++) {
+		for (; i < (1U << size) && i < s->num_points; i++) {
+			/* Iterate points from newest to oldest */
+			l = (MAX_POINTS + s->last_point - i) % MAX_POINTS;
+			sums_add(s, &sums, &s->points[l], 1.0);
+		}
+		s->results[size - MIN_SIZE].sums = sums;
+	}
+}
+
 static void add_sample(struct linreg_servo *s, int64_t offset, double weight)
 {
+	unsigned int l, n, size;
+
 	s->last_point = (s->last_point + 1) % MAX_POINTS;
 
+	/* Drop the points leaving the full windows, before overwriting. */
+	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+		n = 1 << size;
+		if (n > s->num_points)
+			break;
+		l = (MAX_POINTS + s->last_point - n) % MAX_POINTS;
+		sums_add(s, &s->results[size - MIN_SIZE].sums,
+			 &s->points[l], -1.0);
+	}
+
 	s->points[s->last_point].x = s->reference.x;
 	s->points[s->last_point].y = s->reference.y - offset;
 	s->points[s->last_point].w = weight;
 
 	if (s->num_points < MAX_POINTS)
 		s->num_points++;
+
+	if (s->num_points == 1 || ++s->sum_updates >= MAX_POINTS) {
+		sums_refresh(s);
+		return;
+	}
+	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+		sums_add(s, &s->results[size - MIN_SIZE].sums,
+			 &s->points[s->last_point], 1.0);
+	}
 }
 
 static void regress(struct linreg_servo *s)
 {
-	double x, y, y0, e, x_sum, y_sum, xy_sum, x2_sum, w, w_sum;
-	unsigned int i, l, n, size;
+	double y0, e, dx, dy;
+	unsigned int n, size;
 	struct result *res;
-
-	x_sum = 0.0, y_sum = 0.0, xy_sum = 0.0, x2_sum = 0.0; w_sum = 0.0;
-	i = 0;
+	struct sums *sums;
 
 	y0 = (int64_t)(s->points[s->last_point].y - s->reference.y);
 
+	/* Offset of the current reference from the origin of the sums */
+	dx = (int64_t)(s->reference.x - s->anchor.x);
+	dy = (int64_t)(s->reference.y - s->anchor.y);
+
 	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
 		n = 1 << size;
 		if (n > s->num_points)
@@ -167,25 +244,12 @@ static void regress(struct linreg_servo *s)
 			}
 		}
 
-		for (; i < n; i++) {
-			/* Iterate points from newest to oldest */
-			l = (MAX_POINTS + s->last_point - i) % MAX_POINTS;
-
-			x = (int64_t)(s->points[l].x - s->reference.x);
-			y = (int64_t)(s->points[l].y - s->reference.y);
-			w = s->points[l].w;
-
-			x_sum += x * w;
-			y_sum += y * w;
-			xy_sum += x * y * w;
-			x2_sum += x * x * w;
-			w_sum += w;
-		}
-
 		/* Get new intercept and slope */
-		res->slope = (xy_sum - x_sum * y_sum / w_sum) /
-				(x2_sum - x_sum * x_sum / w_sum);
-		res->intercept = (y_sum - res->slope * x_sum) / w_sum;
+		sums = &res->sums;
+		res->slope = (sums->xy - sums->x * sums->y / sums->w) /
+				(sums->x2 - sums->x * sums->x / sums->w);
+		res->intercept = (sums->y - res->slope * sums->x) / sums->w +
+				res->slope * dx - dy;
 	}
 }
 
@@ -0,0 +1,33 @@
+/**
+ * @file linreg_ref.h
+ * @note Copyright (C) 2014 Miroslav Lichvar <mlichvar@redhat.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_LINREG_REF_H
+#define HAVE_LINREG_REF_H
+
+#include "servo.h"
+
+/**
+ * Creates a linear regression servo which rebuilds its sums from all of
+ * the stored points on every sample, as linreg did originally. It only
+ * serves as a reference for the running sums of linreg.
+ * @param fadj  The clock's current adjustment in parts per billion.
+ * @return      A pointer to a new servo on success, NULL otherwise.
+ */
+struct servo *linreg_ref_servo_create(int fadj);
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file mmin.c
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
+ */
+#include <stdlib.h>
+
+#include "mmin.h"
+#include "filter_private.h"
+
+/*
+ * The candidates for the minimum, in order of arrival, form a queue
+ * of increasing values. A new sample evicts every candidate that is
+ * not smaller than itself, and the oldest candidate leaves once it
+ * drops out of the window, so each sample costs O(1) amortized.
+ */
+struct mmin {
+	struct filter filter;
+	int len;
+	/* Number of samples seen, modulo the integer range. */
+	unsigned int seq;
+	/* Circular queue of candidates. */
+	int head;
+	int cnt;
+	tmv_t *val;
+	unsigned int *arrival;
+};
+
+static void mmin_destroy(struct filter *filter)
+{
+	struct mmin *m = container_of(filter, struct mmin, filter);
+	free(m->val);
+	free(m->arrival);
+	free(m);
+}
+
+static tmv_t mmin_sample(struct filter *filter, tmv_t sample)
+{
+	struct mmin *m = container_of(filter, struct mmin, filter);
+	int tail;
+
+	while (m->cnt) {
+		tail = (m->head + m->cnt - 1) % m->len;
+		if (tmv_cmp(m->val[tail], sample) < 0)
+			break;
+		m->cnt--;
+	}
+	if (m->cnt && m->seq - m->arrival[m->head] >= (unsigned int) m->len) {
+		m->head = (m->head + 1) % m->len;
+		m->cnt--;
+	}
+
+	tail = (m->head + m->cnt) % m->len;
+	m->val[tail] = sample;
+	m->arrival[tail] = m->seq++;
+	m->cnt++;
+
+	return m->val[m->head];
+}
+
+static void mmin_reset(struct filter *filter)
+{
+	struct mmin *m = container_of(filter, struct mmin, filter);
+	m->head = 0;
+	m->cnt = 0;
+}
+
+struct filter *mmin_create(int length)
+{
+	struct mmin *m;
+
+	if (length < 1)
+		return NULL;
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return NULL;
+	m->filter.destroy = mmin_destroy;
+	m->filter.sample = mmin_sample;
+	m->filter.reset = mmin_reset;
+	m->val = calloc(1, length * sizeof(*m->val));
+	m->arrival = calloc(1, length * sizeof(*m->arrival));
+	if (!m->val || !m->arrival) {
+		mmin_destroy(&m->filter);
+		return NULL;
+	}
+	m->len = length;
+	return &m->filter;
+}
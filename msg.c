@@ -26,6 +26,7 @@
 #include "msg.h"
 #include "print.h"
 #include "tlv.h"
+#include "util.h"
 
 #define VERSION_MASK 0x0f
 #define VERSION      0x02
@@ -42,11 +43,23 @@ struct message_storage {
 	struct ptp_message msg;
 } PACKED;
 
+/*
+ * Messages carved out of a slab are aligned so that each 'msg' starts
+ * on a cache line, with the head room just in front of it.
+ */
+#define MSG_ALIGN 64
+#define MSG_STRIDE \
+	(MSG_ALIGN + ((sizeof(struct ptp_message) + MSG_ALIGN - 1) & ~(MSG_ALIGN - 1)))
+
 static TAILQ_HEAD(msg_pool, ptp_message) msg_pool = TAILQ_HEAD_INITIALIZER(msg_pool);
 
 static struct {
 	int total;
 	int count;
+	int capacity;
+	unsigned int exhausted;
+	void *slab;
+	size_t slab_len;
 } pool_stats;
 
 #ifdef DEBUG_POOL
@@ -263,6 +276,10 @@ struct ptp_message *msg_allocate(void)
 		TAILQ_REMOVE(&msg_pool, m, list);
 		pool_stats.count--;
 		pool_debug("dequeue", m);
+	} else if (pool_stats.slab) {
+		/* A fixed pool never grows. */
+		pool_stats.exhausted++;
+		pool_debug("exhausted", NULL);
 	} else {
 		s = malloc(sizeof(*s));
 		if (s) {
@@ -287,6 +304,12 @@ void msg_cleanup(void)
 
 	tlv_extra_cleanup();
 
+	if (pool_stats.slab) {
+		TAILQ_INIT(&msg_pool);
+		slab_unmap(pool_stats.slab, pool_stats.slab_len);
+		memset(&pool_stats, 0, sizeof(pool_stats));
+		return;
+	}
 	while ((m = TAILQ_FIRST(&msg_pool)) != NULL) {
 		TAILQ_REMOVE(&msg_pool, m, list);
 		s = container_of(m, struct message_storage, msg);
@@ -294,6 +317,42 @@ void msg_cleanup(void)
 	}
 }
 
+int msg_pool_reserve(int count, int flags)
+{
+	struct ptp_message *m;
+	unsigned char *base;
+	size_t len;
+	int i;
+
+	if (!count || pool_stats.slab || pool_stats.total) {
+		return 0;
+	}
+	len = (size_t) count * MSG_STRIDE;
+	base = slab_map(&len, flags);
+	if (!base) {
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		m = (struct ptp_message *) (base + i * MSG_STRIDE + MSG_ALIGN);
+		TAILQ_INSERT_TAIL(&msg_pool, m, list);
+	}
+	pool_stats.slab = base;
+	pool_stats.slab_len = len;
+	pool_stats.capacity = count;
+	pool_stats.total = count;
+	pool_stats.count = count;
+	return 0;
+}
+
+void msg_pool_stats(struct message_pool_np *mp)
+{
+	mp->msg_capacity = pool_stats.capacity;
+	mp->msg_total = pool_stats.total;
+	mp->msg_free = pool_stats.count;
+	mp->msg_exhausted = pool_stats.exhausted;
+	tlv_extra_pool_stats(mp);
+}
+
 struct ptp_message *msg_duplicate(struct ptp_message *msg, int cnt)
 {
 	struct ptp_message *dup;
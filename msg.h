@@ -361,6 +361,23 @@ void msg_get(struct ptp_message *m);
  */
 int msg_post_recv(struct ptp_message *m, int cnt);
 
+/**
+ * Preallocates a fixed number of messages. Once the pool is reserved,
+ * @ref msg_allocate() fails instead of growing it.
+ *
+ * @param count  The number of messages, or zero to grow on demand.
+ * @param flags  Bit mask of the SLAB_ flags from util.h.
+ * @return       Zero on success, non-zero otherwise.
+ */
+int msg_pool_reserve(int count, int flags);
+
+/**
+ * Reports the occupancy of the message and TLV pools.
+ *
+ * @param mp  Returns the pool statistics.
+ */
+void msg_pool_stats(struct message_pool_np *mp);
+
 /**
  * Prepare messages for transmission.
  * @param m  A message obtained using @ref msg_allocate().
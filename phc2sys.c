@@ -24,6 +24,8 @@
 #include <limits.h>
 #include <net/if.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -85,6 +87,19 @@ struct clock {
 	struct stats *freq_stats;
 	struct stats *delay_stats;
 	struct clockcheck *sanity_check;
+	struct sysoff_adapt *adapt;
+	/* worker thread, when clocks are updated in parallel */
+	struct phc2sys_private *priv;
+	pthread_t worker;
+	int worker_started;
+	int todo;
+	/* result of the last round, reported by the main loop */
+	int reported;
+	uint64_t sampled;
+	int64_t report_offset;
+	int64_t report_delay;
+	double report_freq;
+	enum servo_state report_state;
 };
 
 struct port {
@@ -99,15 +114,30 @@ struct phc2sys_private {
 	int sanity_freq_limit;
 	enum servo_type servo_type;
 	int phc_readings;
+	int adaptive_readings;
 	double phc_interval;
 	int forced_sync_offset;
 	int kernel_leap;
 	int state_changed;
+	int time_sync_events;
+	int time_synced;
 	struct pmc_node node;
 	LIST_HEAD(port_head, port) ports;
 	LIST_HEAD(clock_head, clock) clocks;
 	LIST_HEAD(dst_clock_head, clock) dst_clocks;
 	struct clock *master;
+	/* parallel clock updates */
+	int clock_threads;
+	cpu_set_t cpus;
+	int num_cpus;
+	int next_cpu;
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned int generation;
+	int pending;
+	int error;
+	int stop;
 };
 
 static struct config *phc2sys_config;
@@ -173,6 +203,7 @@ static struct clock *clock_add(struct phc2sys_private *priv, char *device)
 	c->clkid = clkid;
 	c->phc_index = phc_index;
 	c->servo_state = SERVO_UNLOCKED;
+	c->priv = priv;
 	c->device = device ? strdup(device) : NULL;
 
 	if (c->clkid == CLOCK_REALTIME) {
@@ -200,6 +231,13 @@ static struct clock *clock_add(struct phc2sys_private *priv, char *device)
 			return NULL;
 		}
 	}
+	if (priv->adaptive_readings) {
+		c->adapt = sysoff_adapt_create(priv->phc_readings);
+		if (!c->adapt) {
+			pr_err("failed to create adaptive readings");
+			return NULL;
+		}
+	}
 
 	if (clkid != CLOCK_INVALID)
 		c->servo = servo_add(priv, c);
@@ -223,6 +261,9 @@ static void clock_cleanup(struct phc2sys_private *priv)
 		if (c->sanity_check) {
 			clockcheck_destroy(c->sanity_check);
 		}
+		if (c->adapt) {
+			sysoff_adapt_destroy(c->adapt);
+		}
 		if (c->delay_stats) {
 			stats_destroy(c->delay_stats);
 		}
@@ -468,12 +509,18 @@ static void reconfigure(struct phc2sys_private *priv)
 }
 
 static int read_phc(clockid_t clkid, clockid_t sysclk, int readings,
+		    struct sysoff_adapt *adapt,
 		    int64_t *offset, uint64_t *ts, int64_t *delay)
 {
+	int64_t intervals[PTP_MAX_SAMPLES], offsets[PTP_MAX_SAMPLES];
+	uint64_t stamps[PTP_MAX_SAMPLES];
 	struct timespec tdst1, tdst2, tsrc;
-	int i;
+	int i, best;
 	int64_t interval, best_interval = INT64_MAX;
 
+	if (adapt)
+		readings = sysoff_adapt_samples(adapt);
+
 	/* Pick the quickest clkid reading. */
 	for (i = 0; i < readings; i++) {
 		if (clock_gettime(sysclk, &tdst1) ||
@@ -486,13 +533,27 @@ static int read_phc(clockid_t clkid, clockid_t sysclk, int readings,
 		interval = (tdst2.tv_sec - tdst1.tv_sec) * NS_PER_SEC +
 			tdst2.tv_nsec - tdst1.tv_nsec;
 
-		if (best_interval > interval) {
+		if (adapt) {
+			intervals[i] = interval;
+			offsets[i] = (tdst1.tv_sec - tsrc.tv_sec) * NS_PER_SEC +
+				tdst1.tv_nsec - tsrc.tv_nsec + interval / 2;
+			stamps[i] = tdst2.tv_sec * NS_PER_SEC + tdst2.tv_nsec;
+		} else if (best_interval > interval) {
 			best_interval = interval;
 			*offset = (tdst1.tv_sec - tsrc.tv_sec) * NS_PER_SEC +
 				tdst1.tv_nsec - tsrc.tv_nsec + interval / 2;
 			*ts = tdst2.tv_sec * NS_PER_SEC + tdst2.tv_nsec;
 		}
 	}
+
+	if (adapt) {
+		best = sysoff_adapt_select(adapt, intervals, readings);
+		if (best < 0)
+			return 0;
+		best_interval = intervals[best];
+		*offset = offsets[best];
+		*ts = stamps[best];
+	}
 	*delay = best_interval;
 
 	return 1;
@@ -511,6 +572,7 @@ static void update_clock_stats(struct clock *clock, unsigned int max_count,
 			       int64_t offset, double freq, int64_t delay)
 {
 	struct stats_result offset_stats, freq_stats, delay_stats;
+	struct sysoff_adapt_stats adapt_stats;
 
 	stats_add_value(clock->offset_stats, offset);
 	stats_add_value(clock->freq_stats, freq);
@@ -540,12 +602,41 @@ static void update_clock_stats(struct clock *clock, unsigned int max_count,
 			offset_stats.rms, offset_stats.max_abs,
 			freq_stats.mean, freq_stats.stddev);
 	}
+	if (clock->adapt) {
+		sysoff_adapt_stats(clock->adapt, &adapt_stats);
+		pr_info("%s "
+			"measurements %u rejected %u samples %4.1f "
+			"jitter %" PRId64 " reject above %" PRId64,
+			clock->device, adapt_stats.measurements,
+			adapt_stats.rejected, adapt_stats.samples,
+			adapt_stats.jitter, adapt_stats.reject_limit);
+	}
 
 	stats_reset(clock->offset_stats);
 	stats_reset(clock->freq_stats);
 	stats_reset(clock->delay_stats);
 }
 
+static void report_clock(struct phc2sys_private *priv, struct clock *clock,
+			 int64_t offset, enum servo_state state, double ppb,
+			 int64_t delay)
+{
+	if (clock->offset_stats) {
+		update_clock_stats(clock, priv->stats_max_count, offset, ppb, delay);
+	} else {
+		if (delay >= 0) {
+			pr_info("%s %s offset %9" PRId64 " s%d freq %+7.0f "
+				"delay %6" PRId64,
+				clock->device, priv->master->source_label,
+				offset, state, ppb, delay);
+		} else {
+			pr_info("%s %s offset %9" PRId64 " s%d freq %+7.0f",
+				clock->device, priv->master->source_label,
+				offset, state, ppb);
+		}
+	}
+}
+
 static void update_clock(struct phc2sys_private *priv, struct clock *clock,
 			 int64_t offset, uint64_t ts, int64_t delay)
 {
@@ -581,20 +672,16 @@ static void update_clock(struct phc2sys_private *priv, struct clock *clock,
 		break;
 	}
 
-	if (clock->offset_stats) {
-		update_clock_stats(clock, priv->stats_max_count, offset, ppb, delay);
-	} else {
-		if (delay >= 0) {
-			pr_info("%s %s offset %9" PRId64 " s%d freq %+7.0f "
-				"delay %6" PRId64,
-				clock->device, priv->master->source_label,
-				offset, state, ppb, delay);
-		} else {
-			pr_info("%s %s offset %9" PRId64 " s%d freq %+7.0f",
-				clock->device, priv->master->source_label,
-				offset, state, ppb);
-		}
+	if (!clock->worker_started) {
+		report_clock(priv, clock, offset, state, ppb, delay);
+		return;
 	}
+	/* Leave the report to the main loop, in the order of the clocks. */
+	clock->report_offset = offset;
+	clock->report_state = state;
+	clock->report_freq = ppb;
+	clock->report_delay = delay;
+	clock->reported = 1;
 }
 
 static void enable_pps_output(clockid_t src)
@@ -653,7 +740,7 @@ static int do_pps_loop(struct phc2sys_private *priv, struct clock *clock,
 		/* If a PHC is available, use it to get the whole number
 		   of seconds in the offset and PPS for the rest. */
 		if (src != CLOCK_INVALID) {
-			if (!read_phc(src, clock->clkid, priv->phc_readings,
+			if (!read_phc(src, clock->clkid, priv->phc_readings, NULL,
 				      &phc_offset, &phc_ts, &phc_delay))
 				return -1;
 
@@ -696,19 +783,323 @@ static int update_needed(struct clock *c)
 	return 0;
 }
 
+static int sync_needed(struct phc2sys_private *priv, struct clock *clock)
+{
+	if (!update_needed(clock))
+		return 0;
+
+	/* don't try to synchronize the clock to itself */
+	if (clock->clkid == priv->master->clkid ||
+	    (clock->phc_index >= 0 &&
+	     clock->phc_index == priv->master->phc_index) ||
+	    !strcmp(clock->device, priv->master->device))
+		return 0;
+
+	return 1;
+}
+
+static int clock_sync(struct phc2sys_private *priv, struct clock *clock)
+{
+	uint64_t ts;
+	int64_t offset, delay;
+	int res;
+
+	if (!clock->servo) {
+		pr_err("cannot update clock without servo");
+		return -1;
+	}
+
+	if (clock->clkid == CLOCK_REALTIME &&
+	    priv->master->sysoff_method >= 0) {
+		/* use sysoff */
+		res = sysoff_measure_adaptive(CLOCKID_TO_FD(priv->master->clkid),
+					      priv->master->sysoff_method,
+					      priv->phc_readings, clock->adapt,
+					      &offset, &ts, &delay);
+		if (res == SYSOFF_REJECTED)
+			return 0;
+		if (res < 0)
+			return -1;
+	} else if (priv->master->clkid == CLOCK_REALTIME &&
+		   clock->sysoff_method >= 0) {
+		/* use reversed sysoff */
+		res = sysoff_measure_adaptive(CLOCKID_TO_FD(clock->clkid),
+					      clock->sysoff_method,
+					      priv->phc_readings, clock->adapt,
+					      &offset, &ts, &delay);
+		if (res == SYSOFF_REJECTED)
+			return 0;
+		if (res < 0)
+			return -1;
+		offset = -offset;
+		ts += offset;
+	} else {
+		/* use phc */
+		if (!read_phc(priv->master->clkid, clock->clkid,
+			      priv->phc_readings, clock->adapt,
+			      &offset, &ts, &delay))
+			return 0;
+	}
+	update_clock(priv, clock, offset, ts, delay);
+	return 0;
+}
+
+/*
+ * Each destination clock gets a thread of its own, which waits for the
+ * main loop to start a round of updates. The main loop does not touch
+ * the clocks or the PMC state until every worker of the round is done,
+ * so the workers need no locking beyond the hand over. The results are
+ * printed by the main loop once the round is over.
+ */
+static void *clock_worker(void *arg)
+{
+	struct clock *clock = arg;
+	struct phc2sys_private *priv = clock->priv;
+	unsigned int generation = 0;
+	struct timespec tp;
+	int err;
+
+	pthread_mutex_lock(&priv->lock);
+	while (1) {
+		while (!priv->stop && generation == priv->generation)
+			pthread_cond_wait(&priv->start, &priv->lock);
+		if (priv->stop)
+			break;
+		generation = priv->generation;
+		if (!clock->todo)
+			continue;
+		pthread_mutex_unlock(&priv->lock);
+
+		clock_gettime(CLOCK_MONOTONIC, &tp);
+		clock->sampled = tp.tv_sec * NS_PER_SEC + tp.tv_nsec;
+		err = clock_sync(priv, clock);
+
+		pthread_mutex_lock(&priv->lock);
+		clock->todo = 0;
+		if (err)
+			priv->error = 1;
+		if (!--priv->pending)
+			pthread_cond_signal(&priv->done);
+	}
+	pthread_mutex_unlock(&priv->lock);
+	return NULL;
+}
+
+/* Parses a list of CPUs like "1,3-5" into a set, returns its size. */
+static int parse_cpu_list(const char *str, cpu_set_t *cpus)
+{
+	unsigned long first, last;
+	char *end;
+
+	CPU_ZERO(cpus);
+	while (*str) {
+		first = strtoul(str, &end, 10);
+		if (end == str)
+			return -1;
+		last = first;
+		if (*end == '-') {
+			str = end + 1;
+			last = strtoul(str, &end, 10);
+			if (end == str)
+				return -1;
+		}
+		if (first > last || last >= CPU_SETSIZE)
+			return -1;
+		for (; first <= last; first++)
+			CPU_SET(first, cpus);
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return -1;
+		str = end;
+	}
+	return CPU_COUNT(cpus);
+}
+
+static int clock_worker_start(struct phc2sys_private *priv,
+			      struct clock *clock)
+{
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	int cpu, err;
+
+	pthread_attr_init(&attr);
+	if (priv->num_cpus) {
+		/* Hand out the configured CPUs in turn. */
+		cpu = priv->next_cpu;
+		while (!CPU_ISSET(cpu % CPU_SETSIZE, &priv->cpus))
+			cpu++;
+		cpu %= CPU_SETSIZE;
+		priv->next_cpu = cpu + 1;
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		err = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+		if (err) {
+			pr_err("failed to pin worker for %s to CPU %d: %s",
+			       clock->device, cpu, strerror(err));
+			goto out;
+		}
+		pr_info("%s updated on CPU %d", clock->device, cpu);
+	}
+	err = pthread_create(&clock->worker, &attr, clock_worker, clock);
+	if (err) {
+		pr_err("failed to start worker for %s: %s",
+		       clock->device, strerror(err));
+		goto out;
+	}
+	clock->worker_started = 1;
+out:
+	pthread_attr_destroy(&attr);
+	return err ? -1 : 0;
+}
+
+static void clock_report_round(struct phc2sys_private *priv)
+{
+	uint64_t first = UINT64_MAX, last = 0;
+	int64_t max_offset = 0;
+	struct clock *clock;
+	int count = 0, stats = 0;
+
+	LIST_FOREACH(clock, &priv->dst_clocks, dst_list) {
+		if (!clock->reported)
+			continue;
+		clock->reported = 0;
+		report_clock(priv, clock, clock->report_offset,
+			     clock->report_state, clock->report_freq,
+			     clock->report_delay);
+		if (clock->sampled < first)
+			first = clock->sampled;
+		if (clock->sampled > last)
+			last = clock->sampled;
+		if (llabs(clock->report_offset) > max_offset)
+			max_offset = llabs(clock->report_offset);
+		if (clock->offset_stats)
+			stats = 1;
+		count++;
+	}
+	if (count < 2)
+		return;
+	if (stats) {
+		pr_debug("round of %d clocks sampled within %" PRIu64 " ns "
+			 "max offset %" PRId64, count, last - first, max_offset);
+	} else {
+		pr_info("round of %d clocks sampled within %" PRIu64 " ns "
+			"max offset %" PRId64, count, last - first, max_offset);
+	}
+}
+
+static int clock_sync_parallel(struct phc2sys_private *priv)
+{
+	struct clock *clock;
+	int err;
+
+	pthread_mutex_lock(&priv->lock);
+	LIST_FOREACH(clock, &priv->dst_clocks, dst_list) {
+		if (!sync_needed(priv, clock))
+			continue;
+		if (!clock->worker_started &&
+		    clock_worker_start(priv, clock)) {
+			priv->error = 1;
+			break;
+		}
+		clock->todo = 1;
+		priv->pending++;
+	}
+	if (priv->pending) {
+		priv->generation++;
+		pthread_cond_broadcast(&priv->start);
+		while (priv->pending)
+			pthread_cond_wait(&priv->done, &priv->lock);
+	}
+	err = priv->error;
+	pthread_mutex_unlock(&priv->lock);
+
+	clock_report_round(priv);
+
+	return err ? -1 : 0;
+}
+
+static void clock_workers_stop(struct phc2sys_private *priv)
+{
+	struct clock *clock;
+
+	pthread_mutex_lock(&priv->lock);
+	priv->stop = 1;
+	pthread_cond_broadcast(&priv->start);
+	pthread_mutex_unlock(&priv->lock);
+
+	LIST_FOREACH(clock, &priv->clocks, list) {
+		if (clock->worker_started) {
+			pthread_join(clock->worker, NULL);
+			clock->worker_started = 0;
+		}
+	}
+	pthread_cond_destroy(&priv->done);
+	pthread_cond_destroy(&priv->start);
+	pthread_mutex_destroy(&priv->lock);
+}
+
+/*
+ * Waits for ptp4l to report an adjustment of its clock, so that the
+ * clocks are sampled right after the source was disciplined. Should
+ * the notifications stop, e.g. as ptp4l lost its master, the clocks
+ * are sampled every other update interval.
+ */
+static void wait_time_sync(struct phc2sys_private *priv, uint64_t *deadline)
+{
+	struct pollfd pfd;
+	struct timespec tp;
+	uint64_t now;
+	int cnt;
+
+	while (is_running() && !priv->time_synced) {
+		clock_gettime(CLOCK_MONOTONIC, &tp);
+		now = tp.tv_sec * NS_PER_SEC + tp.tv_nsec;
+		if (now >= *deadline)
+			break;
+
+		pfd.fd = pmc_get_transport_fd(priv->node.pmc);
+		pfd.events = POLLIN | POLLPRI;
+		cnt = poll(&pfd, 1, (*deadline - now + 999999) / 1000000);
+		if (cnt < 0) {
+			if (errno != EINTR)
+				pr_err("poll failed: %m");
+			break;
+		}
+		if (!cnt)
+			break;
+		run_pmc_events(&priv->node);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	*deadline = tp.tv_sec * NS_PER_SEC + tp.tv_nsec +
+		2 * priv->phc_interval * NS_PER_SEC;
+}
+
 static int do_loop(struct phc2sys_private *priv, int subscriptions)
 {
 	struct timespec interval;
 	struct clock *clock;
-	uint64_t ts;
-	int64_t offset, delay;
+	uint64_t deadline = 0;
+	int r = 0;
 
 	interval.tv_sec = priv->phc_interval;
 	interval.tv_nsec = (priv->phc_interval - interval.tv_sec) * 1e9;
 
+	if (priv->clock_threads) {
+		pthread_mutex_init(&priv->lock, NULL);
+		pthread_cond_init(&priv->start, NULL);
+		pthread_cond_init(&priv->done, NULL);
+	}
+
 	while (is_running()) {
-		clock_nanosleep(CLOCK_MONOTONIC, 0, &interval, NULL);
-		if (update_pmc_node(&priv->node, subscriptions) < 0)
+		if (priv->time_sync_events) {
+			wait_time_sync(priv, &deadline);
+		} else {
+			clock_nanosleep(CLOCK_MONOTONIC, 0, &interval, NULL);
+		}
+		if (update_pmc_node(&priv->node,
+				    subscriptions || priv->time_sync_events) < 0)
 			continue;
 
 		if (subscriptions) {
@@ -723,54 +1114,34 @@ static int do_loop(struct phc2sys_private *priv, int subscriptions)
 				reconfigure(priv);
 			}
 		}
+		priv->time_synced = 0;
 		if (!priv->master)
 			continue;
 
-		LIST_FOREACH(clock, &priv->dst_clocks, dst_list) {
-			if (!update_needed(clock))
-				continue;
-
-			/* don't try to synchronize the clock to itself */
-			if (clock->clkid == priv->master->clkid ||
-			    (clock->phc_index >= 0 &&
-			     clock->phc_index == priv->master->phc_index) ||
-			    !strcmp(clock->device, priv->master->device))
-				continue;
-
-			if (!clock->servo) {
-				pr_err("cannot update clock without servo");
-				return -1;
+		if (priv->clock_threads) {
+			if (clock_sync_parallel(priv)) {
+				r = -1;
+				break;
 			}
+			continue;
+		}
 
-			if (clock->clkid == CLOCK_REALTIME &&
-			    priv->master->sysoff_method >= 0) {
-				/* use sysoff */
-				if (sysoff_measure(CLOCKID_TO_FD(priv->master->clkid),
-						   priv->master->sysoff_method,
-						   priv->phc_readings,
-						   &offset, &ts, &delay) < 0)
-					return -1;
-			} else if (priv->master->clkid == CLOCK_REALTIME &&
-				   clock->sysoff_method >= 0) {
-				/* use reversed sysoff */
-				if (sysoff_measure(CLOCKID_TO_FD(clock->clkid),
-						   clock->sysoff_method,
-						   priv->phc_readings,
-						   &offset, &ts, &delay) < 0)
-					return -1;
-				offset = -offset;
-				ts += offset;
-			} else {
-				/* use phc */
-				if (!read_phc(priv->master->clkid, clock->clkid,
-					      priv->phc_readings,
-					      &offset, &ts, &delay))
-					continue;
+		LIST_FOREACH(clock, &priv->dst_clocks, dst_list) {
+			if (!sync_needed(priv, clock))
+				continue;
+			if (clock_sync(priv, clock)) {
+				r = -1;
+				break;
 			}
-			update_clock(priv, clock, offset, ts, delay);
 		}
+		if (r)
+			break;
 	}
-	return 0;
+
+	if (priv->clock_threads)
+		clock_workers_stop(priv);
+
+	return r;
 }
 
 static int normalize_state(int state)
@@ -805,14 +1176,37 @@ static int clock_compute_state(struct phc2sys_private *priv,
 #define node_to_phc2sys(node) \
 	container_of(node, struct phc2sys_private, node)
 
+static void phc2sys_port_state(struct pmc_node *node,
+			       struct PortIdentity *pid, int state)
+{
+	struct phc2sys_private *priv = node_to_phc2sys(node);
+	struct port *port;
+	struct clock *clock;
+
+	port = port_get(priv, pid->portNumber);
+	if (!port) {
+		pr_info("received data for unknown port %s", pid2str(pid));
+		return;
+	}
+	state = normalize_state(state);
+	if (port->state != state) {
+		pr_info("port %s changed state", pid2str(pid));
+		port->state = state;
+		clock = port->clock;
+		state = clock_compute_state(priv, clock);
+		if (clock->state != state || clock->new_state) {
+			clock->new_state = state;
+			priv->state_changed = 1;
+		}
+	}
+}
+
 static int phc2sys_recv_subscribed(struct pmc_node *node,
 				   struct ptp_message *msg, int excluded)
 {
 	struct phc2sys_private *priv = node_to_phc2sys(node);
-	int mgt_id, state;
 	struct portDS *pds;
-	struct port *port;
-	struct clock *clock;
+	int mgt_id;
 
 	mgt_id = get_mgt_id(msg);
 	if (mgt_id == excluded)
@@ -820,24 +1214,10 @@ static int phc2sys_recv_subscribed(struct pmc_node *node,
 	switch (mgt_id) {
 	case TLV_PORT_DATA_SET:
 		pds = get_mgt_data(msg);
-		port = port_get(priv, pds->portIdentity.portNumber);
-		if (!port) {
-			pr_info("received data for unknown port %s",
-				pid2str(&pds->portIdentity));
-			return 1;
-		}
-		state = normalize_state(pds->portState);
-		if (port->state != state) {
-			pr_info("port %s changed state",
-				pid2str(&pds->portIdentity));
-			port->state = state;
-			clock = port->clock;
-			state = clock_compute_state(priv, clock);
-			if (clock->state != state || clock->new_state) {
-				clock->new_state = state;
-				priv->state_changed = 1;
-			}
-		}
+		phc2sys_port_state(node, &pds->portIdentity, pds->portState);
+		return 1;
+	case TLV_TIME_STATUS_NP:
+		priv->time_synced = 1;
 		return 1;
 	}
 	return 0;
@@ -996,7 +1376,7 @@ static void usage(char *progname)
 		" -w             wait for ptp4l\n"
 		" common options:\n"
 		" -f [file]      configuration file\n"
-		" -E [pi|linreg] clock servo (pi)\n"
+		" -E [pi|linreg|kalman] clock servo (pi)\n"
 		" -P [kp]        proportional constant (0.7)\n"
 		" -I [ki]        integration constant (0.3)\n"
 		" -S [step]      step threshold (disabled)\n"
@@ -1092,6 +1472,9 @@ int main(int argc, char *argv[])
 			} else if (!strcasecmp(optarg, "linreg")) {
 				config_set_int(cfg, "clock_servo",
 					       CLOCK_SERVO_LINREG);
+			} else if (!strcasecmp(optarg, "kalman")) {
+				config_set_int(cfg, "clock_servo",
+					       CLOCK_SERVO_KALMAN);
 			} else if (!strcasecmp(optarg, "ntpshm")) {
 				config_set_int(cfg, "clock_servo",
 					       CLOCK_SERVO_NTPSHM);
@@ -1250,6 +1633,23 @@ int main(int argc, char *argv[])
 	}
 	priv.kernel_leap = config_get_int(cfg, NULL, "kernel_leap");
 	priv.sanity_freq_limit = config_get_int(cfg, NULL, "sanity_freq_limit");
+	priv.adaptive_readings = config_get_int(cfg, NULL, "adaptive_readings");
+	priv.clock_threads = config_get_int(cfg, NULL, "clock_threads");
+	priv.num_cpus = parse_cpu_list(config_get_string(cfg, NULL,
+							 "clock_thread_cpus"),
+				       &priv.cpus);
+	if (priv.num_cpus < 0) {
+		fprintf(stderr, "bad clock_thread_cpus list\n");
+		goto bad_usage;
+	}
+	priv.time_sync_events = config_get_int(cfg, NULL, "time_sync_events");
+
+	if (priv.time_sync_events && pps_fd < 0 &&
+	    (!(autocfg || wait_sync) || priv.forced_sync_offset)) {
+		fprintf(stderr,
+			"time_sync_events needs -a, or -w without -O\n");
+		goto bad_usage;
+	}
 
 	snprintf(uds_local, sizeof(uds_local), "/var/run/phc2sys.%d",
 		 getpid());
@@ -1258,6 +1658,9 @@ int main(int argc, char *argv[])
 		if (init_pmc_node(cfg, &priv.node, uds_local,
 				  phc2sys_recv_subscribed))
 			goto end;
+		priv.node.port_state_changed = phc2sys_port_state;
+		if (priv.time_sync_events)
+			priv.node.events |= 1 << NOTIFY_TIME_SYNC;
 		if (auto_init_ports(&priv, rt) < 0)
 			goto end;
 		r = do_loop(&priv, 1);
@@ -1296,6 +1699,9 @@ int main(int argc, char *argv[])
 		if (init_pmc_node(cfg, &priv.node, uds_local,
 				  phc2sys_recv_subscribed))
 			goto end;
+		/* Without autoconfiguration only the clock updates matter. */
+		if (priv.time_sync_events)
+			priv.node.events = 1 << NOTIFY_TIME_SYNC;
 
 		while (is_running()) {
 			r = run_pmc_wait_sync(&priv.node, 1000);
@@ -1315,9 +1721,10 @@ int main(int argc, char *argv[])
 			}
 		}
 
-		if (priv.forced_sync_offset ||
-		    (src->clkid != CLOCK_REALTIME && dst->clkid != CLOCK_REALTIME) ||
-		    src->clkid == CLOCK_INVALID)
+		if (!priv.time_sync_events &&
+		    (priv.forced_sync_offset ||
+		     (src->clkid != CLOCK_REALTIME && dst->clkid != CLOCK_REALTIME) ||
+		     src->clkid == CLOCK_INVALID))
 			close_pmc_node(&priv.node);
 	}
 
@@ -145,8 +145,11 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 	struct management_tlv_datum *mtd;
 	struct port_properties_np *ppn;
 	struct timePropertiesDS *tp;
+	struct message_pool_np *mpn;
 	struct management_tlv *mgt;
 	struct time_status_np *tsn;
+	struct unicast_service_pacing_np *usp;
+	struct unicast_pacing_np *rec;
 	struct port_stats_np *pcp;
 	struct tlv_extra *extra;
 	struct port_ds_np *pnp;
@@ -155,7 +158,8 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 	struct parentDS *pds;
 	struct portDS *p;
 	struct TLV *tlv;
-	int action;
+	int action, i, j;
+	uint8_t *buf;
 
 	if (msg_type(msg) == SIGNALING) {
 		pmc_show_signaling(msg, fp);
@@ -387,15 +391,33 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 		sen = (struct subscribe_events_np *) mgt->data;
 		fprintf(fp, "SUBSCRIBE_EVENTS_NP "
 			IFMT "duration          %hu"
-			IFMT "NOTIFY_PORT_STATE %s",
+			IFMT "NOTIFY_PORT_STATE %s"
+			IFMT "NOTIFY_TIME_SYNC  %s",
 			sen->duration,
-			(sen->bitmask[0] & 1 << NOTIFY_PORT_STATE) ? "on" : "off");
+			(sen->bitmask[0] & 1 << NOTIFY_PORT_STATE) ? "on" : "off",
+			(sen->bitmask[0] & 1 << NOTIFY_TIME_SYNC) ? "on" : "off");
 		break;
 	case TLV_SYNCHRONIZATION_UNCERTAIN_NP:
 		mtd = (struct management_tlv_datum *) mgt->data;
 		fprintf(fp, "SYNCHRONIZATION_UNCERTAIN_NP "
 			IFMT "uncertain %hhu", mtd->val);
 		break;
+	case TLV_MESSAGE_POOL_NP:
+		mpn = (struct message_pool_np *) mgt->data;
+		fprintf(fp, "MESSAGE_POOL_NP "
+			IFMT "msg_capacity   %u"
+			IFMT "msg_total      %u"
+			IFMT "msg_free       %u"
+			IFMT "msg_exhausted  %u"
+			IFMT "tlv_capacity   %u"
+			IFMT "tlv_total      %u"
+			IFMT "tlv_free       %u"
+			IFMT "tlv_exhausted  %u",
+			mpn->msg_capacity, mpn->msg_total,
+			mpn->msg_free, mpn->msg_exhausted,
+			mpn->tlv_capacity, mpn->tlv_total,
+			mpn->tlv_free, mpn->tlv_exhausted);
+		break;
 	case TLV_PORT_DATA_SET:
 		p = (struct portDS *) mgt->data;
 		if (p->portState > PS_SLAVE) {
@@ -487,6 +509,29 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 			pcp->stats.txMsgType[SIGNALING],
 			pcp->stats.txMsgType[MANAGEMENT]);
 		break;
+	case TLV_UNICAST_SERVICE_PACING_NP:
+		usp = (struct unicast_service_pacing_np *) mgt->data;
+		fprintf(fp, "UNICAST_SERVICE_PACING_NP "
+			IFMT "portIdentity              %s"
+			IFMT "numberIntervals           %hu",
+			pid2str(&usp->portIdentity), usp->numberIntervals);
+		buf = usp->data;
+		for (i = 0; i < usp->numberIntervals; i++) {
+			rec = (struct unicast_pacing_np *) buf;
+			fprintf(fp,
+				IFMT "logInterMessagePeriod     %hhd"
+				IFMT "numberClients             %hu"
+				IFMT "numberSlots               %hhu"
+				IFMT "fanout                   ",
+				rec->logInterMessagePeriod,
+				rec->numberClients, rec->numberSlots);
+			for (j = 0; j < rec->numberSlots; j++) {
+				fprintf(fp, " %hu", rec->fanout[j]);
+			}
+			buf += sizeof(*rec) +
+				rec->numberSlots * sizeof(rec->fanout[0]);
+		}
+		break;
 	case TLV_LOG_ANNOUNCE_INTERVAL:
 		mtd = (struct management_tlv_datum *) mgt->data;
 		fprintf(fp, "LOG_ANNOUNCE_INTERVAL "
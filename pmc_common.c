@@ -120,6 +120,7 @@ struct management_id idtab[] = {
 	{ "GRANDMASTER_SETTINGS_NP", TLV_GRANDMASTER_SETTINGS_NP, do_set_action },
 	{ "SUBSCRIBE_EVENTS_NP", TLV_SUBSCRIBE_EVENTS_NP, do_set_action },
 	{ "SYNCHRONIZATION_UNCERTAIN_NP", TLV_SYNCHRONIZATION_UNCERTAIN_NP, do_set_action },
+	{ "MESSAGE_POOL_NP", TLV_MESSAGE_POOL_NP, do_get_action },
 /* Port management ID values */
 	{ "NULL_MANAGEMENT", TLV_NULL_MANAGEMENT, null_management },
 	{ "CLOCK_DESCRIPTION", TLV_CLOCK_DESCRIPTION, do_get_action },
@@ -141,6 +142,7 @@ struct management_id idtab[] = {
 	{ "PORT_DATA_SET_NP", TLV_PORT_DATA_SET_NP, do_set_action },
 	{ "PORT_STATS_NP", TLV_PORT_STATS_NP, do_get_action },
 	{ "PORT_PROPERTIES_NP", TLV_PORT_PROPERTIES_NP, do_get_action },
+	{ "UNICAST_SERVICE_PACING_NP", TLV_UNICAST_SERVICE_PACING_NP, do_get_action },
 };
 
 static void do_get_action(struct pmc *pmc, int action, int index, char *str)
@@ -159,7 +161,7 @@ static void do_set_action(struct pmc *pmc, int action, int index, char *str)
 	struct management_tlv_datum mtd;
 	struct subscribe_events_np sen;
 	struct port_ds_np pnp;
-	char onoff[4] = {0};
+	char onoff[4] = {0}, onoff_sync[4] = {0};
 
 	switch (action) {
 	case GET:
@@ -234,15 +236,19 @@ static void do_set_action(struct pmc *pmc, int action, int index, char *str)
 		memset(&sen, 0, sizeof(sen));
 		cnt = sscanf(str, " %*s %*s "
 			     "duration %hu "
-			     "NOTIFY_PORT_STATE %3s ",
-			     &sen.duration, onoff);
-		if (cnt != 2) {
+			     "NOTIFY_PORT_STATE %3s "
+			     "NOTIFY_TIME_SYNC %3s ",
+			     &sen.duration, onoff, onoff_sync);
+		if (cnt < 2) {
 			fprintf(stderr, "%s SET needs 2 values\n",
 				idtab[index].name);
 			break;
 		}
 		if (!strcasecmp(onoff, "on")) {
-			sen.bitmask[0] = 1 << NOTIFY_PORT_STATE;
+			sen.bitmask[0] |= 1 << NOTIFY_PORT_STATE;
+		}
+		if (!strcasecmp(onoff_sync, "on")) {
+			sen.bitmask[0] |= 1 << NOTIFY_TIME_SYNC;
 		}
 		pmc_send_set_action(pmc, code, &sen, sizeof(sen));
 		break;
@@ -521,6 +527,9 @@ static int pmc_tlv_datalen(struct pmc *pmc, int id)
 	case TLV_GRANDMASTER_SETTINGS_NP:
 		len += sizeof(struct grandmaster_settings_np);
 		break;
+	case TLV_MESSAGE_POOL_NP:
+		len += sizeof(struct message_pool_np);
+		break;
 	case TLV_NULL_MANAGEMENT:
 		break;
 	case TLV_CLOCK_DESCRIPTION:
@@ -721,13 +730,55 @@ int pmc_do_command(struct pmc *pmc, char *str)
 	return 0;
 }
 
+/*
+ * Reads the state which ptp4l publishes in shared memory. Returns zero
+ * on success, or -1 if the caller has to ask ptp4l over the socket.
+ */
+static int pmc_node_snapshot(struct pmc_node *node,
+			     struct state_shm_snapshot *snap)
+{
+	int valid = 0;
+
+	if (!node->shm && node->shm_name)
+		node->shm = state_shm_open(node->shm_name);
+
+	if (node->shm && !state_shm_read(node->shm, snap) &&
+	    (!node->clock_identity_set ||
+	     cid_eq(&node->clock_identity, &snap->clockIdentity)))
+		valid = 1;
+
+	if (node->shm && !valid) {
+		/* A new instance of ptp4l creates a new object. */
+		state_shm_destroy(node->shm);
+		node->shm = NULL;
+	}
+	if (node->shm_valid && !valid) {
+		/* Subscribe to the port states again right away. */
+		node->pmc_last_update = 0;
+	}
+	node->shm_valid = valid;
+
+	return valid ? 0 : -1;
+}
+
+static unsigned int subscribed_events(struct pmc_node *node)
+{
+	unsigned int events = node->events;
+
+	/* The port states are read from the shared memory. */
+	if (node->shm_valid && node->port_state_changed)
+		events &= ~(1 << NOTIFY_PORT_STATE);
+
+	return events;
+}
+
 static void send_subscription(struct pmc_node *node)
 {
 	struct subscribe_events_np sen;
 
 	memset(&sen, 0, sizeof(sen));
 	sen.duration = PMC_SUBSCRIBE_DURATION;
-	sen.bitmask[0] = 1 << NOTIFY_PORT_STATE;
+	sen.bitmask[0] = subscribed_events(node);
 	pmc_send_set_action(node->pmc, TLV_SUBSCRIBE_EVENTS_NP, &sen, sizeof(sen));
 }
 
@@ -857,11 +908,23 @@ static int run_pmc(struct pmc_node *node, int timeout, int ds_id,
 
 int run_pmc_wait_sync(struct pmc_node *node, int timeout)
 {
+	struct state_shm_snapshot snap;
 	struct ptp_message *msg;
 	Enumeration8 portState;
+	unsigned int i;
 	void *data;
 	int res;
 
+	if (!pmc_node_snapshot(node, &snap)) {
+		for (i = 0; i < snap.numberPorts && i < STATE_SHM_MAX_PORTS; i++) {
+			switch (snap.port[i].port_state) {
+			case PS_MASTER:
+			case PS_SLAVE:
+				return 1;
+			}
+		}
+	}
+
 	while (1) {
 		res = run_pmc(node, timeout, TLV_PORT_DATA_SET, &msg);
 		if (res <= 0)
@@ -881,17 +944,9 @@ int run_pmc_wait_sync(struct pmc_node *node, int timeout)
 	}
 }
 
-int run_pmc_get_utc_offset(struct pmc_node *node, int timeout)
+static void pmc_node_set_utc_offset(struct pmc_node *node,
+				    struct timePropertiesDS *tds)
 {
-	struct ptp_message *msg;
-	int res;
-	struct timePropertiesDS *tds;
-
-	res = run_pmc(node, timeout, TLV_TIME_PROPERTIES_DATA_SET, &msg);
-	if (res <= 0)
-		return res;
-
-	tds = (struct timePropertiesDS *)get_mgt_data(msg);
 	if (tds->flags & PTP_TIMESCALE) {
 		node->sync_offset = tds->currentUtcOffset;
 		if (tds->flags & LEAP_61)
@@ -907,16 +962,38 @@ int run_pmc_get_utc_offset(struct pmc_node *node, int timeout)
 		node->leap = 0;
 		node->utc_offset_traceable = 0;
 	}
+}
+
+int run_pmc_get_utc_offset(struct pmc_node *node, int timeout)
+{
+	struct state_shm_snapshot snap;
+	struct ptp_message *msg;
+	int res;
+
+	if (!pmc_node_snapshot(node, &snap)) {
+		pmc_node_set_utc_offset(node, &snap.timeprop);
+		return 1;
+	}
+
+	res = run_pmc(node, timeout, TLV_TIME_PROPERTIES_DATA_SET, &msg);
+	if (res <= 0)
+		return res;
+
+	pmc_node_set_utc_offset(node, get_mgt_data(msg));
 	msg_put(msg);
 	return 1;
 }
 
 int run_pmc_get_number_ports(struct pmc_node *node, int timeout)
 {
+	struct state_shm_snapshot snap;
 	struct ptp_message *msg;
 	int res;
 	struct defaultDS *dds;
 
+	if (!pmc_node_snapshot(node, &snap))
+		return snap.numberPorts;
+
 	res = run_pmc(node, timeout, TLV_DEFAULT_DATA_SET, &msg);
 	if (res <= 0)
 		return res;
@@ -941,7 +1018,22 @@ int run_pmc_subscribe(struct pmc_node *node, int timeout)
 
 void run_pmc_events(struct pmc_node *node)
 {
+	struct state_shm_snapshot snap;
+	struct state_shm_port *sp;
 	struct ptp_message *msg;
+	unsigned int i;
+
+	if (node->port_state_changed && !pmc_node_snapshot(node, &snap)) {
+		for (i = 0; i < snap.numberPorts && i < STATE_SHM_MAX_PORTS; i++) {
+			sp = &snap.port[i];
+			if (!sp->portIdentity.portNumber ||
+			    node->shm_port_state[i] == sp->port_state)
+				continue;
+			node->shm_port_state[i] = sp->port_state;
+			node->port_state_changed(node, &sp->portIdentity,
+						 sp->port_state);
+		}
+	}
 
 	run_pmc(node, 0, -1, &msg);
 }
@@ -950,9 +1042,25 @@ int run_pmc_port_properties(struct pmc_node *node, int timeout,
 			    unsigned int port, int *state,
 			    int *tstamping, char *iface)
 {
+	struct state_shm_snapshot snap;
 	struct ptp_message *msg;
 	int res, len;
 	struct port_properties_np *ppn;
+	struct state_shm_port *sp;
+
+	if (!pmc_node_snapshot(node, &snap)) {
+		if (port < 1 || port > snap.numberPorts)
+			return -1;
+		sp = port <= STATE_SHM_MAX_PORTS ? &snap.port[port - 1] : NULL;
+		if (sp && sp->portIdentity.portNumber == port) {
+			*state = sp->port_state;
+			*tstamping = sp->timestamping;
+			len = strnlen(sp->interface, IFNAMSIZ - 1);
+			memcpy(iface, sp->interface, len);
+			iface[len] = '\0';
+			return 1;
+		}
+	}
 
 	pmc_target_port(node->pmc, port);
 	while (1) {
@@ -985,10 +1093,17 @@ out:
 
 int run_pmc_clock_identity(struct pmc_node *node, int timeout)
 {
+	struct state_shm_snapshot snap;
 	struct ptp_message *msg;
 	struct defaultDS *dds;
 	int res;
 
+	if (!pmc_node_snapshot(node, &snap)) {
+		node->clock_identity = snap.clockIdentity;
+		node->clock_identity_set = 1;
+		return 1;
+	}
+
 	res = run_pmc(node, timeout, TLV_DEFAULT_DATA_SET, &msg);
 	if (res <= 0)
 		return res;
@@ -1004,9 +1119,14 @@ int run_pmc_clock_identity(struct pmc_node *node, int timeout)
 /* Returns: -1 in case of error, 0 otherwise */
 int update_pmc_node(struct pmc_node *node, int subscribe)
 {
+	struct state_shm_snapshot snap;
 	struct timespec tp;
 	uint64_t ts;
 
+	/* The shared memory is cheap enough to be read every time. */
+	if (!pmc_node_snapshot(node, &snap))
+		pmc_node_set_utc_offset(node, &snap.timeprop);
+
 	if (clock_gettime(CLOCK_MONOTONIC, &tp)) {
 		pr_err("failed to read clock: %m");
 		return -1;
@@ -1016,9 +1136,9 @@ int update_pmc_node(struct pmc_node *node, int subscribe)
 	if (node->pmc &&
 	    !(ts > node->pmc_last_update &&
 	      ts - node->pmc_last_update < PMC_UPDATE_INTERVAL)) {
-		if (subscribe)
+		if (subscribe && subscribed_events(node))
 			run_pmc_subscribe(node, 0);
-		if (run_pmc_get_utc_offset(node, 0) > 0)
+		if (node->shm_valid || run_pmc_get_utc_offset(node, 0) > 0)
 			node->pmc_last_update = ts;
 	}
 
@@ -1028,6 +1148,8 @@ int update_pmc_node(struct pmc_node *node, int subscribe)
 int init_pmc_node(struct config *cfg, struct pmc_node *node, const char *uds,
 		  pmc_node_recv_subscribed_t *recv_subscribed)
 {
+	const char *shm_name;
+
 	node->pmc = pmc_create(cfg, TRANS_UDS, uds, 0,
 			       config_get_int(cfg, NULL, "domainNumber"),
 			       config_get_int(cfg, NULL, "transportSpecific") << 4, 1);
@@ -1036,6 +1158,11 @@ int init_pmc_node(struct config *cfg, struct pmc_node *node, const char *uds,
 		return -1;
 	}
 	node->recv_subscribed = recv_subscribed;
+	node->events = 1 << NOTIFY_PORT_STATE;
+
+	shm_name = config_get_string(cfg, NULL, "state_shm_name");
+	if (shm_name[0])
+		node->shm_name = shm_name;
 
 	return 0;
 }
@@ -1047,4 +1174,8 @@ void close_pmc_node(struct pmc_node *node)
 
 	pmc_destroy(node->pmc);
 	node->pmc = NULL;
+	if (node->shm) {
+		state_shm_destroy(node->shm);
+		node->shm = NULL;
+	}
 }
@@ -24,6 +24,7 @@
 #include "config.h"
 #include "fsm.h"
 #include "msg.h"
+#include "state_shm.h"
 #include "transport.h"
 
 struct pmc;
@@ -56,6 +57,9 @@ typedef int pmc_node_recv_subscribed_t(struct pmc_node *node,
 				       struct ptp_message *msg,
 				       int excluded);
 
+typedef void pmc_node_port_state_t(struct pmc_node *node,
+				   struct PortIdentity *pid, int state);
+
 struct pmc_node {
 	struct pmc *pmc;
 	int pmc_ds_requested;
@@ -65,7 +69,14 @@ struct pmc_node {
 	int utc_offset_traceable;
 	int clock_identity_set;
 	struct ClockIdentity clock_identity;
+	unsigned int events; /* bit mask of enum notification to subscribe */
 	pmc_node_recv_subscribed_t *recv_subscribed;
+	/* state published by ptp4l in shared memory */
+	const char *shm_name;
+	struct state_shm *shm;
+	int shm_valid;
+	uint8_t shm_port_state[STATE_SHM_MAX_PORTS];
+	pmc_node_port_state_t *port_state_changed;
 };
 
 int init_pmc_node(struct config *cfg, struct pmc_node *node, const char *uds,
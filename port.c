@@ -35,8 +35,10 @@
 #include "port.h"
 #include "port_private.h"
 #include "print.h"
+#include "state_shm.h"
 #include "rtnl.h"
 #include "sk.h"
+#include "stats.h"
 #include "tc.h"
 #include "tlv.h"
 #include "tmv.h"
@@ -48,6 +50,8 @@
 #define ALLOWED_LOST_RESPONSES 3
 #define ANNOUNCE_SPAN 1
 #define MAX_NEIGHBOR_FREQ_OFFSET 0.0002
+/* Room for the UNICAST_SERVICE_PACING_NP data, well within one message. */
+#define MAX_PACING_LEN 1024
 
 enum syfu_event {
 	SYNC_MISMATCH,
@@ -58,6 +62,7 @@ enum syfu_event {
 
 static int port_is_ieee8021as(struct port *p);
 static void port_nrate_initialize(struct port *p);
+static void port_peer_delay(struct port *p);
 
 static int announce_compare(struct ptp_message *m1, struct ptp_message *m2)
 {
@@ -133,24 +138,40 @@ static void extract_address(struct ptp_message *m, struct PortAddress *paddr)
 	paddr->addressLength = len;
 }
 
-static int msg_current(struct ptp_message *m, struct timespec now)
+static int64_t msg_tmo(struct ptp_message *m)
 {
-	int64_t t1, t2, tmo;
-
-	t1 = m->ts.host.tv_sec * NSEC2SEC + m->ts.host.tv_nsec;
-	t2 = now.tv_sec * NSEC2SEC + now.tv_nsec;
-
 	if (m->header.logMessageInterval <= -31) {
-		tmo = 0;
+		return 0;
 	} else if (m->header.logMessageInterval >= 31) {
-		tmo = INT64_MAX;
+		return INT64_MAX;
 	} else if (m->header.logMessageInterval < 0) {
-		tmo = 4LL * NSEC2SEC / (1 << -m->header.logMessageInterval);
+		return 4LL * NSEC2SEC / (1 << -m->header.logMessageInterval);
 	} else {
-		tmo = 4LL * (1 << m->header.logMessageInterval) * NSEC2SEC;
+		return 4LL * (1 << m->header.logMessageInterval) * NSEC2SEC;
 	}
+}
 
-	return t2 - t1 < tmo;
+static int msg_current(struct ptp_message *m, struct timespec now)
+{
+	int64_t t1, t2;
+
+	t1 = m->ts.host.tv_sec * NSEC2SEC + m->ts.host.tv_nsec;
+	t2 = now.tv_sec * NSEC2SEC + now.tv_nsec;
+
+	return t2 - t1 < msg_tmo(m);
+}
+
+/*
+ * Returns the time at which a message ceases to be current, in
+ * nanoseconds of CLOCK_MONOTONIC.
+ */
+static int64_t msg_expiry(struct ptp_message *m)
+{
+	int64_t t1, tmo = msg_tmo(m);
+
+	t1 = m->ts.host.tv_sec * NSEC2SEC + m->ts.host.tv_nsec;
+
+	return tmo > INT64_MAX - t1 ? INT64_MAX : t1 + tmo;
 }
 
 static int msg_source_equal(struct ptp_message *m1, struct foreign_clock *fc)
@@ -184,9 +205,15 @@ void fault_interval(struct port *port, enum fault_type ft,
 	i->val = port->flt_interval_pertype[ft].val;
 }
 
-int port_fault_fd(struct port *port)
+void port_attach_timers(struct port *port, struct twheel *wheel, void *owner)
 {
-	return port->fault_fd;
+	int i;
+
+	for (i = 0; i < N_TIMER_FDS; i++) {
+		twheel_timer_init(&port->timer[i], wheel, owner, FD_FIRST_TIMER + i);
+	}
+	twheel_timer_init(&port->fault_timer, wheel, owner, N_POLLFD);
+	twheel_timer_init(&port->txts_timer, wheel, owner, N_POLLFD + 1);
 }
 
 struct fdarray *port_fda(struct port *port)
@@ -194,11 +221,8 @@ struct fdarray *port_fda(struct port *port)
 	return &port->fda;
 }
 
-int set_tmo_log(int fd, unsigned int scale, int log_seconds)
+int set_tmo_log(struct twheel_timer *t, unsigned int scale, int log_seconds)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
 	uint64_t ns;
 	int i;
 
@@ -208,35 +232,21 @@ int set_tmo_log(int fd, unsigned int scale, int log_seconds)
 		for (i = 1, ns = scale * 500000000ULL; i < log_seconds; i++) {
 			ns >>= 1;
 		}
-		tmo.it_value.tv_nsec = ns;
-
-		while (tmo.it_value.tv_nsec >= NS_PER_SEC) {
-			tmo.it_value.tv_nsec -= NS_PER_SEC;
-			tmo.it_value.tv_sec++;
-		}
 
 	} else
-		tmo.it_value.tv_sec = scale * (1 << log_seconds);
+		ns = scale * (1ULL << log_seconds) * NS_PER_SEC;
 
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	return twheel_arm(t, ns);
 }
 
-int set_tmo_lin(int fd, int seconds)
+int set_tmo_lin(struct twheel_timer *t, int seconds)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
-
-	tmo.it_value.tv_sec = seconds;
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	return twheel_arm(t, seconds * (uint64_t) NS_PER_SEC);
 }
 
-int set_tmo_random(int fd, int min, int span, int log_seconds)
+int set_tmo_random(struct twheel_timer *t, int min, int span, int log_seconds)
 {
 	uint64_t value_ns, min_ns, span_ns;
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
 
 	if (log_seconds >= 0) {
 		min_ns = min * NS_PER_SEC << log_seconds;
@@ -248,32 +258,48 @@ int set_tmo_random(int fd, int min, int span, int log_seconds)
 
 	value_ns = min_ns + (span_ns * (random() % (1 << 15) + 1) >> 15);
 
-	tmo.it_value.tv_sec = value_ns / NS_PER_SEC;
-	tmo.it_value.tv_nsec = value_ns % NS_PER_SEC;
-
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	return twheel_arm(t, value_ns);
 }
 
 int port_set_fault_timer_log(struct port *port,
 			     unsigned int scale, int log_seconds)
 {
-	return set_tmo_log(port->fault_fd, scale, log_seconds);
+	return set_tmo_log(&port->fault_timer, scale, log_seconds);
 }
 
 int port_set_fault_timer_lin(struct port *port, int seconds)
 {
-	return set_tmo_lin(port->fault_fd, seconds);
+	return set_tmo_lin(&port->fault_timer, seconds);
 }
 
-void fc_clear(struct foreign_clock *fc)
+static void fc_drop_oldest(struct foreign_clock *fc)
 {
-	struct ptp_message *m;
+	unsigned int i = (fc->head - fc->n_messages + 1) &
+		(FOREIGN_MASTER_RING - 1);
+
+	msg_put(fc->ring[i]);
+	fc->ring[i] = NULL;
+	fc->n_messages--;
+	fc->port->best_valid = 0;
+}
+
+static void fc_push(struct foreign_clock *fc, struct ptp_message *m)
+{
+	if (fc->n_messages == FOREIGN_MASTER_RING) {
+		fc_drop_oldest(fc);
+	}
+	msg_get(m);
+	fc->head = (fc->head + 1) & (FOREIGN_MASTER_RING - 1);
+	fc->ring[fc->head] = m;
+	fc->n_messages++;
+	fc->expiry = msg_expiry(m);
+	fc->port->best_valid = 0;
+}
 
+void fc_clear(struct foreign_clock *fc)
+{
 	while (fc->n_messages) {
-		m = TAILQ_LAST(&fc->messages, messages);
-		TAILQ_REMOVE(&fc->messages, m, list);
-		fc->n_messages--;
-		msg_put(m);
+		fc_drop_oldest(fc);
 	}
 }
 
@@ -289,19 +315,13 @@ static void fc_prune(struct foreign_clock *fc)
 		threshold = 1;
 
 	while (fc->n_messages > threshold) {
-		m = TAILQ_LAST(&fc->messages, messages);
-		TAILQ_REMOVE(&fc->messages, m, list);
-		fc->n_messages--;
-		msg_put(m);
+		fc_drop_oldest(fc);
 	}
 
-	while (!TAILQ_EMPTY(&fc->messages)) {
-		m = TAILQ_LAST(&fc->messages, messages);
+	while ((m = fc_oldest(fc)) != NULL) {
 		if (msg_current(m, now))
 			break;
-		TAILQ_REMOVE(&fc->messages, m, list);
-		fc->n_messages--;
-		msg_put(m);
+		fc_drop_oldest(fc);
 	}
 }
 
@@ -339,24 +359,83 @@ void ts_add(tmv_t *ts, Integer64 correction)
 	*ts = tmv_add(*ts, correction_to_tmv(correction));
 }
 
+static struct fmh *fc_bucket(struct port *p, struct PortIdentity *pid)
+{
+	unsigned char *buf = (unsigned char *) pid;
+	uint32_t h = 2166136261U;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(*pid); i++) {
+		h = (h ^ buf[i]) * 16777619U;
+	}
+	h ^= h >> 16;
+
+	return &p->fm_hash[h % FM_HASH_SIZE];
+}
+
+static void fc_remove(struct foreign_clock *fc)
+{
+	struct port *p = fc->port;
+
+	LIST_REMOVE(fc, list);
+	LIST_REMOVE(fc, hash);
+	fc_clear(fc);
+	free(fc);
+	p->n_foreign_masters--;
+}
+
+/*
+ * Makes room for a new foreign master by dropping one whose announce
+ * messages have all aged out. Returns zero on success.
+ */
+static int fc_reclaim(struct port *p)
+{
+	struct foreign_clock *fc;
+	struct timespec now;
+	int64_t t;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	t = now.tv_sec * NSEC2SEC + now.tv_nsec;
+
+	LIST_FOREACH(fc, &p->foreign_masters, list) {
+		if (fc == p->best || t < fc->expiry) {
+			continue;
+		}
+		fc_prune(fc);
+		if (!fc->n_messages) {
+			fc_remove(fc);
+			return 0;
+		}
+	}
+	return -1;
+}
+
 /*
  * Returns non-zero if the announce message is different than last.
  */
 static int add_foreign_master(struct port *p, struct ptp_message *m)
 {
+	struct PortIdentity *pid = &m->header.sourcePortIdentity;
 	int threshold = FOREIGN_MASTER_THRESHOLD;
 	struct foreign_clock *fc;
 	struct ptp_message *tmp;
 	int broke_threshold = 0, diff = 0;
 
-	LIST_FOREACH(fc, &p->foreign_masters, list) {
+	LIST_FOREACH(fc, fc_bucket(p, pid), hash) {
 		if (msg_source_equal(m, fc)) {
 			break;
 		}
 	}
 	if (!fc) {
+		if (p->max_foreign_masters &&
+		    p->n_foreign_masters >= p->max_foreign_masters &&
+		    fc_reclaim(p)) {
+			pl_info(60, "port %hu: foreign master table full, "
+				"ignoring %s", portnum(p), pid2str(pid));
+			return 0;
+		}
 		pr_notice("port %hu: new foreign master %s", portnum(p),
-			pid2str(&m->header.sourcePortIdentity));
+			pid2str(pid));
 
 		fc = malloc(sizeof(*fc));
 		if (!fc) {
@@ -364,9 +443,11 @@ static int add_foreign_master(struct port *p, struct ptp_message *m)
 			return 0;
 		}
 		memset(fc, 0, sizeof(*fc));
-		TAILQ_INIT(&fc->messages);
 		LIST_INSERT_HEAD(&p->foreign_masters, fc, list);
+		LIST_INSERT_HEAD(fc_bucket(p, pid), fc, hash);
+		p->n_foreign_masters++;
 		fc->port = p;
+		fc->expiry = msg_expiry(m);
 		fc->dataset.sender = m->header.sourcePortIdentity;
 		/* For 1588, we do not count this first message, see 9.5.3(b) */
 		if (!port_is_ieee8021as(fc->port))
@@ -388,15 +469,13 @@ static int add_foreign_master(struct port *p, struct ptp_message *m)
 	/*
 	 * Okay, go ahead and add this announcement.
 	 */
-	msg_get(m);
-	fc->n_messages++;
-	TAILQ_INSERT_HEAD(&fc->messages, m, list);
+	fc_push(fc, m);
 
 	/*
 	 * Test if this announcement contains changed information.
 	 */
-	if (fc->n_messages > 1) {
-		tmp = TAILQ_NEXT(m, list);
+	tmp = fc_previous(fc);
+	if (tmp) {
 		diff = announce_compare(m, tmp);
 	}
 
@@ -448,7 +527,7 @@ static int net_sync_resp_append(struct port *p, struct ptp_message *m)
 		paddr->addressLength =
 			transport_protocol_addr(best->trp, paddr->address);
 		if (best->best) {
-			tmp = TAILQ_FIRST(&best->best->messages);
+			tmp = fc_latest(best->best);
 			extract_address(tmp, paddr);
 		}
 	} else {
@@ -506,10 +585,9 @@ static void free_foreign_masters(struct port *p)
 {
 	struct foreign_clock *fc;
 	while ((fc = LIST_FIRST(&p->foreign_masters)) != NULL) {
-		LIST_REMOVE(fc, list);
-		fc_clear(fc);
-		free(fc);
+		fc_remove(fc);
 	}
+	p->best_valid = 0;
 }
 
 static int fup_sync_ok(struct ptp_message *fup, struct ptp_message *sync)
@@ -623,6 +701,146 @@ static int peer_prepare_and_send(struct port *p, struct ptp_message *msg,
 	return 0;
 }
 
+static void txts_slot_release(struct txts_slot *s)
+{
+	msg_put(s->msg);
+	if (s->req) {
+		msg_put(s->req);
+	}
+	memset(s, 0, sizeof(*s));
+}
+
+static void port_txts_flush(struct port *p)
+{
+	int i;
+
+	p->txts_key = 0;
+	p->txts_oldest = 0;
+	p->txts_expires = 0;
+	twheel_cancel(&p->txts_timer);
+	if (!p->txts) {
+		return;
+	}
+	for (i = 0; i < N_TXTS_SLOTS; i++) {
+		if (p->txts[i].msg) {
+			txts_slot_release(&p->txts[i]);
+		}
+	}
+}
+
+struct txts_slot *port_txts_track(struct port *p, struct ptp_message *msg,
+				  int (*complete)(struct port *p,
+						  struct txts_slot *s,
+						  tmv_t ts))
+{
+	struct txts_slot *s = &p->txts[p->txts_key % N_TXTS_SLOTS];
+	struct timespec now;
+
+	if (s->msg) {
+		pr_err("port %hu: missing timestamp on transmitted %s",
+		       portnum(p), msg_type_string(msg_type(s->msg)));
+		txts_slot_release(s);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	msg_get(msg);
+	s->msg = msg;
+	s->complete = complete;
+	s->expires = now.tv_sec * NS_PER_SEC + now.tv_nsec +
+		sk_tx_timeout * 1000000ULL;
+	s->key = p->txts_key++;
+
+	if (p->txts_key - p->txts_oldest > N_TXTS_SLOTS) {
+		p->txts_oldest = p->txts_key - N_TXTS_SLOTS;
+	}
+	/* The timer always waits for the oldest message in flight. */
+	if (!p->txts_expires) {
+		p->txts_expires = s->expires;
+		twheel_arm_abs(&p->txts_timer, s->expires);
+	}
+	return s;
+}
+
+static void flush_tx_batch(struct tx_batch *b)
+{
+	int i;
+
+	for (i = 0; i < b->len; i++) {
+		msg_put(b->msg[i]);
+	}
+	b->len = 0;
+}
+
+static int port_tx_batch_send(struct port *p, struct tx_batch *b,
+			      enum transport_event event)
+{
+	int cnt[SK_TX_BATCH_MAX], err = 0, i;
+
+	if (!b->len) {
+		return 0;
+	}
+	transport_sendto_batch(p->trp, &p->fda, event, b->msg, cnt, b->len);
+
+	for (i = 0; i < b->len; i++) {
+		if (cnt[i] <= 0) {
+			pr_err("port %hu: send %s failed", portnum(p),
+			       msg_type_string(msg_type(b->msg[i])));
+			err = -1;
+			continue;
+		}
+		port_stats_inc_tx(p, b->msg[i]);
+		/*
+		 * Only the packets that actually went out consume a time
+		 * stamp key, and so the tracking waits until now.
+		 */
+		if (b->complete[i]) {
+			port_txts_track(p, b->msg[i], b->complete[i]);
+		}
+	}
+	flush_tx_batch(b);
+	return err;
+}
+
+static void port_tx_batch_add(struct port *p, struct ptp_message *msg,
+			      enum transport_event event,
+			      int (*complete)(struct port *p,
+					      struct txts_slot *s,
+					      tmv_t ts))
+{
+	struct tx_batch *b;
+
+	b = event == TRANS_GENERAL ? &p->txb_general : &p->txb_event;
+	if (b->len == SK_TX_BATCH_MAX && port_tx_batch_send(p, b, event)) {
+		p->tx_batch_err = -1;
+	}
+	msg_get(msg);
+	b->msg[b->len] = msg;
+	b->complete[b->len] = complete;
+	b->len++;
+}
+
+void port_tx_batch_begin(struct port *p)
+{
+	p->tx_batching++;
+}
+
+int port_tx_batch_end(struct port *p)
+{
+	int err;
+
+	if (--p->tx_batching) {
+		return 0;
+	}
+	err = p->tx_batch_err;
+	p->tx_batch_err = 0;
+	if (port_tx_batch_send(p, &p->txb_event, TRANS_DEFER_EVENT)) {
+		err = -1;
+	}
+	if (port_tx_batch_send(p, &p->txb_general, TRANS_GENERAL)) {
+		err = -1;
+	}
+	return err;
+}
+
 int port_capable(struct port *p)
 {
 	if (!port_is_ieee8021as(p)) {
@@ -690,12 +908,10 @@ not_capable:
 	return 0;
 }
 
-int port_clr_tmo(int fd)
+int port_clr_tmo(struct twheel_timer *t)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	twheel_cancel(t);
+	return 0;
 }
 
 static int port_ignore(struct port *p, struct ptp_message *m)
@@ -752,7 +968,7 @@ static int port_nsm_reply(struct port *p, struct ptp_message *m)
 /*
  * Test whether a 802.1AS port may transmit a sync message.
  */
-static int port_sync_incapable(struct port *p)
+int port_sync_incapable(struct port *p)
 {
 	struct ClockIdentity cid;
 	struct PortIdentity pid;
@@ -799,6 +1015,7 @@ static int port_management_fill_response(struct port *target,
 	struct management_tlv_datum *mtd;
 	struct clock_description *desc;
 	struct port_properties_np *ppn;
+	struct unicast_service_pacing_np *usp;
 	struct port_stats_np *psn;
 	struct management_tlv *tlv;
 	struct port_ds_np *pdsnp;
@@ -807,7 +1024,7 @@ static int port_management_fill_response(struct port *target,
 	struct portDS *pds;
 	uint16_t u16;
 	uint8_t *buf;
-	int datalen;
+	int datalen, n;
 
 	extra = tlv_extra_alloc();
 	if (!extra) {
@@ -963,6 +1180,15 @@ static int port_management_fill_response(struct port *target,
 		psn->stats = target->stats;
 		datalen = sizeof(*psn);
 		break;
+	case TLV_UNICAST_SERVICE_PACING_NP:
+		usp = (struct unicast_service_pacing_np *) tlv->data;
+		usp->portIdentity = target->portIdentity;
+		datalen = sizeof(*usp);
+		n = 0;
+		datalen += unicast_service_pacing(target, usp->data,
+						  MAX_PACING_LEN - datalen, &n);
+		usp->numberIntervals = n;
+		break;
 	default:
 		/* The caller should *not* respond to this message. */
 		tlv_extra_recycle(extra);
@@ -1090,7 +1316,7 @@ static void port_nrate_initialize(struct port *p)
 
 int port_set_announce_tmo(struct port *p)
 {
-	return set_tmo_random(p->fda.fd[FD_ANNOUNCE_TIMER],
+	return set_tmo_random(port_timer(p, FD_ANNOUNCE_TIMER),
 			      p->announceReceiptTimeout,
 			      p->announce_span, p->logAnnounceInterval);
 }
@@ -1102,34 +1328,34 @@ int port_set_delay_tmo(struct port *p)
 	}
 
 	if (p->delayMechanism == DM_P2P) {
-		return set_tmo_log(p->fda.fd[FD_DELAY_TIMER], 1,
+		return set_tmo_log(port_timer(p, FD_DELAY_TIMER), 1,
 			       p->logPdelayReqInterval);
 	} else {
-		return set_tmo_random(p->fda.fd[FD_DELAY_TIMER], 0, 2,
+		return set_tmo_random(port_timer(p, FD_DELAY_TIMER), 0, 2,
 				p->logMinDelayReqInterval);
 	}
 }
 
 static int port_set_manno_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, p->logAnnounceInterval);
+	return set_tmo_log(port_timer(p, FD_MANNO_TIMER), 1, p->logAnnounceInterval);
 }
 
 int port_set_qualification_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_QUALIFICATION_TIMER],
+	return set_tmo_log(port_timer(p, FD_QUALIFICATION_TIMER),
 		       1+clock_steps_removed(p->clock), p->logAnnounceInterval);
 }
 
 static int port_set_sync_rx_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_SYNC_RX_TIMER],
+	return set_tmo_log(port_timer(p, FD_SYNC_RX_TIMER),
 			   p->syncReceiptTimeout, p->logSyncInterval);
 }
 
 static int port_set_sync_tx_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_SYNC_TX_TIMER], 1, p->logSyncInterval);
+	return set_tmo_log(port_timer(p, FD_SYNC_TX_TIMER), 1, p->logSyncInterval);
 }
 
 void port_show_transition(struct port *p, enum port_state next,
@@ -1354,6 +1580,16 @@ static void port_syfufsm(struct port *p, enum syfu_event event,
 	}
 }
 
+static int port_pdelay_request_complete(struct port *p, struct txts_slot *s,
+					tmv_t ts)
+{
+	s->msg->hwts.ts = ts;
+	if (p->peer_delay_req == s->msg) {
+		port_peer_delay(p);
+	}
+	return 0;
+}
+
 static int port_pdelay_request(struct port *p)
 {
 	struct ptp_message *msg;
@@ -1388,12 +1624,15 @@ static int port_pdelay_request(struct port *p)
 		msg->header.flagField[0] |= UNICAST;
 	}
 
-	err = peer_prepare_and_send(p, msg, TRANS_EVENT);
+	err = peer_prepare_and_send(p, msg, p->tx_async ?
+				    TRANS_DEFER_EVENT : TRANS_EVENT);
 	if (err) {
 		pr_err("port %hu: send peer delay request failed", portnum(p));
 		goto out;
 	}
-	if (msg_sots_missing(msg)) {
+	if (p->tx_async) {
+		port_txts_track(p, msg, port_pdelay_request_complete);
+	} else if (msg_sots_missing(msg)) {
 		pr_err("missing timestamp on transmitted peer delay request");
 		goto out;
 	}
@@ -1411,6 +1650,21 @@ out:
 	return -1;
 }
 
+static int port_delay_request_complete(struct port *p, struct txts_slot *s,
+				       tmv_t ts)
+{
+	struct ptp_message *rsp = p->delay_resp_early;
+
+	s->msg->hwts.ts = ts;
+	if (rsp && rsp->delay_resp.hdr.sequenceId ==
+	    ntohs(s->msg->delay_req.hdr.sequenceId)) {
+		p->delay_resp_early = NULL;
+		process_delay_resp(p, rsp);
+		msg_put(rsp);
+	}
+	return 0;
+}
+
 int port_delay_request(struct port *p)
 {
 	struct ptp_message *msg;
@@ -1447,16 +1701,20 @@ int port_delay_request(struct port *p)
 	msg->header.logMessageInterval = 0x7f;
 
 	if (p->hybrid_e2e) {
-		struct ptp_message *dst = TAILQ_FIRST(&p->best->messages);
+		struct ptp_message *dst = fc_latest(p->best);
 		msg->address = dst->address;
 		msg->header.flagField[0] |= UNICAST;
 	}
 
-	if (port_prepare_and_send(p, msg, TRANS_EVENT)) {
+	if (port_prepare_and_send(p, msg, p->tx_async ?
+				  TRANS_DEFER_EVENT : TRANS_EVENT)) {
 		pr_err("port %hu: send delay request failed", portnum(p));
 		goto out;
 	}
-	if (msg_sots_missing(msg)) {
+	if (p->tx_async) {
+		/* The time stamp is filled in once it arrives. */
+		port_txts_track(p, msg, port_delay_request_complete);
+	} else if (msg_sots_missing(msg)) {
 		pr_err("missing timestamp on transmitted delay request");
 		goto out;
 	}
@@ -1469,22 +1727,15 @@ out:
 	return -1;
 }
 
-int port_tx_announce(struct port *p, struct address *dst)
+struct ptp_message *port_announce_create(struct port *p, struct address *dst)
 {
 	struct timePropertiesDS tp = clock_time_properties(p->clock);
 	struct parent_ds *dad = clock_parent_ds(p->clock);
 	struct ptp_message *msg;
-	int err;
 
-	if (p->inhibit_multicast_service && !dst) {
-		return 0;
-	}
-	if (!port_capable(p)) {
-		return 0;
-	}
 	msg = msg_allocate();
 	if (!msg) {
-		return -1;
+		return NULL;
 	}
 
 	msg->hwts.type = p->timestamping;
@@ -1494,7 +1745,6 @@ int port_tx_announce(struct port *p, struct address *dst)
 	msg->header.messageLength      = sizeof(struct announce_msg);
 	msg->header.domainNumber       = clock_domain_number(p->clock);
 	msg->header.sourcePortIdentity = p->portIdentity;
-	msg->header.sequenceId         = p->seqnum.announce++;
 	msg->header.control            = CTL_OTHER;
 	msg->header.logMessageInterval = p->logAnnounceInterval;
 
@@ -1515,6 +1765,25 @@ int port_tx_announce(struct port *p, struct address *dst)
 	if (p->path_trace_enabled && path_trace_append(p, msg, dad)) {
 		pr_err("port %hu: append path trace failed", portnum(p));
 	}
+	return msg;
+}
+
+int port_tx_announce(struct port *p, struct address *dst)
+{
+	struct ptp_message *msg;
+	int err;
+
+	if (p->inhibit_multicast_service && !dst) {
+		return 0;
+	}
+	if (!port_capable(p)) {
+		return 0;
+	}
+	msg = port_announce_create(p, dst);
+	if (!msg) {
+		return -1;
+	}
+	msg->header.sequenceId = p->seqnum.announce++;
 
 	err = port_prepare_and_send(p, msg, TRANS_GENERAL);
 	if (err) {
@@ -1578,44 +1847,77 @@ static void port_syfu_relay_info_insert(struct port *p,
 	pr_debug("port %hu:   fup_info %.9f", portnum(p), gm_rr);
 }
 
-int port_tx_sync(struct port *p, struct address *dst)
+struct ptp_message *port_followup_create(struct port *p,
+					 struct ptp_message *msg)
 {
-	struct ptp_message *msg, *fup;
-	int err, event;
+	struct ptp_message *fup;
 
-	switch (p->timestamping) {
-	case TS_SOFTWARE:
-	case TS_LEGACY_HW:
-	case TS_HARDWARE:
-		event = TRANS_EVENT;
-		break;
-	case TS_ONESTEP:
-		event = TRANS_ONESTEP;
-		break;
-	case TS_P2P1STEP:
-		event = TRANS_P2P1STEP;
-		break;
-	default:
-		return -1;
+	fup = msg_allocate();
+	if (!fup) {
+		return NULL;
 	}
 
-	if (p->inhibit_multicast_service && !dst) {
-		return 0;
+	fup->hwts.type = p->timestamping;
+
+	fup->header.tsmt               = FOLLOW_UP | p->transportSpecific;
+	fup->header.ver                = PTP_VERSION;
+	fup->header.messageLength      = sizeof(struct follow_up_msg);
+	fup->header.domainNumber       = clock_domain_number(p->clock);
+	fup->header.sourcePortIdentity = p->portIdentity;
+	fup->header.sequenceId         = ntohs(msg->header.sequenceId);
+	fup->header.control            = CTL_FOLLOW_UP;
+	fup->header.logMessageInterval = p->logSyncInterval;
+
+	fup->follow_up.preciseOriginTimestamp = tmv_to_Timestamp(msg->hwts.ts);
+
+	if (msg_unicast(msg)) {
+		fup->address = msg->address;
+		fup->header.flagField[0] |= UNICAST;
 	}
-	if (!port_capable(p)) {
-		return 0;
+
+	if (p->follow_up_info) {
+		if (follow_up_info_append(fup)) {
+			pr_err("port %hu: append fup info failed", portnum(p));
+			msg_put(fup);
+			return NULL;
+		}
+
+		port_syfu_relay_info_insert(p, msg, fup);
 	}
-	if (port_sync_incapable(p)) {
-		return 0;
+	return fup;
+}
+
+static int port_tx_followup(struct port *p, struct ptp_message *msg)
+{
+	struct ptp_message *fup;
+	int err;
+
+	fup = port_followup_create(p, msg);
+	if (!fup) {
+		return -1;
+	}
+	err = port_prepare_and_send(p, fup, TRANS_GENERAL);
+	if (err) {
+		pr_err("port %hu: send follow up failed", portnum(p));
 	}
+	msg_put(fup);
+	return err;
+}
+
+static int port_tx_sync_complete(struct port *p, struct txts_slot *s,
+				 tmv_t ts)
+{
+	s->msg->hwts.ts = ts;
+	return port_tx_followup(p, s->msg);
+}
+
+struct ptp_message *port_sync_create(struct port *p, struct address *dst)
+{
+	struct ptp_message *msg;
+
 	msg = msg_allocate();
 	if (!msg) {
-		return -1;
-	}
-	fup = msg_allocate();
-	if (!fup) {
-		msg_put(msg);
-		return -1;
+		return NULL;
 	}
 
 	msg->hwts.type = p->timestamping;
@@ -1625,7 +1927,6 @@ int port_tx_sync(struct port *p, struct address *dst)
 	msg->header.messageLength      = sizeof(struct sync_msg);
 	msg->header.domainNumber       = clock_domain_number(p->clock);
 	msg->header.sourcePortIdentity = p->portIdentity;
-	msg->header.sequenceId         = p->seqnum.sync++;
 	msg->header.control            = CTL_SYNC;
 	msg->header.logMessageInterval = p->logSyncInterval;
 
@@ -1638,57 +1939,78 @@ int port_tx_sync(struct port *p, struct address *dst)
 		msg->header.flagField[0] |= UNICAST;
 		msg->header.logMessageInterval = 0x7f;
 	}
-	err = port_prepare_and_send(p, msg, event);
-	if (err) {
-		pr_err("port %hu: send sync failed", portnum(p));
-		goto out;
-	}
-	if (p->timestamping == TS_ONESTEP || p->timestamping == TS_P2P1STEP) {
-		goto out;
-	} else if (msg_sots_missing(msg)) {
-		pr_err("missing timestamp on transmitted sync");
-		err = -1;
-		goto out;
-	}
-
-	/*
-	 * Send the follow up message right away.
-	 */
-	fup->hwts.type = p->timestamping;
+	return msg;
+}
 
-	fup->header.tsmt               = FOLLOW_UP | p->transportSpecific;
-	fup->header.ver                = PTP_VERSION;
-	fup->header.messageLength      = sizeof(struct follow_up_msg);
-	fup->header.domainNumber       = clock_domain_number(p->clock);
-	fup->header.sourcePortIdentity = p->portIdentity;
-	fup->header.sequenceId         = p->seqnum.sync - 1;
-	fup->header.control            = CTL_FOLLOW_UP;
-	fup->header.logMessageInterval = p->logSyncInterval;
+int port_tx_sync(struct port *p, struct address *dst)
+{
+	struct ptp_message *msg;
+	int err, event;
 
-	fup->follow_up.preciseOriginTimestamp = tmv_to_Timestamp(msg->hwts.ts);
+	switch (p->timestamping) {
+	case TS_SOFTWARE:
+	case TS_LEGACY_HW:
+	case TS_HARDWARE:
+		event = p->tx_async ? TRANS_DEFER_EVENT : TRANS_EVENT;
+		break;
+	case TS_ONESTEP:
+		event = TRANS_ONESTEP;
+		break;
+	case TS_P2P1STEP:
+		event = TRANS_P2P1STEP;
+		break;
+	default:
+		return -1;
+	}
 
-	if (dst) {
-		fup->address = *dst;
-		fup->header.flagField[0] |= UNICAST;
+	if (p->inhibit_multicast_service && !dst) {
+		return 0;
+	}
+	if (!port_capable(p)) {
+		return 0;
+	}
+	if (port_sync_incapable(p)) {
+		return 0;
 	}
+	msg = port_sync_create(p, dst);
+	if (!msg) {
+		return -1;
+	}
+	msg->header.sequenceId = p->seqnum.sync++;
 
-	if (p->follow_up_info) {
-		if (follow_up_info_append(fup)) {
-			pr_err("port %hu: append fup info failed", portnum(p));
-			err = -1;
+	if (p->tx_batching && dst && event == TRANS_DEFER_EVENT) {
+		err = msg_pre_send(msg);
+		if (err) {
+			pr_err("port %hu: send sync failed", portnum(p));
 			goto out;
 		}
-
-		port_syfu_relay_info_insert(p, msg, fup);
+		/* The time stamp is tracked once the batch goes out. */
+		port_tx_batch_add(p, msg, event, port_tx_sync_complete);
+		goto out;
 	}
-
-	err = port_prepare_and_send(p, fup, TRANS_GENERAL);
+	err = port_prepare_and_send(p, msg, event);
 	if (err) {
-		pr_err("port %hu: send follow up failed", portnum(p));
+		pr_err("port %hu: send sync failed", portnum(p));
+		goto out;
+	}
+	if (p->timestamping == TS_ONESTEP || p->timestamping == TS_P2P1STEP) {
+		goto out;
+	} else if (event == TRANS_DEFER_EVENT) {
+		/* The follow up goes out once the time stamp arrives. */
+		port_txts_track(p, msg, port_tx_sync_complete);
+		goto out;
+	} else if (msg_sots_missing(msg)) {
+		pr_err("missing timestamp on transmitted sync");
+		err = -1;
+		goto out;
 	}
+
+	/*
+	 * Send the follow up message right away.
+	 */
+	err = port_tx_followup(p, msg);
 out:
 	msg_put(msg);
-	msg_put(fup);
 	return err;
 }
 
@@ -1729,6 +2051,10 @@ void flush_delay_req(struct port *p)
 		TAILQ_REMOVE(&p->delay_req, m, list);
 		msg_put(m);
 	}
+	if (p->delay_resp_early) {
+		msg_put(p->delay_resp_early);
+		p->delay_resp_early = NULL;
+	}
 }
 
 static void flush_peer_delay(struct port *p)
@@ -1747,6 +2073,117 @@ static void flush_peer_delay(struct port *p)
 	}
 }
 
+static void flush_rx_batch(struct port *p)
+{
+	struct rx_batch *q;
+	int i;
+
+	if (!p->rxq) {
+		return;
+	}
+	for (i = 0; i < N_RX_QUEUES; i++) {
+		q = &p->rxq[i];
+		for (; q->len; q->head++, q->len--) {
+			msg_put(q->msg[q->head]);
+			q->msg[q->head] = NULL;
+		}
+		q->head = 0;
+	}
+}
+
+static void port_rx_batch_stats(struct port *p, int cnt)
+{
+	struct stats_result res;
+	struct timespec now;
+
+	stats_add_value(p->rx_batch_stats, cnt);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec < p->rx_batch_report) {
+		return;
+	}
+	if (p->rx_batch_report && !stats_get_result(p->rx_batch_stats, &res)) {
+		pr_info("port %hu: rx batch wakeups %u messages per wakeup "
+			"mean %.1f max %.0f", portnum(p),
+			stats_get_num_values(p->rx_batch_stats), res.mean, res.max);
+	}
+	stats_reset(p->rx_batch_stats);
+	p->rx_batch_report = now.tv_sec + p->rx_batch_interval;
+}
+
+static int port_rx_fill(struct port *p, int fd_index)
+{
+	struct rx_batch *q = &p->rxq[fd_index];
+	int cnt, i, n;
+
+	for (n = 0; n < p->rx_batch; n++) {
+		q->msg[n] = msg_allocate();
+		if (!q->msg[n]) {
+			break;
+		}
+		q->msg[n]->hwts.type = p->timestamping;
+	}
+	if (!n) {
+		return -ENOMEM;
+	}
+	cnt = transport_recv_batch(p->trp, p->fda.fd[fd_index],
+				   q->msg, q->cnt, n);
+	for (i = cnt > 0 ? cnt : 0; i < n; i++) {
+		msg_put(q->msg[i]);
+		q->msg[i] = NULL;
+	}
+	if (cnt < 1) {
+		return cnt < 0 ? cnt : -EAGAIN;
+	}
+	q->head = 0;
+	q->len = cnt;
+	port_rx_batch_stats(p, cnt);
+	return 0;
+}
+
+int port_recv(struct port *p, int fd_index, struct ptp_message **msg)
+{
+	struct rx_batch *q;
+	int cnt, err;
+
+	*msg = NULL;
+
+	if (!p->rxq || fd_index >= N_RX_QUEUES) {
+		*msg = msg_allocate();
+		if (!*msg) {
+			return -ENOMEM;
+		}
+		(*msg)->hwts.type = p->timestamping;
+		cnt = transport_recv(p->trp, p->fda.fd[fd_index], *msg);
+	} else {
+		q = &p->rxq[fd_index];
+		if (!q->len) {
+			err = port_rx_fill(p, fd_index);
+			if (err) {
+				return err;
+			}
+		}
+		*msg = q->msg[q->head];
+		cnt = q->cnt[q->head];
+		q->msg[q->head] = NULL;
+		q->head++;
+		q->len--;
+	}
+	if (cnt < 0) {
+		msg_put(*msg);
+		*msg = NULL;
+	}
+	return cnt;
+}
+
+int port_rx_pending(struct port *p, int fd_index)
+{
+	if (!p->rxq || fd_index >= N_RX_QUEUES) {
+		return 0;
+	}
+	return p->rxq[fd_index].len;
+}
+
 static void port_clear_fda(struct port *p, int count)
 {
 	int i;
@@ -1765,11 +2202,18 @@ void port_disable(struct port *p)
 	flush_peer_delay(p);
 
 	p->best = NULL;
+	p->best_valid = 0;
 	free_foreign_masters(p);
+	port_txts_flush(p);
+	flush_rx_batch(p);
+	flush_tx_batch(&p->txb_general);
+	flush_tx_batch(&p->txb_event);
+	p->tx_batch_err = 0;
+	unicast_service_stop(p);
 	transport_close(p->trp, &p->fda);
 
 	for (i = 0; i < N_TIMER_FDS; i++) {
-		close(p->fda.fd[FD_FIRST_TIMER + i]);
+		port_clr_tmo(&p->timer[i]);
 	}
 
 	/* Keep rtnl socket to get link status info. */
@@ -1780,7 +2224,7 @@ void port_disable(struct port *p)
 int port_initialize(struct port *p)
 {
 	struct config *cfg = clock_config(p->clock);
-	int fd[N_TIMER_FDS], i;
+	int i;
 
 	p->multiple_seq_pdr_count  = 0;
 	p->multiple_pdr_detected   = 0;
@@ -1818,22 +2262,8 @@ int port_initialize(struct port *p)
 		return -1;
 	}
 
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		fd[i] = -1;
-	}
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		fd[i] = timerfd_create(CLOCK_MONOTONIC, 0);
-		if (fd[i] < 0) {
-			pr_err("timerfd_create: %s", strerror(errno));
-			goto no_timers;
-		}
-	}
 	if (transport_open(p->trp, p->iface, &p->fda, p->timestamping))
-		goto no_tropen;
-
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		p->fda.fd[FD_FIRST_TIMER + i] = fd[i];
-	}
+		return -1;
 
 	if (port_set_announce_tmo(p)) {
 		goto no_tmo;
@@ -1861,19 +2291,20 @@ int port_initialize(struct port *p)
 		}
 	}
 
+	if (unicast_service_start(p)) {
+		goto no_tmo;
+	}
+
 	port_nrate_initialize(p);
 
 	clock_fda_changed(p->clock);
 	return 0;
 
 no_tmo:
-	transport_close(p->trp, &p->fda);
-no_tropen:
-no_timers:
 	for (i = 0; i < N_TIMER_FDS; i++) {
-		if (fd[i] >= 0)
-			close(fd[i]);
+		port_clr_tmo(&p->timer[i]);
 	}
+	transport_close(p->trp, &p->fda);
 	return -1;
 }
 
@@ -1884,9 +2315,18 @@ static int port_renew_transport(struct port *p)
 	if (!port_is_enabled(p)) {
 		return 0;
 	}
+	port_txts_flush(p);
+	flush_rx_batch(p);
+	flush_tx_batch(&p->txb_general);
+	flush_tx_batch(&p->txb_event);
+	p->tx_batch_err = 0;
+	unicast_service_stop(p);
 	transport_close(p->trp, &p->fda);
 	port_clear_fda(p, FD_FIRST_TIMER);
 	res = transport_open(p->trp, p->iface, &p->fda, p->timestamping);
+	if (!res) {
+		res = unicast_service_start(p);
+	}
 	/* Need to call clock_fda_changed even if transport_open failed in
 	 * order to update clock to the now closed descriptors. */
 	clock_fda_changed(p->clock);
@@ -1921,11 +2361,9 @@ static int update_current_master(struct port *p, struct ptp_message *m)
 	}
 	port_set_announce_tmo(p);
 	fc_prune(fc);
-	msg_get(m);
-	fc->n_messages++;
-	TAILQ_INSERT_HEAD(&fc->messages, m, list);
-	if (fc->n_messages > 1) {
-		tmp = TAILQ_NEXT(m, list);
+	fc_push(fc, m);
+	tmp = fc_previous(fc);
+	if (tmp) {
 		return announce_compare(m, tmp);
 	}
 	return 0;
@@ -2055,6 +2493,15 @@ void process_delay_resp(struct port *p, struct ptp_message *m)
 	if (!req) {
 		return;
 	}
+	if (!msg_sots_valid(req)) {
+		/* Wait for the time stamp of the request. */
+		if (p->delay_resp_early) {
+			msg_put(p->delay_resp_early);
+		}
+		msg_get(m);
+		p->delay_resp_early = m;
+		return;
+	}
 
 	c3 = correction_to_tmv(m->header.correction);
 	t3 = req->hwts.ts;
@@ -2126,10 +2573,59 @@ void process_follow_up(struct port *p, struct ptp_message *m)
 	port_syfufsm(p, event, m);
 }
 
+static int port_tx_pdelay_resp_fup(struct port *p, struct ptp_message *m,
+				   struct ptp_message *rsp)
+{
+	struct ptp_message *fup;
+	int err;
+
+	fup = msg_allocate();
+	if (!fup) {
+		return -1;
+	}
+
+	fup->hwts.type = p->timestamping;
+
+	fup->header.tsmt               = PDELAY_RESP_FOLLOW_UP | p->transportSpecific;
+	fup->header.ver                = PTP_VERSION;
+	fup->header.messageLength      = sizeof(struct pdelay_resp_fup_msg);
+	fup->header.domainNumber       = m->header.domainNumber;
+	fup->header.correction         = m->header.correction;
+	fup->header.sourcePortIdentity = p->portIdentity;
+	fup->header.sequenceId         = m->header.sequenceId;
+	fup->header.control            = CTL_OTHER;
+	fup->header.logMessageInterval = 0x7f;
+
+	fup->pdelay_resp_fup.requestingPortIdentity = m->header.sourcePortIdentity;
+
+	fup->pdelay_resp_fup.responseOriginTimestamp =
+		tmv_to_Timestamp(rsp->hwts.ts);
+
+	if (msg_unicast(m)) {
+		fup->address = m->address;
+		fup->header.flagField[0] |= UNICAST;
+	}
+
+	err = peer_prepare_and_send(p, fup, TRANS_GENERAL);
+	if (err) {
+		pr_err("port %hu: send pdelay_resp_fup failed", portnum(p));
+	}
+	msg_put(fup);
+	return err;
+}
+
+static int port_pdelay_response_complete(struct port *p, struct txts_slot *s,
+					 tmv_t ts)
+{
+	s->msg->hwts.ts = ts;
+	return port_tx_pdelay_resp_fup(p, s->req, s->msg);
+}
+
 int process_pdelay_req(struct port *p, struct ptp_message *m)
 {
-	struct ptp_message *rsp, *fup;
 	enum transport_event event;
+	struct ptp_message *rsp;
+	struct txts_slot *s;
 	int err;
 
 	switch (p->timestamping) {
@@ -2137,7 +2633,7 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 	case TS_LEGACY_HW:
 	case TS_HARDWARE:
 	case TS_ONESTEP:
-		event = TRANS_EVENT;
+		event = p->tx_async ? TRANS_DEFER_EVENT : TRANS_EVENT;
 		break;
 	case TS_P2P1STEP:
 		event = TRANS_P2P1STEP;
@@ -2176,12 +2672,6 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 		return -1;
 	}
 
-	fup = msg_allocate();
-	if (!fup) {
-		msg_put(rsp);
-		return -1;
-	}
-
 	rsp->hwts.type = p->timestamping;
 
 	rsp->header.tsmt               = PDELAY_RESP | p->transportSpecific;
@@ -2220,6 +2710,11 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 	}
 	if (p->timestamping == TS_P2P1STEP) {
 		goto out;
+	} else if (event == TRANS_DEFER_EVENT) {
+		s = port_txts_track(p, rsp, port_pdelay_response_complete);
+		msg_get(m);
+		s->req = m;
+		goto out;
 	} else if (msg_sots_missing(rsp)) {
 		pr_err("missing timestamp on transmitted peer delay response");
 		err = -1;
@@ -2229,35 +2724,9 @@ int process_pdelay_req(struct port *p, struct ptp_message *m)
 	/*
 	 * Send the follow up message right away.
 	 */
-	fup->hwts.type = p->timestamping;
-
-	fup->header.tsmt               = PDELAY_RESP_FOLLOW_UP | p->transportSpecific;
-	fup->header.ver                = PTP_VERSION;
-	fup->header.messageLength      = sizeof(struct pdelay_resp_fup_msg);
-	fup->header.domainNumber       = m->header.domainNumber;
-	fup->header.correction         = m->header.correction;
-	fup->header.sourcePortIdentity = p->portIdentity;
-	fup->header.sequenceId         = m->header.sequenceId;
-	fup->header.control            = CTL_OTHER;
-	fup->header.logMessageInterval = 0x7f;
-
-	fup->pdelay_resp_fup.requestingPortIdentity = m->header.sourcePortIdentity;
-
-	fup->pdelay_resp_fup.responseOriginTimestamp =
-		tmv_to_Timestamp(rsp->hwts.ts);
-
-	if (msg_unicast(m)) {
-		fup->address = m->address;
-		fup->header.flagField[0] |= UNICAST;
-	}
-
-	err = peer_prepare_and_send(p, fup, TRANS_GENERAL);
-	if (err) {
-		pr_err("port %hu: send pdelay_resp_fup failed", portnum(p));
-	}
+	err = port_tx_pdelay_resp_fup(p, m, rsp);
 out:
 	msg_put(rsp);
-	msg_put(fup);
 	return err;
 }
 
@@ -2279,6 +2748,10 @@ static void port_peer_delay(struct port *p)
 	if (rsp->header.sequenceId != ntohs(req->header.sequenceId))
 		return;
 
+	/* Wait for the transmit time stamp of the request. */
+	if (msg_sots_missing(req))
+		return;
+
 	t1 = req->hwts.ts;
 	t4 = rsp->hwts.ts;
 	c1 = correction_to_tmv(rsp->header.correction + p->asymmetry);
@@ -2457,9 +2930,13 @@ void port_close(struct port *p)
 	unicast_service_cleanup(p);
 	transport_destroy(p->trp);
 	tsproc_destroy(p->tsproc);
-	if (p->fault_fd >= 0) {
-		close(p->fault_fd);
+	port_clr_tmo(&p->fault_timer);
+	port_clr_tmo(&p->txts_timer);
+	free(p->txts);
+	if (p->rx_batch_stats) {
+		stats_destroy(p->rx_batch_stats);
 	}
+	free(p->rxq);
 	free(p);
 }
 
@@ -2467,8 +2944,21 @@ struct foreign_clock *port_compute_best(struct port *p)
 {
 	int (*dscmp)(struct dataset *a, struct dataset *b);
 	int threshold = FOREIGN_MASTER_THRESHOLD;
+	int64_t expiry = INT64_MAX, t;
 	struct foreign_clock *fc;
 	struct ptp_message *tmp;
+	struct timespec now;
+
+	/*
+	 * The outcome only changes when an announce message arrives or
+	 * leaves, or when the oldest message kept ages out, so reuse it
+	 * until then.
+	 */
+	if (p->best_valid) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec * NSEC2SEC + now.tv_nsec < p->best_expiry)
+			return p->best;
+	}
 
 	dscmp = clock_dscmp(p->clock);
 	p->best = NULL;
@@ -2477,7 +2967,7 @@ struct foreign_clock *port_compute_best(struct port *p)
 		return p->best;
 
 	LIST_FOREACH(fc, &p->foreign_masters, list) {
-		tmp = TAILQ_FIRST(&fc->messages);
+		tmp = fc_latest(fc);
 		if (!tmp)
 			continue;
 
@@ -2499,17 +2989,28 @@ struct foreign_clock *port_compute_best(struct port *p)
 			fc_clear(fc);
 	}
 
+	LIST_FOREACH(fc, &p->foreign_masters, list) {
+		tmp = fc_oldest(fc);
+		if (!tmp)
+			continue;
+		t = msg_expiry(tmp);
+		if (t < expiry)
+			expiry = t;
+	}
+	p->best_expiry = expiry;
+	p->best_valid = 1;
+
 	return p->best;
 }
 
 static void port_e2e_transition(struct port *p, enum port_state next)
 {
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_DELAY_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(port_timer(p, FD_ANNOUNCE_TIMER));
+	port_clr_tmo(port_timer(p, FD_SYNC_RX_TIMER));
+	port_clr_tmo(port_timer(p, FD_DELAY_TIMER));
+	port_clr_tmo(port_timer(p, FD_QUALIFICATION_TIMER));
+	port_clr_tmo(port_timer(p, FD_MANNO_TIMER));
+	port_clr_tmo(port_timer(p, FD_SYNC_TX_TIMER));
 	/* Leave FD_UNICAST_REQ_TIMER running. */
 
 	switch (next) {
@@ -2528,7 +3029,7 @@ static void port_e2e_transition(struct port *p, enum port_state next)
 	case PS_MASTER:
 	case PS_GRAND_MASTER:
 		if (!p->inhibit_announce) {
-			set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, -10); /*~1ms*/
+			set_tmo_log(port_timer(p, FD_MANNO_TIMER), 1, -10); /*~1ms*/
 		}
 		port_set_sync_tx_tmo(p);
 		break;
@@ -2548,12 +3049,12 @@ static void port_e2e_transition(struct port *p, enum port_state next)
 
 static void port_p2p_transition(struct port *p, enum port_state next)
 {
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
+	port_clr_tmo(port_timer(p, FD_ANNOUNCE_TIMER));
+	port_clr_tmo(port_timer(p, FD_SYNC_RX_TIMER));
 	/* Leave FD_DELAY_TIMER running. */
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(port_timer(p, FD_QUALIFICATION_TIMER));
+	port_clr_tmo(port_timer(p, FD_MANNO_TIMER));
+	port_clr_tmo(port_timer(p, FD_SYNC_TX_TIMER));
 	/* Leave FD_UNICAST_REQ_TIMER running. */
 
 	switch (next) {
@@ -2573,7 +3074,7 @@ static void port_p2p_transition(struct port *p, enum port_state next)
 	case PS_MASTER:
 	case PS_GRAND_MASTER:
 		if (!p->inhibit_announce) {
-			set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, -10); /*~1ms*/
+			set_tmo_log(port_timer(p, FD_MANNO_TIMER), 1, -10); /*~1ms*/
 		}
 		port_set_sync_tx_tmo(p);
 		break;
@@ -2693,10 +3194,106 @@ enum fsm_event port_event(struct port *p, int fd_index)
 	return p->event(p, fd_index);
 }
 
+static enum fsm_event port_txts_drain(struct port *p)
+{
+	struct txts_slot *s, done;
+	struct hw_timestamp hwts;
+	int cnt = 0, err;
+	uint32_t key;
+
+	hwts.type = p->timestamping;
+
+	while (!(err = transport_txts_async(&p->fda, &hwts, &key))) {
+		cnt++;
+		s = &p->txts[key % N_TXTS_SLOTS];
+		if (!s->msg || s->key != key) {
+			pr_debug("port %hu: dropping stale tx timestamp %u",
+				 portnum(p), key);
+			/*
+			 * A key we have yet to hand out means that the
+			 * kernel counted a send we did not track. Catch
+			 * up, and let the slots that were tracked under
+			 * the wrong keys time out.
+			 */
+			if ((int32_t)(key - p->txts_key) >= 0) {
+				pr_err("port %hu: tx timestamp key %u ahead "
+				       "of %u, resynchronizing", portnum(p),
+				       key, p->txts_key);
+				p->txts_key = key + 1;
+			}
+			continue;
+		}
+		/* Free the slot first, as the completion may transmit. */
+		done = *s;
+		memset(s, 0, sizeof(*s));
+		ts_add(&hwts.ts, p->tx_timestamp_offset);
+		err = done.complete(p, &done, hwts.ts);
+		txts_slot_release(&done);
+		if (err) {
+			return EV_FAULT_DETECTED;
+		}
+		if (!port_is_enabled(p)) {
+			return EV_NONE;
+		}
+	}
+	if (err != -EAGAIN || !cnt) {
+		return EV_FAULT_DETECTED;
+	}
+	return EV_NONE;
+}
+
+enum fsm_event port_txts_timeout(struct port *p)
+{
+	enum fsm_event event = EV_NONE;
+	struct timespec ts;
+	struct txts_slot *s;
+	uint64_t now;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+
+	for (; p->txts_oldest != p->txts_key; p->txts_oldest++) {
+		s = &p->txts[p->txts_oldest % N_TXTS_SLOTS];
+		if (!s->msg || s->key != p->txts_oldest) {
+			continue;
+		}
+		if (s->expires > now) {
+			p->txts_expires = s->expires;
+			twheel_arm_abs(&p->txts_timer, s->expires);
+			return event;
+		}
+		pr_err("port %hu: timed out while waiting for tx timestamp "
+		       "of %s", portnum(p), msg_type_string(msg_type(s->msg)));
+		pr_err("increasing tx_timestamp_timeout may correct "
+		       "this issue, but it is likely caused by a driver bug");
+		txts_slot_release(s);
+		event = EV_FAULT_DETECTED;
+	}
+	p->txts_expires = 0;
+	twheel_cancel(&p->txts_timer);
+	return event;
+}
+
+enum fsm_event port_txts_event(struct port *p)
+{
+	enum fsm_event event;
+
+	if (!p->tx_async) {
+		return EV_FAULT_DETECTED;
+	}
+	/* Any unicast follow up messages leave together at the end. */
+	port_tx_batch_begin(p);
+	event = port_txts_drain(p);
+	if (port_tx_batch_end(p) && event == EV_NONE) {
+		event = EV_FAULT_DETECTED;
+	}
+	return event;
+}
+
 static enum fsm_event bc_event(struct port *p, int fd_index)
 {
+	struct ptp_message *msg, *wire = NULL;
 	enum fsm_event event = EV_NONE;
-	struct ptp_message *msg;
 	int cnt, fd = p->fda.fd[fd_index], err;
 
 	switch (fd_index) {
@@ -2714,11 +3311,11 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 		 * state transition. So, it won't be cleared anywhere else.
 		 */
 		if (p->bmca == BMCA_NOOP) {
-			port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
+			port_clr_tmo(port_timer(p, FD_SYNC_RX_TIMER));
 		}
 
 		if (p->inhibit_announce) {
-			port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
+			port_clr_tmo(port_timer(p, FD_ANNOUNCE_TIMER));
 		} else {
 			port_set_announce_tmo(p);
 		}
@@ -2774,18 +3371,30 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 			return EV_NONE;
 	}
 
-	msg = msg_allocate();
-	if (!msg)
-		return EV_FAULT_DETECTED;
-
-	msg->hwts.type = p->timestamping;
-
-	cnt = transport_recv(p->trp, fd, msg);
+	cnt = port_recv(p, fd_index, &msg);
 	if (cnt < 0) {
 		pr_err("port %hu: recv message failed", portnum(p));
-		msg_put(msg);
 		return EV_FAULT_DETECTED;
 	}
+	/*
+	 * Keep the wire image of a management message that will be
+	 * relayed, as the message itself is converted in place. Without
+	 * a copy, the clock converts the message back for relaying.
+	 */
+	if (msg_type(msg) == MANAGEMENT &&
+	    cnt >= (int) sizeof(struct management_msg) &&
+	    msg->management.boundaryHops &&
+	    clock_forwards_mgmt(p->clock, p)) {
+		wire = msg_allocate();
+		if (wire) {
+			memcpy(wire, msg, sizeof(*wire));
+			wire->refcnt = 1;
+			TAILQ_INIT(&wire->tlv_list);
+		} else {
+			pr_debug("port %hu: no copy of management message",
+				 portnum(p));
+		}
+	}
 	err = msg_post_recv(msg, cnt);
 	if (err) {
 		switch (err) {
@@ -2796,20 +3405,17 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 			pr_debug("port %hu: ignoring message", portnum(p));
 			break;
 		}
-		msg_put(msg);
-		return EV_NONE;
+		goto out;
 	}
 	port_stats_inc_rx(p, msg);
 	if (port_ignore(p, msg)) {
-		msg_put(msg);
-		return EV_NONE;
+		goto out;
 	}
 	if (msg_sots_missing(msg) &&
 	    !(p->timestamping == TS_P2P1STEP && msg_type(msg) == PDELAY_REQ)) {
 		pr_err("port %hu: received %s without timestamp",
 		       portnum(p), msg_type_string(msg_type(msg)));
-		msg_put(msg);
-		return EV_NONE;
+		goto out;
 	}
 	if (msg_sots_valid(msg)) {
 		ts_add(&msg->hwts.ts, -p->rx_timestamp_offset);
@@ -2851,11 +3457,14 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 		}
 		break;
 	case MANAGEMENT:
-		if (clock_manage(p->clock, p, msg))
+		if (clock_manage(p->clock, p, msg, wire))
 			event = EV_STATE_DECISION_EVENT;
 		break;
 	}
-
+out:
+	if (wire) {
+		msg_put(wire);
+	}
 	msg_put(msg);
 	return event;
 }
@@ -2892,6 +3501,10 @@ int port_prepare_and_send(struct port *p, struct ptp_message *msg,
 	if (msg_pre_send(msg)) {
 		return -1;
 	}
+	if (p->tx_batching && event == TRANS_GENERAL && msg_unicast(msg)) {
+		port_tx_batch_add(p, msg, event, NULL);
+		return 0;
+	}
 	if (msg_unicast(msg)) {
 		cnt = transport_sendto(p->trp, &p->fda, event, msg);
 	} else {
@@ -3103,7 +3716,7 @@ struct port *port_open(const char *phc_device,
 	struct config *cfg = clock_config(clock);
 	struct port *p = malloc(sizeof(*p));
 	enum transport_type transport;
-	int i;
+	int i, interval;
 
 	if (!p) {
 		return NULL;
@@ -3111,6 +3724,12 @@ struct port *port_open(const char *phc_device,
 
 	memset(p, 0, sizeof(*p));
 	TAILQ_INIT(&p->tc_transmitted);
+	for (i = 0; i < TC_HASH_SIZE; i++) {
+		LIST_INIT(&p->tc_hash[i]);
+	}
+	for (i = 0; i < FM_HASH_SIZE; i++) {
+		LIST_INIT(&p->fm_hash[i]);
+	}
 
 	switch (type) {
 	case CLOCK_TYPE_ORDINARY:
@@ -3166,6 +3785,7 @@ struct port *port_open(const char *phc_device,
 	p->announce_span = transport == TRANS_UDS ? 0 : ANNOUNCE_SPAN;
 	p->follow_up_info = config_get_int(cfg, p->name, "follow_up_info");
 	p->freq_est_interval = config_get_int(cfg, p->name, "freq_est_interval");
+	p->max_foreign_masters = config_get_int(cfg, p->name, "max_foreign_masters");
 	p->msg_interval_request = config_get_int(cfg, p->name, "msg_interval_request");
 	p->net_sync_monitor = config_get_int(cfg, p->name, "net_sync_monitor");
 	p->path_trace_enabled = config_get_int(cfg, p->name, "path_trace_enabled");
@@ -3256,17 +3876,55 @@ struct port *port_open(const char *phc_device,
 	}
 	p->nrate.ratio = 1.0;
 
-	port_clear_fda(p, N_POLLFD);
-	p->fault_fd = -1;
-	if (number) {
-		p->fault_fd = timerfd_create(CLOCK_MONOTONIC, 0);
-		if (p->fault_fd < 0) {
-			pr_err("timerfd_create failed: %m");
+	/*
+	 * Keyed time stamps allow two-step event messages to be
+	 * completed later on, from the main loop.
+	 */
+	switch (timestamping) {
+	case TS_SOFTWARE:
+	case TS_HARDWARE:
+	case TS_LEGACY_HW:
+		p->tx_async = sk_tx_async && transport != TRANS_UDS;
+		break;
+	case TS_ONESTEP:
+	case TS_P2P1STEP:
+		break;
+	}
+	if (p->tx_async) {
+		p->txts = calloc(N_TXTS_SLOTS, sizeof(*p->txts));
+		if (!p->txts) {
+			pr_err("port %d: failed to allocate tx timestamp slots",
+			       number);
 			goto err_tsproc;
 		}
 	}
+
+	/* Bursts of messages may be drained with one system call. */
+	p->rx_batch = config_get_int(cfg, p->name, "rx_batch_size");
+	if (p->rx_batch > 1 && transport != TRANS_UDS) {
+		p->rxq = calloc(N_RX_QUEUES, sizeof(*p->rxq));
+		p->rx_batch_stats = stats_create();
+		if (!p->rxq || !p->rx_batch_stats) {
+			pr_err("port %d: failed to allocate receive batch",
+			       number);
+			goto err_rxq;
+		}
+		/* Report at the summary interval, but at most once a second. */
+		interval = config_get_int(cfg, NULL, "summary_interval");
+		interval = interval < 0 ? 0 : interval;
+		p->rx_batch_interval = 1 << (interval < 16 ? interval : 16);
+	}
+
+	port_clear_fda(p, N_POLLFD);
+	port_attach_timers(p, NULL, NULL);
 	return p;
 
+err_rxq:
+	if (p->rx_batch_stats) {
+		stats_destroy(p->rx_batch_stats);
+	}
+	free(p->rxq);
+	free(p->txts);
 err_tsproc:
 	tsproc_destroy(p->tsproc);
 err_uc_service:
@@ -3319,6 +3977,7 @@ int port_state_update(struct port *p, enum fsm_event event, int mdiff)
 		port_show_transition(p, next, event);
 		p->state = next;
 		port_notify_event(p, NOTIFY_PORT_STATE);
+		clock_state_changed(p->clock);
 		unicast_client_state_changed(p);
 		return 1;
 	}
@@ -3326,6 +3985,18 @@ int port_state_update(struct port *p, enum fsm_event event, int mdiff)
 	return 0;
 }
 
+void port_state_snapshot(struct port *p, struct state_shm_port *sp)
+{
+	sp->portIdentity = p->portIdentity;
+	if (p->state == PS_GRAND_MASTER)
+		sp->port_state = PS_MASTER;
+	else
+		sp->port_state = p->state;
+	sp->timestamping = p->timestamping;
+	strncpy(sp->interface, interface_label(p->iface),
+		sizeof(sp->interface) - 1);
+}
+
 enum bmca_select port_bmca(struct port *p)
 {
 	return p->bmca;
@@ -29,6 +29,9 @@
 /* forward declarations */
 struct interface;
 struct clock;
+struct state_shm_port;
+struct twheel;
+struct twheel_timer;
 
 /** Opaque type. */
 struct port;
@@ -58,7 +61,9 @@ void port_close(struct port *port);
 /**
  * Computes the 'best' foreign master discovered on a port. This has
  * the side effect of updating the 'dataset' field of the returned
- * foreign master.
+ * foreign master. The result is kept until the port's list of foreign
+ * masters changes or one of their announce messages ages out, so
+ * calling this repeatedly is cheap.
  *
  * @param port A pointer previously obtained via port_open().
  * @return A pointer to the port's best foreign master, or NULL.
@@ -85,6 +90,27 @@ void port_dispatch(struct port *p, enum fsm_event event, int mdiff);
  */
 enum fsm_event port_event(struct port *port, int fd_index);
 
+/**
+ * Collects the transmit time stamps waiting on the error queue of a
+ * port's event socket and completes the messages they belong to.
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @return EV_NONE when at least one time stamp was collected, or
+ *         EV_FAULT_DETECTED when the error was not caused by a pending
+ *         time stamp.
+ */
+enum fsm_event port_txts_event(struct port *port);
+
+/**
+ * Gives up on the transmitted messages whose time stamps did not
+ * arrive within tx_timestamp_timeout. Call this when the time stamp
+ * timer, the one attached with the index N_POLLFD + 1, expires.
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @return EV_FAULT_DETECTED when a time stamp was lost, or EV_NONE.
+ */
+enum fsm_event port_txts_timeout(struct port *port);
+
 /**
  * Forward a message on a given port.
  * @param port    A pointer previously obtained via port_open().
@@ -220,6 +246,13 @@ struct ptp_message *port_signaling_construct(struct port *p,
  */
 enum port_state port_state(struct port *port);
 
+/**
+ * Fills in the entry of a port in a snapshot of the clock's state.
+ * @param p   A port instance.
+ * @param sp  The entry to fill in.
+ */
+void port_state_snapshot(struct port *p, struct state_shm_port *sp);
+
 /**
  * Update a port's current state based on a given event.
  * @param p        A pointer previously obtained via port_open().
@@ -239,58 +272,70 @@ int port_state_update(struct port *p, enum fsm_event event, int mdiff);
 struct fdarray *port_fda(struct port *port);
 
 /**
- * Return file descriptor of the port.
+ * Reports whether messages from an earlier batched read of one of the
+ * port's descriptors still await handling via port_event().
+ * @param port      A port instance.
+ * @param fd_index  The index of the descriptor.
+ * @return          The number of messages waiting.
+ */
+int port_rx_pending(struct port *port, int fd_index);
+
+/**
+ * Attach the timers of the port to a timing wheel. Each timer carries
+ * the index of the descriptor it replaces, the fault timer carries
+ * the index N_POLLFD, and the transmit time stamp timer N_POLLFD + 1.
  * @param port	A port instance.
- * @return	File descriptor or -1 if not applicable.
+ * @param wheel	The timing wheel that drives the port's timers.
+ * @param owner	Opaque pointer handed back along with expired timers.
  */
-int port_fault_fd(struct port *port);
+void port_attach_timers(struct port *port, struct twheel *wheel, void *owner);
 
 /**
- * Utility function for setting or resetting a file descriptor timer.
+ * Utility function for setting or resetting a port timer.
  *
- * This function sets the timer 'fd' to the value M(2^N), where M is
+ * This function sets the timer 't' to the value M(2^N), where M is
  * the value of the 'scale' parameter and N in the value of the
  * 'log_seconds' parameter.
  *
  * Passing both 'scale' and 'log_seconds' as zero disables the timer.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param t A timer attached to a timing wheel.
  * @param scale The multiplicative factor for the timer.
  * @param log_seconds The exponential factor for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_log(int fd, unsigned int scale, int log_seconds);
+int set_tmo_log(struct twheel_timer *t, unsigned int scale, int log_seconds);
 
 /**
- * Utility function for setting a file descriptor timer.
+ * Utility function for setting a port timer.
  *
- * This function sets the timer 'fd' to a random value between M * 2^N and
+ * This function sets the timer 't' to a random value between M * 2^N and
  * (M + S) * 2^N, where M is the value of the 'min' parameter, S is the value
  * of the 'span' parameter, and N in the value of the 'log_seconds' parameter.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param t A timer attached to a timing wheel.
  * @param min The minimum value for the timer.
  * @param span The span value for the timer. Must be a positive value.
  * @param log_seconds The exponential factor for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_random(int fd, int min, int span, int log_seconds);
+int set_tmo_random(struct twheel_timer *t, int min, int span, int log_seconds);
 
 /**
- * Utility function for setting or resetting a file descriptor timer.
+ * Utility function for setting or resetting a port timer.
  *
- * This function sets the timer 'fd' to the value of the 'seconds' parameter.
+ * This function sets the timer 't' to the value of the 'seconds' parameter.
  *
  * Passing 'seconds' as zero disables the timer.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param t A timer attached to a timing wheel.
  * @param seconds The timeout value for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_lin(int fd, int seconds);
+int set_tmo_lin(struct twheel_timer *t, int seconds);
 
 /**
- * Sets port's fault file descriptor timer.
+ * Sets port's fault timer.
  * Passing both 'scale' and 'log_seconds' as zero disables the timer.
  *
  * @param fd		A port instance.
@@ -302,7 +347,7 @@ int port_set_fault_timer_log(struct port *port,
 			     unsigned int scale, int log_seconds);
 
 /**
- * Sets port's fault file descriptor timer.
+ * Sets port's fault timer.
  * Passing 'seconds' as zero disables the timer.
  *
  * @param fd		A port instance.
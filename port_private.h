@@ -26,7 +26,9 @@
 #include "fsm.h"
 #include "monitor.h"
 #include "msg.h"
+#include "sk.h"
 #include "tmv.h"
+#include "twheel.h"
 
 #define NSEC2SEC 1000000000LL
 
@@ -54,11 +56,58 @@ struct nrate_estimator {
 
 struct tc_txd {
 	TAILQ_ENTRY(tc_txd) list;
+	LIST_ENTRY(tc_txd) hash;
 	struct ptp_message *msg;
 	tmv_t residence;
 	int ingress_port;
 };
 
+/* Buckets of the index of foreign masters by sender port identity. */
+#define FM_HASH_SIZE 64
+
+/* Buckets of the index of transmitted TC messages awaiting their mates. */
+#define TC_HASH_SIZE 256
+
+#define N_TXTS_SLOTS 1024
+
+/*
+ * An event message whose transmit time stamp has yet to arrive. The
+ * slot is indexed by the SOF_TIMESTAMPING_OPT_ID key of the packet.
+ */
+struct txts_slot {
+	struct ptp_message *msg;
+	struct ptp_message *req;	/* the request being answered, if any */
+	struct port *ingress;		/* the port a forwarded message came in on */
+	int (*complete)(struct port *p, struct txts_slot *s, tmv_t ts);
+	uint64_t expires;		/* CLOCK_MONOTONIC deadline in ns */
+	uint32_t key;
+};
+
+/* Only the event and general descriptors are read in batches. */
+#define N_RX_QUEUES (FD_GENERAL + 1)
+
+/*
+ * The messages read from one descriptor by a single system call that
+ * have yet to be handed to the port.
+ */
+struct rx_batch {
+	struct ptp_message *msg[SK_RX_BATCH_MAX];
+	int cnt[SK_RX_BATCH_MAX];
+	int head;
+	int len;
+};
+
+/*
+ * Unicast messages held back while the port batches its transmissions,
+ * so that they leave together in a single system call.
+ */
+struct tx_batch {
+	struct ptp_message *msg[SK_TX_BATCH_MAX];
+	int (*complete[SK_TX_BATCH_MAX])(struct port *p, struct txts_slot *s,
+					 tmv_t ts);
+	int len;
+};
+
 struct port {
 	LIST_ENTRY(port) list;
 	const char *name;
@@ -67,7 +116,9 @@ struct port {
 	struct transport *trp;
 	enum timestamp_type timestamping;
 	struct fdarray fda;
-	int fault_fd;
+	struct twheel_timer timer[N_TIMER_FDS];
+	struct twheel_timer fault_timer;
+	struct twheel_timer txts_timer;
 	int phc_index;
 
 	void (*dispatch)(struct port *p, enum fsm_event event, int mdiff);
@@ -75,9 +126,13 @@ struct port {
 
 	int jbod;
 	struct foreign_clock *best;
+	int best_valid;
+	int64_t best_expiry;
 	enum syfu_state syfu;
 	struct ptp_message *last_syncfup;
 	TAILQ_HEAD(delay_req, ptp_message) delay_req;
+	/* A Delay_Resp which overtook the time stamp of its request */
+	struct ptp_message *delay_resp_early;
 	struct ptp_message *peer_delay_req;
 	struct ptp_message *peer_delay_resp;
 	struct ptp_message *peer_delay_fup;
@@ -144,8 +199,30 @@ struct port {
 	struct PortStats    stats;
 	/* foreignMasterDS */
 	LIST_HEAD(fm, foreign_clock) foreign_masters;
-	/* TC book keeping */
+	LIST_HEAD(fmh, foreign_clock) fm_hash[FM_HASH_SIZE];
+	int max_foreign_masters;
+	int n_foreign_masters;
+	/* TC book keeping, in order of transmission */
 	TAILQ_HEAD(tct, tc_txd) tc_transmitted;
+	LIST_HEAD(tch, tc_txd) tc_hash[TC_HASH_SIZE];
+	/* asynchronous transmit time stamps */
+	int tx_async;
+	uint32_t txts_key;
+	uint32_t txts_oldest;	/* no slot with an older key is in flight */
+	uint64_t txts_expires;	/* deadline the txts_timer is armed for */
+	struct txts_slot *txts;
+	/* batched receive */
+	int rx_batch;
+	struct rx_batch *rxq;
+	struct stats *rx_batch_stats;
+	int rx_batch_interval;
+	time_t rx_batch_report;
+	/* batched transmit */
+	int tx_batching;
+	/* Set when a full batch failed before port_tx_batch_end() */
+	int tx_batch_err;
+	struct tx_batch txb_general;
+	struct tx_batch txb_event;
 	/* unicast client mode */
 	struct unicast_master_table *unicast_master_table;
 	/* unicast service mode */
@@ -156,6 +233,7 @@ struct port {
 };
 
 #define portnum(p) (p->portIdentity.portNumber)
+#define port_timer(p, index) (&(p)->timer[(index) - FD_FIRST_TIMER])
 
 void e2e_dispatch(struct port *p, enum fsm_event event, int mdiff);
 enum fsm_event e2e_event(struct port *p, int fd_index);
@@ -168,13 +246,17 @@ void delay_req_prune(struct port *p);
 void fc_clear(struct foreign_clock *fc);
 void flush_delay_req(struct port *p);
 void flush_last_sync(struct port *p);
+struct ptp_message *port_announce_create(struct port *p, struct address *dst);
 int port_capable(struct port *p);
-int port_clr_tmo(int fd);
+int port_clr_tmo(struct twheel_timer *t);
 int port_delay_request(struct port *p);
 void port_disable(struct port *p);
+struct ptp_message *port_followup_create(struct port *p,
+					 struct ptp_message *sync);
 int port_initialize(struct port *p);
 int port_is_enabled(struct port *p);
 void port_link_status(void *ctx, int index, int linkup);
+int port_recv(struct port *p, int fd_index, struct ptp_message **msg);
 int port_set_announce_tmo(struct port *p);
 int port_set_delay_tmo(struct port *p);
 int port_set_qualification_tmo(struct port *p);
@@ -183,12 +265,20 @@ void port_show_transition(struct port *p, enum port_state next,
 struct ptp_message *port_signaling_uc_construct(struct port *p,
 						struct address *address,
 						struct PortIdentity *tpid);
+struct ptp_message *port_sync_create(struct port *p, struct address *dst);
+int port_sync_incapable(struct port *p);
 int port_tx_announce(struct port *p, struct address *dst);
+void port_tx_batch_begin(struct port *p);
+int port_tx_batch_end(struct port *p);
 int port_tx_interval_request(struct port *p,
 			     Integer8 announceInterval,
 			     Integer8 timeSyncInterval,
 			     Integer8 linkDelayInterval);
 int port_tx_sync(struct port *p, struct address *dst);
+struct txts_slot *port_txts_track(struct port *p, struct ptp_message *msg,
+				  int (*complete)(struct port *p,
+						  struct txts_slot *s,
+						  tmv_t ts));
 int process_announce(struct port *p, struct ptp_message *m);
 void process_delay_resp(struct port *p, struct ptp_message *m);
 void process_follow_up(struct port *p, struct ptp_message *m);
@@ -30,9 +30,18 @@ struct pqueue {
 	int len;
 	int max;
 	int (*cmp)(void *a, void *b);
+	int *(*pos)(void *d);
 	void **data;
 };
 
+static void pq_set(struct pqueue *q, int index, void *d)
+{
+	q->data[index] = d;
+	if (q->pos) {
+		*q->pos(d) = index;
+	}
+}
+
 static int pq_greater(struct pqueue *q, int a, int b)
 {
 	return q->cmp(q->data[a], q->data[b]) > 0 ? 1 : 0;
@@ -55,8 +64,8 @@ static void heapify(struct pqueue *q, int index)
 
 	if (i_max != index) {
 		void *tmp = q->data[index];
-		q->data[index] = q->data[i_max];
-		q->data[i_max] = tmp;
+		pq_set(q, index, q->data[i_max]);
+		pq_set(q, i_max, tmp);
 		heapify(q, i_max);
 	}
 }
@@ -64,7 +73,8 @@ static void heapify(struct pqueue *q, int index)
 /* public methods */
 
 struct pqueue *pqueue_create(int max_length,
-			     int (*compare)(void *a, void *b))
+			     int (*compare)(void *a, void *b),
+			     int *(*position)(void *d))
 {
 	struct pqueue *q = calloc(1, sizeof(*q));
 	if (!q) {
@@ -73,6 +83,7 @@ struct pqueue *pqueue_create(int max_length,
 	q->len = 0;
 	q->max = max_length;
 	q->cmp = compare;
+	q->pos = position;
 	q->data = calloc(max_length, sizeof(void *));
 	if (!q->data) {
 		free(q);
@@ -95,9 +106,11 @@ void *pqueue_extract(struct pqueue *q)
 		return NULL;
 	}
 	data = q->data[0];
-	q->data[0] = q->data[q->len - 1];
 	q->len--;
-	heapify(q, 0);
+	if (q->len) {
+		pq_set(q, 0, q->data[q->len]);
+		heapify(q, 0);
+	}
 
 	return data;
 }
@@ -119,10 +132,46 @@ int pqueue_insert(struct pqueue *q, void *d)
 	q->len++;
 
 	while (index && (q->cmp(q->data[parent(index)], d) < 0)) {
-		q->data[index] = q->data[parent(index)];
+		pq_set(q, index, q->data[parent(index)]);
 		index = parent(index);
 	}
-	q->data[index] = d;
+	pq_set(q, index, d);
+
+	return 0;
+}
+
+int pqueue_remove(struct pqueue *q, void *d)
+{
+	int index;
+	void *last;
+
+	if (q->pos) {
+		index = *q->pos(d);
+		if (index < 0 || index >= q->len || q->data[index] != d) {
+			return -ENOENT;
+		}
+	} else {
+		for (index = 0; index < q->len; index++) {
+			if (q->data[index] == d) {
+				break;
+			}
+		}
+		if (index == q->len) {
+			return -ENOENT;
+		}
+	}
+	q->len--;
+	if (index == q->len) {
+		return 0;
+	}
+	last = q->data[q->len];
+
+	while (index && (q->cmp(q->data[parent(index)], last) < 0)) {
+		pq_set(q, index, q->data[parent(index)]);
+		index = parent(index);
+	}
+	pq_set(q, index, last);
+	heapify(q, index);
 
 	return 0;
 }
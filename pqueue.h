@@ -22,8 +22,18 @@
 
 struct pqueue;
 
+/**
+ * Creates a priority queue.
+ * @param max_length  Initial capacity, grown on demand.
+ * @param compare     Orders two elements, largest first.
+ * @param position    Optional, returns the field in which an element
+ *                    keeps its heap index, making pqueue_remove()
+ *                    logarithmic. Pass NULL to search linearly.
+ * @return            A new queue on success, NULL otherwise.
+ */
 struct pqueue *pqueue_create(int max_length,
-			     int (*compare)(void *a, void *b));
+			     int (*compare)(void *a, void *b),
+			     int *(*position)(void *d));
 
 void pqueue_destroy(struct pqueue *q);
 
@@ -31,6 +41,8 @@ void *pqueue_extract(struct pqueue *q);
 
 int pqueue_insert(struct pqueue *q, void *d);
 
+int pqueue_remove(struct pqueue *q, void *d);
+
 int pqueue_length(struct pqueue *q);
 
 void *pqueue_peek(struct pqueue *q);
@@ -25,6 +25,7 @@
 
 #include "clock.h"
 #include "config.h"
+#include "msg.h"
 #include "ntpshm.h"
 #include "pi.h"
 #include "print.h"
@@ -72,7 +73,7 @@ int main(int argc, char *argv[])
 {
 	char *config = NULL, *req_phc = NULL, *progname;
 	enum clock_type type = CLOCK_TYPE_ORDINARY;
-	int c, err = -1, index, print_level;
+	int c, err = -1, index, pool_flags, print_level;
 	struct clock *clock = NULL;
 	struct option *opts;
 	struct config *cfg;
@@ -190,8 +191,23 @@ int main(int argc, char *argv[])
 	assume_two_step = config_get_int(cfg, NULL, "assume_two_step");
 	sk_check_fupsync = config_get_int(cfg, NULL, "check_fup_sync");
 	sk_tx_timeout = config_get_int(cfg, NULL, "tx_timestamp_timeout");
+	sk_tx_async = config_get_int(cfg, NULL, "tx_timestamp_async");
 	sk_hwts_filter_mode = config_get_int(cfg, NULL, "hwts_filter");
 
+	pool_flags = 0;
+	if (config_get_int(cfg, NULL, "message_pool_hugepages")) {
+		pool_flags |= SLAB_HUGEPAGES;
+	}
+	if (config_get_int(cfg, NULL, "message_pool_mlock")) {
+		pool_flags |= SLAB_MLOCK;
+	}
+	if (msg_pool_reserve(config_get_int(cfg, NULL, "message_pool_size"),
+			     pool_flags) ||
+	    tlv_extra_reserve(config_get_int(cfg, NULL, "tlv_pool_size"),
+			      pool_flags)) {
+		goto out;
+	}
+
 	if (config_get_int(cfg, NULL, "clock_servo") == CLOCK_SERVO_NTPSHM) {
 		config_set_int(cfg, "kernel_leap", 0);
 		config_set_int(cfg, "sanity_freq_limit", 0);
@@ -0,0 +1,1334 @@
+/**
+ * @file ptpbench.c
+ * @brief Replays time stamps through the servos and the delay filters.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
+ */
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "config.h"
+#include "fd.h"
+#include "filter.h"
+#include "linreg_ref.h"
+#include "msg.h"
+#include "port.h"
+#include "print.h"
+#include "servo_private.h"
+#include "stats.h"
+#include "sysoff.h"
+#include "tlv.h"
+#include "tsproc.h"
+#include "twheel.h"
+#include "unicast_service.h"
+#include "util.h"
+#include "version.h"
+
+#define BENCH_MAX_PPB		900000000
+#define EPOLL_PORT_FDS		(N_POLLFD + 2)
+#define EPOLL_ROUNDS		20000
+#define FILTER_CHECK_SAMPLES	20000
+#define GRANT_ROUNDS		20000
+#define FILTER_TIME_SAMPLES	200000
+#define LINREG_MAX_DIFF		0.001
+#define LINREG_TIME_SAMPLES	1000000
+#define RANDOM_VALUES		4096
+#define SYNTH_EPOCH		(1700000000 * NS_PER_SEC)
+#define WHEEL_ROUNDS		4
+
+/*
+ * One Sync message: when the master sent it, when the free running
+ * slave clock received it, and the path delay measured at the time.
+ */
+struct sample {
+	int64_t origin;
+	int64_t ingress;
+	int64_t delay;
+	int64_t offset;	/* true offset of the slave clock, if known */
+};
+
+struct trace {
+	struct sample *sample;
+	int len;
+	int max;
+	int has_offset;
+};
+
+/* The slave clock and network from which a trace is synthesized. */
+struct synth {
+	int samples;
+	double offset;	/* initial offset in ns */
+	double freq;	/* initial frequency offset in ppb */
+	double wander;	/* random walk of the frequency in ppb per sqrt(s) */
+	double delay;	/* path delay in ns */
+	double jitter;	/* standard deviation of the time stamps in ns */
+	double queue;	/* mean queuing delay in ns */
+	long seed;
+};
+
+struct bench {
+	struct config *cfg;
+	struct synth synth;
+	struct trace trace;
+	char *trace_file;
+	double interval;
+};
+
+struct replay_result {
+	unsigned int samples;
+	double lock_time;	/* into the trace in seconds, or -1 */
+	struct stats_result offset;
+	struct stats_result error;
+	struct stats_result freq;
+	int have_error;
+	double ns;		/* per sample */
+};
+
+typedef int (*mode_func_t)(struct bench *b);
+
+struct mode {
+	const char *name;
+	mode_func_t function;
+};
+
+static const char *servo_name[] = {
+	[CLOCK_SERVO_PI] = "pi",
+	[CLOCK_SERVO_LINREG] = "linreg",
+	[CLOCK_SERVO_NTPSHM] = "ntpshm",
+	[CLOCK_SERVO_NULLF] = "nullf",
+	[CLOCK_SERVO_KALMAN] = "kalman",
+};
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double gauss(void)
+{
+	return sqrt(-2.0 * log(1.0 - drand48())) * cos(2.0 * M_PI * drand48());
+}
+
+static double expo(double mean)
+{
+	return -mean * log(1.0 - drand48());
+}
+
+static int trace_append(struct trace *t, struct sample *s)
+{
+	struct sample *buf;
+
+	if (t->len == t->max) {
+		buf = realloc(t->sample, 2 * (t->max + 1) * sizeof(*buf));
+		if (!buf) {
+			fprintf(stderr, "out of memory\n");
+			return -1;
+		}
+		t->sample = buf;
+		t->max = 2 * (t->max + 1);
+	}
+	t->sample[t->len++] = *s;
+	return 0;
+}
+
+static int trace_read(struct trace *t, const char *name)
+{
+	char line[256];
+	struct sample s;
+	int lineno = 0;
+	FILE *fp;
+
+	fp = fopen(name, "r");
+	if (!fp) {
+		fprintf(stderr, "failed to open %s: %m\n", name);
+		return -1;
+	}
+	t->has_offset = 1;
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+			continue;
+		}
+		switch (sscanf(line, "%" SCNd64 " %" SCNd64 " %" SCNd64
+			       " %" SCNd64, &s.origin, &s.ingress,
+			       &s.delay, &s.offset)) {
+		case 3:
+			t->has_offset = 0;
+			break;
+		case 4:
+			break;
+		default:
+			fprintf(stderr, "%s:%d: bad sample\n", name, lineno);
+			fclose(fp);
+			return -1;
+		}
+		if (trace_append(t, &s)) {
+			fclose(fp);
+			return -1;
+		}
+	}
+	fclose(fp);
+	if (!t->len) {
+		fprintf(stderr, "%s holds no samples\n", name);
+		return -1;
+	}
+	return 0;
+}
+
+static int trace_synthesize(struct trace *t, struct synth *p, double interval)
+{
+	double back, forward, freq = p->freq, offset = p->offset;
+	int64_t origin = SYNTH_EPOCH, step = interval * NS_PER_SEC;
+	struct sample s;
+	int i;
+
+	srand48(p->seed);
+	t->has_offset = 1;
+	for (i = 0; i < p->samples; i++) {
+		forward = p->delay + expo(p->queue) + p->jitter * gauss();
+		back = p->delay + expo(p->queue) + p->jitter * gauss();
+		s.origin = origin;
+		s.ingress = origin + llround(forward + offset);
+		s.delay = llround((forward + back) / 2.0);
+		s.offset = llround(offset);
+		if (trace_append(t, &s)) {
+			return -1;
+		}
+		offset += freq * 1e-9 * step;
+		freq += p->wander * sqrt(interval) * gauss();
+		origin += step;
+	}
+	return 0;
+}
+
+static void trace_print(struct trace *t)
+{
+	struct sample *s;
+	int i;
+
+	printf("# origin ingress delay%s\n", t->has_offset ? " offset" : "");
+	for (i = 0; i < t->len; i++) {
+		s = &t->sample[i];
+		printf("%" PRId64 " %" PRId64 " %" PRId64, s->origin,
+		       s->ingress, s->delay);
+		if (t->has_offset) {
+			printf(" %" PRId64, s->offset);
+		}
+		printf("\n");
+	}
+}
+
+static struct servo *bench_servo(struct bench *b, enum servo_type type)
+{
+	struct servo *servo;
+	int sw_ts;
+
+	sw_ts = config_get_int(b->cfg, NULL, "time_stamping") == TS_SOFTWARE;
+	servo = servo_create(b->cfg, type, 0, BENCH_MAX_PPB, sw_ts);
+	if (!servo) {
+		fprintf(stderr, "failed to create the %s servo\n",
+			servo_name[type]);
+		return NULL;
+	}
+	servo_sync_interval(servo, b->interval);
+	return servo;
+}
+
+static struct tsproc *bench_tsproc(struct bench *b)
+{
+	return tsproc_create(config_get_int(b->cfg, NULL, "tsproc_mode"),
+			     config_get_int(b->cfg, NULL, "delay_filter"),
+			     config_get_int(b->cfg, NULL, "delay_filter_length"));
+}
+
+/*
+ * Feeds the trace to the time stamp processor and the servo, like
+ * clock_synchronize() does. The slave clock of the trace was free
+ * running, so the adjustments of the servo are applied to its time
+ * stamps on the fly.
+ */
+static int replay(struct bench *b, struct servo *servo,
+		  struct replay_result *r)
+{
+	struct stats *offset_stats, *error_stats, *freq_stats;
+	double adj, corr = 0.0, freq = 0.0, start, weight;
+	enum servo_state state;
+	struct trace *t = &b->trace;
+	int64_t ingress, last = 0, offset;
+	struct tsproc *tsp;
+	struct sample *s;
+	tmv_t tmv;
+	int i;
+
+	memset(r, 0, sizeof(*r));
+	r->lock_time = -1.0;
+
+	tsp = bench_tsproc(b);
+	offset_stats = stats_create();
+	error_stats = stats_create();
+	freq_stats = stats_create();
+	if (!tsp || !offset_stats || !error_stats || !freq_stats) {
+		fprintf(stderr, "out of memory\n");
+		return -1;
+	}
+
+	start = now_ns();
+	for (i = 0; i < t->len; i++) {
+		s = &t->sample[i];
+		if (i) {
+			corr += freq * (s->ingress - last);
+		}
+		last = s->ingress;
+		ingress = s->ingress + llround(corr);
+
+		/*
+		 * A Delay_Req sent at the moment of reception, answered
+		 * so that the raw path delay comes out as measured.
+		 */
+		tsproc_down_ts(tsp, nanoseconds_to_tmv(s->origin),
+			       nanoseconds_to_tmv(ingress));
+		tsproc_up_ts(tsp, nanoseconds_to_tmv(ingress),
+			     nanoseconds_to_tmv(s->origin + 2 * s->delay));
+		tsproc_update_delay(tsp, NULL);
+		if (tsproc_update_offset(tsp, &tmv, &weight)) {
+			continue;
+		}
+		offset = tmv_to_nanoseconds(tmv);
+		adj = servo_sample(servo, offset, ingress, weight, &state);
+		tsproc_set_clock_rate_ratio(tsp, servo_rate_ratio(servo));
+		r->samples++;
+
+		switch (state) {
+		case SERVO_UNLOCKED:
+			continue;
+		case SERVO_JUMP:
+			freq = -adj * 1e-9;
+			corr -= offset;
+			tsproc_reset(tsp, 0);
+			continue;
+		case SERVO_LOCKED:
+		case SERVO_LOCKED_STABLE:
+			freq = -adj * 1e-9;
+			break;
+		}
+		if (r->lock_time < 0.0) {
+			r->lock_time = (s->origin - t->sample[0].origin) / 1e9;
+		}
+		stats_add_value(offset_stats, offset);
+		stats_add_value(freq_stats, -adj);
+		if (t->has_offset) {
+			stats_add_value(error_stats, s->offset +
+					(ingress - s->ingress));
+		}
+	}
+	r->ns = (now_ns() - start) / t->len;
+
+	stats_get_result(offset_stats, &r->offset);
+	stats_get_result(freq_stats, &r->freq);
+	r->have_error = !stats_get_result(error_stats, &r->error);
+
+	stats_destroy(freq_stats);
+	stats_destroy(error_stats);
+	stats_destroy(offset_stats);
+	tsproc_destroy(tsp);
+	return 0;
+}
+
+static void replay_header(void)
+{
+	printf("%-8s %8s %9s %10s %10s %10s %10s %10s %9s\n", "servo",
+	       "samples", "lock [s]", "rms [ns]", "max [ns]", "wander",
+	       "err rms", "err max", "ns/sample");
+}
+
+static void replay_print(const char *name, struct replay_result *r)
+{
+	printf("%-8s %8u ", name, r->samples);
+	if (r->lock_time < 0.0) {
+		printf("%9s %10s %10s %10s ", "-", "-", "-", "-");
+	} else {
+		printf("%9.1f %10.1f %10.0f %10.3f ", r->lock_time,
+		       r->offset.rms, r->offset.max_abs + 0.0, r->freq.stddev);
+	}
+	if (r->lock_time < 0.0 || !r->have_error) {
+		printf("%10s %10s ", "-", "-");
+	} else {
+		printf("%10.1f %10.0f ", r->error.rms, r->error.max_abs + 0.0);
+	}
+	printf("%9.1f\n", r->ns);
+}
+
+static int replay_servo(struct bench *b, enum servo_type type)
+{
+	struct replay_result r;
+	struct servo *servo;
+	int err;
+
+	servo = bench_servo(b, type);
+	if (!servo) {
+		return -1;
+	}
+	err = replay(b, servo, &r);
+	if (!err) {
+		replay_print(servo_name[type], &r);
+	}
+	servo_destroy(servo);
+	return err;
+}
+
+static int do_replay(struct bench *b)
+{
+	replay_header();
+	return replay_servo(b, config_get_int(b->cfg, NULL, "clock_servo"));
+}
+
+static int do_servos(struct bench *b)
+{
+	static const enum servo_type types[] = {
+		CLOCK_SERVO_PI, CLOCK_SERVO_LINREG, CLOCK_SERVO_KALMAN,
+	};
+	unsigned int i;
+
+	replay_header();
+	for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		if (replay_servo(b, types[i])) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * The window of the last 'len' samples, kept sorted by insertion, as
+ * a plain reference for the filters.
+ */
+struct window {
+	int64_t *ring;
+	int64_t *sorted;
+	int len;
+	int cnt;
+	int head;
+};
+
+static void window_reset(struct window *w)
+{
+	w->cnt = 0;
+	w->head = 0;
+}
+
+static void window_add(struct window *w, int64_t x)
+{
+	int i;
+
+	if (w->cnt == w->len) {
+		for (i = 0; w->sorted[i] != w->ring[w->head]; i++)
+			;
+		memmove(&w->sorted[i], &w->sorted[i + 1],
+			(w->cnt - i - 1) * sizeof(x));
+		w->cnt--;
+	}
+	for (i = w->cnt; i > 0 && w->sorted[i - 1] > x; i--) {
+		w->sorted[i] = w->sorted[i - 1];
+	}
+	w->sorted[i] = x;
+	w->cnt++;
+	w->ring[w->head] = x;
+	w->head = (w->head + 1) % w->len;
+}
+
+static tmv_t window_lower_mean(struct window *w)
+{
+	tmv_t sum = tmv_zero();
+	int i, n = (w->cnt + 3) / 4;
+
+	for (i = 0; i < n; i++) {
+		sum = tmv_add(sum, nanoseconds_to_tmv(w->sorted[i]));
+	}
+	return tmv_div(sum, n);
+}
+
+/*
+ * Checks heap_median against moving_median, and moving_minimum and
+ * lower_mean against the sorted window, including after a reset.
+ * Returns the number of mismatches.
+ */
+static long filter_check(int len)
+{
+	struct filter *hm, *lm, *mm, *mn;
+	struct window w;
+	long bad = 0;
+	tmv_t x;
+	int i, n;
+
+	hm = filter_create(FILTER_HEAP_MEDIAN, len);
+	lm = filter_create(FILTER_LOWER_MEAN, len);
+	mm = filter_create(FILTER_MOVING_MEDIAN, len);
+	mn = filter_create(FILTER_MOVING_MINIMUM, len);
+	w.ring = calloc(len, sizeof(*w.ring));
+	w.sorted = calloc(len, sizeof(*w.sorted));
+	w.len = len;
+	window_reset(&w);
+	if (!hm || !lm || !mm || !mn || !w.ring || !w.sorted) {
+		fprintf(stderr, "out of memory\n");
+		return -1;
+	}
+
+	n = FILTER_CHECK_SAMPLES + 3 * len;
+	for (i = 0; i < n; i++) {
+		if (i == n / 2) {
+			filter_reset(hm);
+			filter_reset(lm);
+			filter_reset(mm);
+			filter_reset(mn);
+			window_reset(&w);
+		}
+		/* Plenty of ties, as well as a wide spread. */
+		x = nanoseconds_to_tmv(i % 3 ? lrand48() % 1000000 :
+				       lrand48() % 7);
+		window_add(&w, tmv_to_nanoseconds(x));
+		if (tmv_cmp(filter_sample(hm, x), filter_sample(mm, x))) {
+			bad++;
+		}
+		if (tmv_to_nanoseconds(filter_sample(mn, x)) != w.sorted[0]) {
+			bad++;
+		}
+		if (tmv_cmp(filter_sample(lm, x), window_lower_mean(&w))) {
+			bad++;
+		}
+	}
+
+	free(w.sorted);
+	free(w.ring);
+	filter_destroy(mn);
+	filter_destroy(mm);
+	filter_destroy(lm);
+	filter_destroy(hm);
+	return bad;
+}
+
+static double filter_time(enum filter_type type, int len, tmv_t *values)
+{
+	struct filter *f;
+	double start;
+	int i;
+
+	f = filter_create(type, len);
+	if (!f) {
+		return 0.0;
+	}
+	start = now_ns();
+	for (i = 0; i < FILTER_TIME_SAMPLES; i++) {
+		filter_sample(f, values[i % RANDOM_VALUES]);
+	}
+	start = now_ns() - start;
+	filter_destroy(f);
+	return start / FILTER_TIME_SAMPLES;
+}
+
+static int do_filter(struct bench *b)
+{
+	static const int lengths[] = { 1, 2, 3, 4, 5, 10, 17, 64, 512, 4096 };
+	static const struct {
+		const char *name;
+		enum filter_type type;
+	} types[] = {
+		{ "moving_average", FILTER_MOVING_AVERAGE },
+		{ "moving_median", FILTER_MOVING_MEDIAN },
+		{ "heap_median", FILTER_HEAP_MEDIAN },
+		{ "moving_minimum", FILTER_MOVING_MINIMUM },
+		{ "lower_mean", FILTER_LOWER_MEAN },
+	};
+	tmv_t values[RANDOM_VALUES];
+	unsigned int i, j;
+	long bad, total = 0;
+
+	srand48(b->synth.seed);
+	for (i = 0; i < RANDOM_VALUES; i++) {
+		values[i] = nanoseconds_to_tmv(lrand48() % 1000000);
+	}
+
+	printf("%6s %10s", "length", "mismatches");
+	for (j = 0; j < sizeof(types) / sizeof(types[0]); j++) {
+		printf(" %14s", types[j].name);
+	}
+	printf("\n");
+
+	for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+		bad = filter_check(lengths[i]);
+		if (bad < 0) {
+			return -1;
+		}
+		total += bad;
+		printf("%6d %10ld", lengths[i], bad);
+		for (j = 0; j < sizeof(types) / sizeof(types[0]); j++) {
+			printf(" %11.1f ns",
+			       filter_time(types[j].type, lengths[i], values));
+		}
+		printf("\n");
+	}
+	return total ? -1 : 0;
+}
+
+static double linreg_time(struct bench *b, struct servo *servo)
+{
+	uint64_t ts = SYNTH_EPOCH, step = b->interval * NS_PER_SEC;
+	enum servo_state state;
+	double start;
+	int i;
+
+	start = now_ns();
+	for (i = 0; i < LINREG_TIME_SAMPLES; i++) {
+		servo_sample(servo, (i * 7919) % 1000 - 500, ts, 1.0, &state);
+		ts += step;
+	}
+	return (now_ns() - start) / LINREG_TIME_SAMPLES;
+}
+
+/*
+ * Both servos compute the time of a sample from their own frequency,
+ * truncated to whole nanoseconds, so once their frequencies differ by
+ * rounding their points can differ by a nanosecond and, with that,
+ * their choice of the window size. With the frequency held at zero the
+ * points are the same, and so the regression has to be.
+ */
+static int linreg_check(struct bench *b, struct servo *servo,
+			struct servo *ref, double *max_diff)
+{
+	enum servo_state state, ref_state;
+	struct trace *t = &b->trace;
+	struct sample *s;
+	double diff;
+	int i, mismatches = 0;
+
+	servo->max_frequency = 0.0;
+	ref->max_frequency = 0.0;
+	servo->step_threshold = 0.0;
+	ref->step_threshold = 0.0;
+	servo->first_step_threshold = 0.0;
+	ref->first_step_threshold = 0.0;
+	*max_diff = 0.0;
+
+	for (i = 0; i < t->len; i++) {
+		s = &t->sample[i];
+		servo_sample(servo, s->ingress - s->origin - s->delay,
+			     s->ingress, 1.0, &state);
+		servo_sample(ref, s->ingress - s->origin - s->delay,
+			     s->ingress, 1.0, &ref_state);
+		diff = 1e9 * fabs(servo_rate_ratio(servo) -
+				  servo_rate_ratio(ref));
+		if (state != ref_state || diff > LINREG_MAX_DIFF) {
+			mismatches++;
+		}
+		if (diff > *max_diff) {
+			*max_diff = diff;
+		}
+	}
+	return mismatches;
+}
+
+static struct servo *linreg_ref(struct bench *b, struct servo *servo)
+{
+	struct servo *ref;
+
+	ref = linreg_ref_servo_create(0);
+	if (!ref) {
+		return NULL;
+	}
+	ref->max_frequency = servo->max_frequency;
+	ref->step_threshold = servo->step_threshold;
+	ref->first_step_threshold = servo->first_step_threshold;
+	ref->first_update = servo->first_update;
+	ref->offset_threshold = servo->offset_threshold;
+	ref->num_offset_values = servo->num_offset_values;
+	ref->curr_offset_values = servo->curr_offset_values;
+	servo_sync_interval(ref, b->interval);
+	return ref;
+}
+
+static int do_linreg(struct bench *b)
+{
+	struct servo *ref = NULL, *servo;
+	struct replay_result r;
+	int err = -1, mismatches;
+	double diff, ref_ns;
+
+	servo = bench_servo(b, CLOCK_SERVO_LINREG);
+	if (!servo) {
+		return -1;
+	}
+	ref = linreg_ref(b, servo);
+	if (!ref || replay(b, servo, &r)) {
+		goto out;
+	}
+	replay_header();
+	replay_print("linreg", &r);
+	servo_destroy(servo);
+
+	servo = bench_servo(b, CLOCK_SERVO_LINREG);
+	if (!servo) {
+		goto out;
+	}
+	mismatches = linreg_check(b, servo, ref, &diff);
+	printf("full regression differs by %.3g ppb at most, "
+	       "%d mismatches\n", diff, mismatches);
+	servo_reset(servo);
+	servo_reset(ref);
+
+	ref_ns = linreg_time(b, ref);
+	printf("full regression %.1f ns/sample, running sums %.1f ns/sample\n",
+	       ref_ns, linreg_time(b, servo));
+	err = mismatches ? -1 : 0;
+out:
+	if (ref) {
+		servo_destroy(ref);
+	}
+	if (servo) {
+		servo_destroy(servo);
+	}
+	return err;
+}
+
+/*
+ * Each reading of the clock takes a fixed time, which changes now and
+ * then, plus a random delay. The delay falls on either side of the
+ * reading of the PHC, and so shifts the offset by up to half of it.
+ * Now and then the reading is preempted for much longer.
+ */
+static int sysoff_sim(struct bench *b, int n_samples,
+		      struct sysoff_adapt *adapt)
+{
+	static const double levels[] = { 300.0, 600.0, 900.0 };
+	int64_t error[PTP_MAX_SAMPLES], interval[PTP_MAX_SAMPLES];
+	double busy = 0.0, extra, level = levels[0], samples = 0.0;
+	int best, i, j, n, rejected = 0;
+	struct stats_result res;
+	struct stats *stats;
+
+	stats = stats_create();
+	if (!stats) {
+		return -1;
+	}
+	srand48(b->synth.seed);
+	for (i = 0; i < b->synth.samples; i++) {
+		if (drand48() < 1.0 / 256) {
+			level = levels[lrand48() % 3];
+		}
+		n = adapt ? sysoff_adapt_samples(adapt) : n_samples;
+		best = 0;
+		for (j = 0; j < n; j++) {
+			extra = expo(b->synth.jitter);
+			if (drand48() < 0.01) {
+				extra += expo(20000.0);
+			}
+			interval[j] = llround(level + extra);
+			error[j] = llround((drand48() - 0.5) * extra);
+			if (interval[j] < interval[best]) {
+				best = j;
+			}
+			busy += interval[j];
+		}
+		samples += n;
+		if (adapt) {
+			best = sysoff_adapt_select(adapt, interval, n);
+		}
+		if (best < 0) {
+			rejected++;
+			continue;
+		}
+		stats_add_value(stats, error[best]);
+	}
+	stats_get_result(stats, &res);
+	printf("%-8s %10.1f %10.0f %10.1f %10d %10.0f\n",
+	       adapt ? "adaptive" : "fixed", res.rms, res.max_abs,
+	       samples / b->synth.samples, rejected,
+	       busy / b->synth.samples);
+	stats_destroy(stats);
+	return 0;
+}
+
+static int do_sysoff(struct bench *b)
+{
+	static const int fixed[] = { 3, 5, 10, 25 };
+	struct sysoff_adapt *adapt;
+	unsigned int i;
+	int err;
+
+	printf("%-8s %10s %10s %10s %10s %10s\n", "samples", "rms [ns]",
+	       "max [ns]", "mean", "rejected", "busy [ns]");
+	for (i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+		if (sysoff_sim(b, fixed[i], NULL)) {
+			return -1;
+		}
+	}
+	adapt = sysoff_adapt_create(5);
+	if (!adapt) {
+		return -1;
+	}
+	err = sysoff_sim(b, 0, adapt);
+	sysoff_adapt_destroy(adapt);
+	return err;
+}
+
+/*
+ * Arms every timer at a random time within ten seconds, like the
+ * announce and sync timers of many ports, and then cancels them all.
+ * The timerfd column is one timerfd armed and disarmed just as often,
+ * as each timer used to be.
+ */
+static int wheel_time(int n, double *arm, double *cancel)
+{
+	struct twheel_timer *timers;
+	struct twheel *wheel;
+	uint64_t *tmo;
+	double t0, t1;
+	int i, r;
+
+	wheel = twheel_create();
+	timers = calloc(n, sizeof(*timers));
+	tmo = calloc(n, sizeof(*tmo));
+	if (!wheel || !timers || !tmo) {
+		goto failed;
+	}
+	for (i = 0; i < n; i++) {
+		twheel_timer_init(&timers[i], wheel, NULL, i);
+		tmo[i] = 1 + lrand48() % (10 * NS_PER_SEC);
+	}
+	*arm = *cancel = 0.0;
+	for (r = 0; r < WHEEL_ROUNDS; r++) {
+		t0 = now_ns();
+		for (i = 0; i < n; i++) {
+			if (twheel_arm(&timers[i], tmo[i])) {
+				goto failed;
+			}
+		}
+		t1 = now_ns();
+		for (i = 0; i < n; i++) {
+			twheel_cancel(&timers[i]);
+		}
+		*arm += t1 - t0;
+		*cancel += now_ns() - t1;
+	}
+	*arm /= (double) n * WHEEL_ROUNDS;
+	*cancel /= (double) n * WHEEL_ROUNDS;
+	free(tmo);
+	free(timers);
+	twheel_destroy(wheel);
+	return 0;
+failed:
+	free(tmo);
+	free(timers);
+	if (wheel) {
+		twheel_destroy(wheel);
+	}
+	return -1;
+}
+
+static int timerfd_time(int n, double *arm, double *cancel)
+{
+	struct itimerspec tmo;
+	double t0, t1;
+	int fd, i;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	memset(&tmo, 0, sizeof(tmo));
+	*arm = *cancel = 0.0;
+	for (i = 0; i < n; i++) {
+		tmo.it_value.tv_sec = 1 + lrand48() % 10;
+		t0 = now_ns();
+		timerfd_settime(fd, 0, &tmo, NULL);
+		t1 = now_ns();
+		tmo.it_value.tv_sec = 0;
+		timerfd_settime(fd, 0, &tmo, NULL);
+		*arm += t1 - t0;
+		*cancel += now_ns() - t1;
+	}
+	*arm /= n;
+	*cancel /= n;
+	close(fd);
+	return 0;
+}
+
+static int do_wheel(struct bench *b)
+{
+	static const int counts[] = { 16, 1024, 65536 };
+	double arm, cancel, fd_arm, fd_cancel;
+	unsigned int i;
+
+	srand48(b->synth.seed);
+	printf("%8s %14s %14s %14s %14s\n", "timers", "wheel arm",
+	       "wheel cancel", "timerfd arm", "timerfd cancel");
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		if (wheel_time(counts[i], &arm, &cancel) ||
+		    timerfd_time(counts[i], &fd_arm, &fd_cancel)) {
+			return -1;
+		}
+		printf("%8d %11.1f ns %11.1f ns %11.1f ns %11.1f ns\n",
+		       counts[i], arm, cancel, fd_arm, fd_cancel);
+	}
+	return 0;
+}
+
+/*
+ * Gives each port as many descriptors as the clock polls for it, and
+ * wakes up for one ready descriptor at a time, as the clock mostly
+ * does. The poll column scans every descriptor as the clock used to,
+ * the epoll column waits on a set holding all of them.
+ */
+static int epoll_time(int nports, double *by_poll, double *by_epoll)
+{
+	int epfd = -1, err = -1, i, j, n = nports * EPOLL_PORT_FDS;
+	struct epoll_event ev, *events;
+	struct pollfd *pfd;
+	uint64_t val = 1;
+	double t0;
+
+	pfd = calloc(n, sizeof(*pfd));
+	events = calloc(n, sizeof(*events));
+	if (!pfd || !events) {
+		goto out;
+	}
+	for (i = 0; i < n; i++) {
+		pfd[i].fd = -1;
+	}
+	epfd = epoll_create1(0);
+	if (epfd < 0) {
+		goto out;
+	}
+	for (i = 0; i < n; i++) {
+		pfd[i].fd = eventfd(0, EFD_NONBLOCK);
+		pfd[i].events = POLLIN | POLLPRI;
+		if (pfd[i].fd < 0) {
+			fprintf(stderr, "eventfd: %m\n");
+			goto out;
+		}
+		ev.events = EPOLLIN | EPOLLPRI;
+		ev.data.u32 = i;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, pfd[i].fd, &ev)) {
+			goto out;
+		}
+	}
+
+	*by_poll = 0.0;
+	for (i = 0; i < EPOLL_ROUNDS; i++) {
+		if (write(pfd[lrand48() % n].fd, &val, sizeof(val)) < 0) {
+			goto out;
+		}
+		t0 = now_ns();
+		if (poll(pfd, n, -1) < 1) {
+			goto out;
+		}
+		for (j = 0; j < n; j++) {
+			if (pfd[j].revents & (POLLIN | POLLPRI)) {
+				break;
+			}
+		}
+		*by_poll += now_ns() - t0;
+		if (j == n || read(pfd[j].fd, &val, sizeof(val)) < 0) {
+			goto out;
+		}
+	}
+	*by_epoll = 0.0;
+	for (i = 0; i < EPOLL_ROUNDS; i++) {
+		if (write(pfd[lrand48() % n].fd, &val, sizeof(val)) < 0) {
+			goto out;
+		}
+		t0 = now_ns();
+		if (epoll_wait(epfd, events, n, -1) < 1) {
+			goto out;
+		}
+		*by_epoll += now_ns() - t0;
+		if (read(pfd[events[0].data.u32].fd, &val, sizeof(val)) < 0) {
+			goto out;
+		}
+	}
+	*by_poll /= EPOLL_ROUNDS;
+	*by_epoll /= EPOLL_ROUNDS;
+	err = 0;
+out:
+	for (i = 0; pfd && i < n; i++) {
+		if (pfd[i].fd >= 0) {
+			close(pfd[i].fd);
+		}
+	}
+	if (epfd >= 0) {
+		close(epfd);
+	}
+	free(events);
+	free(pfd);
+	return err;
+}
+
+static int do_epoll(struct bench *b)
+{
+	static const int counts[] = { 4, 48, 256 };
+	double by_poll, by_epoll;
+	struct rlimit lim;
+	unsigned int i;
+
+	/* Make room for the descriptors of the largest clock. */
+	if (!getrlimit(RLIMIT_NOFILE, &lim)) {
+		lim.rlim_cur = lim.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &lim);
+	}
+	srand48(b->synth.seed);
+	printf("%6s %12s %14s %14s\n", "ports", "descriptors", "poll",
+	       "epoll");
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		if (epoll_time(counts[i], &by_poll, &by_epoll)) {
+			return -1;
+		}
+		printf("%6d %12d %11.0f ns %11.0f ns\n", counts[i],
+		       counts[i] * EPOLL_PORT_FDS, by_poll, by_epoll);
+	}
+	return 0;
+}
+
+static void grant_address(struct ptp_message *m, uint32_t client)
+{
+	m->address.len = sizeof(m->address.sin);
+	m->address.sin.sin_family = AF_INET;
+	m->address.sin.sin_addr.s_addr = htonl(0x0a000000 + client);
+	m->header.sourcePortIdentity.portNumber = 1;
+	memcpy(&m->header.sourcePortIdentity.clockIdentity, &client,
+	       sizeof(client));
+}
+
+/*
+ * Grows the number of clients of the port to 'n', and then times
+ * renewing the grants of random clients, and granting and canceling
+ * the service of new clients.
+ */
+static int grants_time(struct port *p, int *clients, int n, double *renew,
+		       double *grant, double *cancel)
+{
+	struct request_unicast_xmit_tlv req = {
+		.type = TLV_REQUEST_UNICAST_TRANSMISSION,
+		.length = sizeof(req) - sizeof(req.type) - sizeof(req.length),
+		.message_type = SYNC << 4,
+		.durationField = 300,
+	};
+	struct cancel_unicast_xmit_tlv can = {
+		.type = TLV_CANCEL_UNICAST_TRANSMISSION,
+		.length = sizeof(can) - sizeof(can.type) - sizeof(can.length),
+		.message_type_flags = SYNC << 4,
+	};
+	struct tlv_extra req_extra = { .tlv = (struct TLV *) &req };
+	struct tlv_extra can_extra = { .tlv = (struct TLV *) &can };
+	struct ptp_message *m;
+	int err = -1, i;
+	double t0, t1;
+
+	m = msg_allocate();
+	if (!m) {
+		return -1;
+	}
+	for (; *clients < n; (*clients)++) {
+		grant_address(m, *clients);
+		if (unicast_service_add(p, m, &req_extra) != SERVICE_GRANTED) {
+			goto out;
+		}
+	}
+	*renew = *grant = *cancel = 0.0;
+	for (i = 0; i < GRANT_ROUNDS; i++) {
+		grant_address(m, lrand48() % n);
+		t0 = now_ns();
+		if (unicast_service_add(p, m, &req_extra) != SERVICE_GRANTED) {
+			goto out;
+		}
+		*renew += now_ns() - t0;
+
+		grant_address(m, n + i);
+		t0 = now_ns();
+		if (unicast_service_add(p, m, &req_extra) != SERVICE_GRANTED) {
+			goto out;
+		}
+		t1 = now_ns();
+		unicast_service_remove(p, m, &can_extra);
+		*grant += t1 - t0;
+		*cancel += now_ns() - t1;
+	}
+	*renew /= GRANT_ROUNDS;
+	*grant /= GRANT_ROUNDS;
+	*cancel /= GRANT_ROUNDS;
+	err = 0;
+out:
+	msg_put(m);
+	return err;
+}
+
+/*
+ * Runs the unicast service of a real port on the loopback interface.
+ * The grants and cancellations are handed to the service directly,
+ * and so the reply messages are not part of the times.
+ */
+static int do_grants(struct bench *b)
+{
+	static const int counts[] = { 100, 1000, 10000 };
+	double renew, grant, cancel;
+	int clients = 0, err = 0;
+	struct clock *clock;
+	unsigned int i;
+	struct port *p;
+
+	if (!config_create_interface("lo", b->cfg) ||
+	    config_set_section_int(b->cfg, "lo", "unicast_listen", 1) ||
+	    config_set_int(b->cfg, "time_stamping", TS_SOFTWARE) ||
+	    config_set_int(b->cfg, "network_transport", TRANS_UDP_IPV4) ||
+	    config_set_string(b->cfg, "uds_address", "/tmp/ptpbench")) {
+		return -1;
+	}
+	clock = clock_create(CLOCK_TYPE_ORDINARY, b->cfg, NULL);
+	if (!clock) {
+		fprintf(stderr, "failed to create a clock\n");
+		return -1;
+	}
+	p = clock_first_port(clock);
+
+	srand48(b->synth.seed);
+	printf("%8s %14s %14s %14s\n", "clients", "renew", "grant",
+	       "cancel");
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		err = grants_time(p, &clients, counts[i], &renew, &grant,
+				  &cancel);
+		if (err) {
+			break;
+		}
+		printf("%8d %11.0f ns %11.0f ns %11.0f ns\n", counts[i],
+		       renew, grant, cancel);
+	}
+	clock_destroy(clock);
+	return err;
+}
+
+static struct mode all_modes[] = {
+	{ "replay", do_replay },
+	{ "servos", do_servos },
+	{ "filter", do_filter },
+	{ "linreg", do_linreg },
+	{ "sysoff", do_sysoff },
+	{ "wheel", do_wheel },
+	{ "epoll", do_epoll },
+	{ "grants", do_grants },
+	{ NULL, NULL },
+};
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\nusage: %s [options] [mode]\n\n"
+		" Modes\n\n"
+		" replay    replay a trace through the time stamp processor and\n"
+		"           the servo of the configuration (default)\n"
+		" servos    replay a trace through the pi, linreg and kalman servos\n"
+		" filter    check the delay filters against plain references\n"
+		"           and time them\n"
+		" linreg    compare the linreg servo to one recomputing the full\n"
+		"           regression on every sample\n"
+		" sysoff    simulate fixed and adaptive numbers of clock readings\n"
+		" wheel     time arming and canceling many timers on a timing\n"
+		"           wheel and on a timerfd\n"
+		" epoll     time waking up for one of the descriptors of many\n"
+		"           ports with poll and with epoll\n"
+		" grants    time granting and canceling unicast service with\n"
+		"           many clients, on the loopback interface\n\n"
+		" Trace Options\n\n"
+		" -t [file] read the trace from 'file' instead of synthesizing it\n"
+		" -n [num]  number of samples to synthesize, default 4096\n"
+		" -O [ns]   initial offset of the slave clock, default 100000\n"
+		" -F [ppb]  frequency offset of the slave clock, default 10000\n"
+		" -W [ppb]  random walk of the frequency per sqrt(s), default 1\n"
+		" -D [ns]   path delay, default 10000\n"
+		" -J [ns]   time stamp noise, or in the sysoff mode the mean\n"
+		"           extra delay of a reading, default 20\n"
+		" -Q [ns]   mean queuing delay, default 0\n"
+		" -r [num]  random seed, default 1\n"
+		" -p        print the trace and exit\n\n"
+		" Other Options\n\n"
+		" -f [file] read configuration from 'file'\n"
+		" -l [num]  set the logging level to 'num'\n"
+		" -m        print messages to stdout\n"
+		" -v        prints the software version and exits\n"
+		" -h        prints this message and exits\n\n"
+		" The options of ptp4l, like clock_servo, delay_filter or\n"
+		" logSyncInterval, may also be given as long options.\n\n"
+		" A trace holds one Sync message per line: the origin and\n"
+		" ingress time stamps and the measured path delay, and\n"
+		" optionally the true offset of the slave clock, all in\n"
+		" nanoseconds. The slave clock must have been free running.\n"
+		"\n",
+		progname);
+}
+
+int main(int argc, char *argv[])
+{
+	char *config = NULL, *progname;
+	int c, err = -1, index, print_level, print = 0;
+	struct mode *mode = &all_modes[0];
+	struct option *opts;
+	struct bench b;
+	int log_sync;
+
+	memset(&b, 0, sizeof(b));
+	b.synth.samples = 4096;
+	b.synth.offset = 100000.0;
+	b.synth.freq = 10000.0;
+	b.synth.wander = 1.0;
+	b.synth.delay = 10000.0;
+	b.synth.jitter = 20.0;
+	b.synth.seed = 1;
+
+	b.cfg = config_create();
+	if (!b.cfg) {
+		return -1;
+	}
+	opts = config_long_options(b.cfg);
+
+	/* Process the command line arguments. */
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1+progname : argv[0];
+	while (EOF != (c = getopt_long(argc, argv, "t:n:O:F:W:D:J:Q:r:pf:l:mvh",
+				       opts, &index))) {
+		switch (c) {
+		case 0:
+			if (config_parse_option(b.cfg, opts[index].name, optarg))
+				goto out;
+			break;
+		case 't':
+			b.trace_file = optarg;
+			break;
+		case 'n':
+			if (get_arg_val_i(c, optarg, &b.synth.samples,
+					  1, INT_MAX))
+				goto out;
+			break;
+		case 'O':
+			if (get_arg_val_d(c, optarg, &b.synth.offset,
+					  -1e18, 1e18))
+				goto out;
+			break;
+		case 'F':
+			if (get_arg_val_d(c, optarg, &b.synth.freq, -1e9, 1e9))
+				goto out;
+			break;
+		case 'W':
+			if (get_arg_val_d(c, optarg, &b.synth.wander, 0, 1e9))
+				goto out;
+			break;
+		case 'D':
+			if (get_arg_val_d(c, optarg, &b.synth.delay, 0, 1e18))
+				goto out;
+			break;
+		case 'J':
+			if (get_arg_val_d(c, optarg, &b.synth.jitter, 0, 1e18))
+				goto out;
+			break;
+		case 'Q':
+			if (get_arg_val_d(c, optarg, &b.synth.queue, 0, 1e18))
+				goto out;
+			break;
+		case 'r':
+			b.synth.seed = atol(optarg);
+			break;
+		case 'p':
+			print = 1;
+			break;
+		case 'f':
+			config = optarg;
+			break;
+		case 'l':
+			if (get_arg_val_i(c, optarg, &print_level,
+					  PRINT_LEVEL_MIN, PRINT_LEVEL_MAX))
+				goto out;
+			config_set_int(b.cfg, "logging_level", print_level);
+			break;
+		case 'm':
+			config_set_int(b.cfg, "verbose", 1);
+			break;
+		case 'v':
+			version_show(stdout);
+			err = 0;
+			goto out;
+		case 'h':
+			usage(progname);
+			err = 0;
+			goto out;
+		case '?':
+		default:
+			usage(progname);
+			goto out;
+		}
+	}
+
+	if (optind < argc) {
+		for (mode = all_modes; mode->name; mode++) {
+			if (!strcmp(mode->name, argv[optind]))
+				break;
+		}
+		if (!mode->name || optind + 1 < argc) {
+			usage(progname);
+			goto out;
+		}
+	}
+
+	if (config && config_read(config, b.cfg)) {
+		goto out;
+	}
+
+	print_set_progname(progname);
+	print_set_verbose(config_get_int(b.cfg, NULL, "verbose"));
+	print_set_syslog(0);
+	print_set_level(config_get_int(b.cfg, NULL, "logging_level"));
+
+	log_sync = config_get_int(b.cfg, NULL, "logSyncInterval");
+	b.interval = log_sync < 0 ? 1.0 / (1 << -log_sync) : 1 << log_sync;
+
+	if (b.trace_file) {
+		if (trace_read(&b.trace, b.trace_file))
+			goto out;
+	} else if (trace_synthesize(&b.trace, &b.synth, b.interval)) {
+		goto out;
+	}
+	if (print) {
+		trace_print(&b.trace);
+		err = 0;
+		goto out;
+	}
+
+	err = mode->function(&b);
+out:
+	free(b.trace.sample);
+	config_destroy(b.cfg);
+	return err ? -1 : 0;
+}
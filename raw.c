@@ -262,6 +262,21 @@ no_mac:
 	return -1;
 }
 
+static void raw_check_vlan(struct raw *raw, struct eth_hdr *hdr)
+{
+	if (raw->vlan) {
+		if (ETH_P_1588 == ntohs(hdr->type)) {
+			pr_notice("raw: disabling VLAN mode");
+			raw->vlan = 0;
+		}
+	} else {
+		if (ETH_P_8021Q == ntohs(hdr->type)) {
+			pr_notice("raw: switching to VLAN mode");
+			raw->vlan = 1;
+		}
+	}
+}
+
 static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts)
 {
@@ -286,16 +301,52 @@ static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
 	if (cnt < 0)
 		return cnt;
 
-	if (raw->vlan) {
-		if (ETH_P_1588 == ntohs(hdr->type)) {
-			pr_notice("raw: disabling VLAN mode");
-			raw->vlan = 0;
+	raw_check_vlan(raw, hdr);
+	return cnt;
+}
+
+static int raw_recv_batch(struct transport *t, int fd,
+			  struct sk_rxbuf *rx, int n)
+{
+	struct raw *raw = container_of(t, struct raw, t);
+	int cnt, hlen, i, len;
+	unsigned char *ptr;
+	struct eth_hdr *hdr;
+
+	/*
+	 * Leave room for the longer header, and move the payload into
+	 * place afterwards, since every frame of a batch may differ. The
+	 * length limit still keeps a moved payload within the buffer.
+	 */
+	hlen = sizeof(struct vlan_hdr);
+	for (i = 0; i < n; i++) {
+		rx[i].buf = (unsigned char *) rx[i].buf - hlen;
+		rx[i].buflen += sizeof(struct eth_hdr);
+	}
+
+	cnt = sk_receive_batch(fd, rx, n);
+
+	for (i = 0; i < cnt; i++) {
+		if (rx[i].cnt < 0) {
+			continue;
 		}
-	} else {
-		if (ETH_P_8021Q == ntohs(hdr->type)) {
-			pr_notice("raw: switching to VLAN mode");
-			raw->vlan = 1;
+		ptr = rx[i].buf;
+		hdr = (struct eth_hdr *) ptr;
+		if (rx[i].cnt >= sizeof(*hdr) &&
+		    ETH_P_8021Q == ntohs(hdr->type)) {
+			len = sizeof(struct vlan_hdr);
+		} else {
+			len = sizeof(struct eth_hdr);
+		}
+		if (rx[i].cnt < len) {
+			rx[i].cnt = -EBADMSG;
+			continue;
+		}
+		rx[i].cnt -= len;
+		if (len != hlen) {
+			memmove(ptr + hlen, ptr + len, rx[i].cnt);
 		}
+		raw_check_vlan(raw, hdr);
 	}
 	return cnt;
 }
@@ -373,6 +424,7 @@ struct transport *raw_transport_create(void)
 	raw->t.close   = raw_close;
 	raw->t.open    = raw_open;
 	raw->t.recv    = raw_recv;
+	raw->t.recv_batch = raw_recv_batch;
 	raw->t.send    = raw_send;
 	raw->t.release = raw_release;
 	raw->t.physical_addr = raw_physical_addr;
@@ -19,6 +19,8 @@
  */
 #include <errno.h>
 #include <time.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
 #include <linux/net_tstamp.h>
 #include <linux/sockios.h>
 #include <linux/ethtool.h>
@@ -41,6 +43,7 @@
 
 int sk_tx_timeout = 1;
 int sk_check_fupsync;
+int sk_tx_async;
 enum hwts_filter_mode sk_hwts_filter_mode = HWTS_FILTER_NORMAL;
 
 /* private methods */
@@ -325,15 +328,65 @@ int sk_interface_addr(const char *name, int family, struct address *addr)
 static short sk_events = POLLPRI;
 static short sk_revents = POLLPRI;
 
+static void sk_set_hwts(struct hw_timestamp *hwts, struct timespec *ts)
+{
+	switch (hwts->type) {
+	case TS_SOFTWARE:
+		hwts->ts = timespec_to_tmv(ts[0]);
+		break;
+	case TS_HARDWARE:
+	case TS_ONESTEP:
+	case TS_P2P1STEP:
+		hwts->ts = timespec_to_tmv(ts[2]);
+		break;
+	case TS_LEGACY_HW:
+		hwts->ts = timespec_to_tmv(ts[1]);
+		break;
+	}
+}
+
+static int sk_receive_cmsg(struct msghdr *msg, struct hw_timestamp *hwts)
+{
+	struct timespec *sw, *ts = NULL;
+	struct cmsghdr *cm;
+	int level, type;
+
+	for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+		level = cm->cmsg_level;
+		type  = cm->cmsg_type;
+		if (SOL_SOCKET == level && SO_TIMESTAMPING == type) {
+			if (cm->cmsg_len < sizeof(*ts) * 3) {
+				pr_warning("short SO_TIMESTAMPING message");
+				return -EMSGSIZE;
+			}
+			ts = (struct timespec *) CMSG_DATA(cm);
+		}
+		if (SOL_SOCKET == level && SO_TIMESTAMPNS == type) {
+			if (cm->cmsg_len < sizeof(*sw)) {
+				pr_warning("short SO_TIMESTAMPNS message");
+				return -EMSGSIZE;
+			}
+			sw = (struct timespec *) CMSG_DATA(cm);
+			hwts->sw = timespec_to_tmv(*sw);
+		}
+	}
+
+	if (!ts) {
+		memset(&hwts->ts, 0, sizeof(hwts->ts));
+		return 0;
+	}
+
+	sk_set_hwts(hwts, ts);
+	return 0;
+}
+
 int sk_receive(int fd, void *buf, int buflen,
 	       struct address *addr, struct hw_timestamp *hwts, int flags)
 {
 	char control[256];
-	int cnt = 0, res = 0, level, type;
-	struct cmsghdr *cm;
+	int cnt = 0, res = 0;
 	struct iovec iov = { buf, buflen };
 	struct msghdr msg;
-	struct timespec *sw, *ts = NULL;
 
 	memset(control, 0, sizeof(control));
 	memset(&msg, 0, sizeof(msg));
@@ -366,6 +419,241 @@ int sk_receive(int fd, void *buf, int buflen,
 		pr_err("recvmsg%sfailed: %m",
 		       flags == MSG_ERRQUEUE ? " tx timestamp " : " ");
 	}
+	res = sk_receive_cmsg(&msg, hwts);
+	if (res) {
+		return res;
+	}
+
+	if (addr)
+		addr->len = msg.msg_namelen;
+
+	return cnt < 1 ? -errno : cnt;
+}
+
+int sk_receive_batch(int fd, struct sk_rxbuf *rx, int n)
+{
+	char control[SK_RX_BATCH_MAX][256];
+	struct mmsghdr mmsg[SK_RX_BATCH_MAX];
+	struct iovec iov[SK_RX_BATCH_MAX];
+	int cnt, i;
+
+	if (n > SK_RX_BATCH_MAX) {
+		n = SK_RX_BATCH_MAX;
+	}
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = rx[i].buf;
+		iov[i].iov_len = rx[i].buflen;
+		if (rx[i].addr) {
+			mmsg[i].msg_hdr.msg_name = &rx[i].addr->ss;
+			mmsg[i].msg_hdr.msg_namelen = sizeof(rx[i].addr->ss);
+		}
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+		mmsg[i].msg_hdr.msg_control = control[i];
+		mmsg[i].msg_hdr.msg_controllen = sizeof(control[i]);
+	}
+
+	cnt = recvmmsg(fd, mmsg, n, MSG_DONTWAIT, NULL);
+	if (cnt < 1) {
+		pr_err("recvmmsg failed: %m");
+		return cnt < 0 ? -errno : -EAGAIN;
+	}
+	for (i = 0; i < cnt; i++) {
+		rx[i].cnt = sk_receive_cmsg(&mmsg[i].msg_hdr, rx[i].hwts);
+		if (rx[i].cnt) {
+			continue;
+		}
+		rx[i].cnt = mmsg[i].msg_len;
+		if (rx[i].addr) {
+			rx[i].addr->len = mmsg[i].msg_hdr.msg_namelen;
+		}
+	}
+	return cnt;
+}
+
+int sk_poll_txts(struct pollfd *pfd, int n, int timeout)
+{
+	int i, res;
+
+	for (i = 0; i < n; i++) {
+		pfd[i].events = sk_events;
+		pfd[i].revents = 0;
+	}
+	res = poll(pfd, n, timeout);
+	if (res < 1) {
+		return res;
+	}
+	for (i = 0; i < n; i++) {
+		pfd[i].revents &= sk_revents;
+	}
+	return res;
+}
+
+int sk_send_batch(int fd, struct sk_txbuf *tx, int n)
+{
+	struct mmsghdr mmsg[SK_TX_BATCH_MAX];
+	struct iovec iov[SK_TX_BATCH_MAX];
+	int cnt, done = 0, i, sent = 0;
+
+	if (n > SK_TX_BATCH_MAX) {
+		n = SK_TX_BATCH_MAX;
+	}
+	memset(mmsg, 0, n * sizeof(mmsg[0]));
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = tx[i].buf;
+		iov[i].iov_len = tx[i].len;
+		mmsg[i].msg_hdr.msg_name = &tx[i].addr->sa;
+		mmsg[i].msg_hdr.msg_namelen = tx[i].addr->len;
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	while (done < n) {
+		cnt = sendmmsg(fd, &mmsg[done], n - done, 0);
+		if (cnt < 1) {
+			/* Skip over the message that failed. */
+			pr_err("sendmmsg failed: %m");
+			tx[done].cnt = cnt < 0 ? -errno : -EIO;
+			done++;
+			continue;
+		}
+		for (i = done; i < done + cnt; i++) {
+			tx[i].cnt = mmsg[i].msg_len;
+		}
+		done += cnt;
+		sent += cnt;
+	}
+	return sent;
+}
+
+int sk_reuseport_open(int fd, const char *device)
+{
+	int family, flags, level, name, nfd, off = 0, on = 1, tos;
+	struct sockaddr_storage ss;
+	socklen_t len, salen;
+
+	len = sizeof(ss);
+	if (getsockname(fd, (struct sockaddr *) &ss, &len)) {
+		pr_err("getsockname failed: %m");
+		return -1;
+	}
+	family = ss.ss_family;
+	if (family == AF_INET) {
+		level = IPPROTO_IP;
+		name = IP_TOS;
+		salen = sizeof(struct sockaddr_in);
+	} else {
+		level = IPPROTO_IPV6;
+		name = IPV6_TCLASS;
+		salen = sizeof(struct sockaddr_in6);
+	}
+
+	nfd = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+	if (nfd < 0) {
+		pr_err("socket failed: %m");
+		return -1;
+	}
+	if (setsockopt(nfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) ||
+	    setsockopt(nfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) {
+		pr_err("setsockopt SO_REUSEPORT failed: %m");
+		goto no_option;
+	}
+	if (family == AF_INET6) {
+		len = sizeof(flags);
+		if (!getsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &flags, &len) &&
+		    setsockopt(nfd, IPPROTO_IPV6, IPV6_V6ONLY, &flags, len)) {
+			pr_err("setsockopt IPV6_V6ONLY failed: %m");
+			goto no_option;
+		}
+	}
+	/* Join the group of 'fd' only, and not those of other ports. */
+	if (setsockopt(nfd, SOL_SOCKET, SO_BINDTODEVICE, device, strlen(device))) {
+		pr_err("setsockopt SO_BINDTODEVICE failed: %m");
+		goto no_option;
+	}
+	if (bind(nfd, (struct sockaddr *) &ss, salen)) {
+		pr_err("bind failed: %m");
+		goto no_option;
+	}
+	/* Keep the multicast traffic of the other sockets away. */
+	if (setsockopt(nfd, level, family == AF_INET ? IP_MULTICAST_ALL :
+		       IPV6_MULTICAST_ALL, &off, sizeof(off))) {
+		pr_warning("setsockopt MULTICAST_ALL failed: %m");
+	}
+	len = sizeof(tos);
+	if (!getsockopt(fd, level, name, &tos, &len) && tos &&
+	    setsockopt(nfd, level, name, &tos, len)) {
+		pr_warning("setsockopt IP_TOS failed: %m");
+	}
+
+	len = sizeof(flags);
+	if (getsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, &len)) {
+		pr_err("getsockopt SO_TIMESTAMPING failed: %m");
+		goto no_option;
+	}
+	if (flags & (SOF_TIMESTAMPING_TX_HARDWARE |
+		     SOF_TIMESTAMPING_TX_SOFTWARE)) {
+		flags |= SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+		if (setsockopt(nfd, SOL_SOCKET, SO_TIMESTAMPING,
+			       &flags, sizeof(flags))) {
+			pr_err("setsockopt SO_TIMESTAMPING failed: %m");
+			goto no_option;
+		}
+		if (setsockopt(nfd, SOL_SOCKET, SO_SELECT_ERR_QUEUE,
+			       &on, sizeof(on))) {
+			pr_warning("setsockopt SO_SELECT_ERR_QUEUE failed: %m");
+		}
+	}
+	return nfd;
+
+no_option:
+	close(nfd);
+	return -1;
+}
+
+int sk_reuseport_steer(int fd, int index)
+{
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_RET | BPF_K, index),
+	};
+	struct sock_fprog prog = {
+		.len = sizeof(code) / sizeof(code[0]),
+		.filter = code,
+	};
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+		       &prog, sizeof(prog))) {
+		pr_err("setsockopt SO_ATTACH_REUSEPORT_CBPF failed: %m");
+		return -1;
+	}
+	return 0;
+}
+
+int sk_receive_txts(int fd, struct hw_timestamp *hwts, uint32_t *key)
+{
+	struct sock_extended_err *err = NULL;
+	struct timespec *ts = NULL;
+	unsigned char buf[128];
+	struct iovec iov = { buf, sizeof(buf) };
+	char control[256];
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	int level, type;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return -EAGAIN;
+		}
+		pr_err("recvmsg tx timestamp failed: %m");
+		return -errno;
+	}
 	for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
 		level = cm->cmsg_level;
 		type  = cm->cmsg_type;
@@ -376,38 +664,20 @@ int sk_receive(int fd, void *buf, int buflen,
 			}
 			ts = (struct timespec *) CMSG_DATA(cm);
 		}
-		if (SOL_SOCKET == level && SO_TIMESTAMPNS == type) {
-			if (cm->cmsg_len < sizeof(*sw)) {
-				pr_warning("short SO_TIMESTAMPNS message");
-				return -EMSGSIZE;
-			}
-			sw = (struct timespec *) CMSG_DATA(cm);
-			hwts->sw = timespec_to_tmv(*sw);
+		if ((IPPROTO_IP == level && IP_RECVERR == type) ||
+		    (IPPROTO_IPV6 == level && IPV6_RECVERR == type) ||
+		    (SOL_PACKET == level && PACKET_TX_TIMESTAMP == type)) {
+			err = (struct sock_extended_err *) CMSG_DATA(cm);
 		}
 	}
-
-	if (addr)
-		addr->len = msg.msg_namelen;
-
-	if (!ts) {
-		memset(&hwts->ts, 0, sizeof(hwts->ts));
-		return cnt < 1 ? -errno : cnt;
+	if (!ts || !err || err->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) {
+		pr_err("tx timestamp without a key");
+		return -EPROTO;
 	}
 
-	switch (hwts->type) {
-	case TS_SOFTWARE:
-		hwts->ts = timespec_to_tmv(ts[0]);
-		break;
-	case TS_HARDWARE:
-	case TS_ONESTEP:
-	case TS_P2P1STEP:
-		hwts->ts = timespec_to_tmv(ts[2]);
-		break;
-	case TS_LEGACY_HW:
-		hwts->ts = timespec_to_tmv(ts[1]);
-		break;
-	}
-	return cnt < 1 ? -errno : cnt;
+	*key = err->ee_data;
+	sk_set_hwts(hwts, ts);
+	return 0;
 }
 
 int sk_set_priority(int fd, int family, uint8_t dscp)
@@ -473,6 +743,14 @@ int sk_timestamping_init(int fd, const char *device, enum timestamp_type type,
 		return -1;
 	}
 
+	/*
+	 * One-step ports still wait for their time stamps in place, and
+	 * sk_receive() expects the whole packet back.
+	 */
+	if (sk_tx_async && type != TS_ONESTEP && type != TS_P2P1STEP) {
+		flags |= SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+	}
+
 	if (type != TS_SOFTWARE) {
 		filter1 = HWTSTAMP_FILTER_PTP_V2_EVENT;
 		switch (type) {
@@ -20,6 +20,8 @@
 #ifndef HAVE_SK_H
 #define HAVE_SK_H
 
+#include <poll.h>
+
 #include "address.h"
 #include "transport.h"
 
@@ -109,6 +111,116 @@ int sk_interface_addr(const char *name, int family, struct address *addr);
 int sk_receive(int fd, void *buf, int buflen,
 	       struct address *addr, struct hw_timestamp *hwts, int flags);
 
+/**
+ * The largest number of messages that sk_receive_batch() reads at once.
+ */
+#define SK_RX_BATCH_MAX 64
+
+/**
+ * Describes one of the buffers filled by sk_receive_batch().
+ * @buf:     Buffer to receive the message.
+ * @buflen:  Size of 'buf' in bytes.
+ * @addr:    Buffer to receive the message's source address. May be NULL.
+ * @hwts:    Buffer to receive the message's time stamp.
+ * @cnt:     Set to the length of the message, or to a negative error code.
+ */
+struct sk_rxbuf {
+	void *buf;
+	int buflen;
+	struct address *addr;
+	struct hw_timestamp *hwts;
+	int cnt;
+};
+
+/**
+ * Read as many messages from a socket as are queued, up to a limit,
+ * using a single call to RECVMMSG(2). Does not block.
+ * @param fd  An open socket.
+ * @param rx  Array of buffers to receive the messages.
+ * @param n   Number of buffers in 'rx', at most @ref SK_RX_BATCH_MAX.
+ * @return    The number of messages read on success, which are found
+ *            in the leading entries of 'rx', or a negative error code.
+ */
+int sk_receive_batch(int fd, struct sk_rxbuf *rx, int n);
+
+/**
+ * Wait for transmit time stamps on a number of sockets at once.
+ * @param pfd      Array of descriptors. On return, the revents field
+ *                 is non-zero for those that have a time stamp queued.
+ * @param n        Number of entries in 'pfd'.
+ * @param timeout  How long to wait, in milliseconds.
+ * @return         The number of ready descriptors, zero on time out,
+ *                 or negative on error.
+ */
+int sk_poll_txts(struct pollfd *pfd, int n, int timeout);
+
+/**
+ * The largest number of messages that sk_send_batch() sends at once.
+ */
+#define SK_TX_BATCH_MAX 64
+
+/**
+ * Describes one of the messages sent by sk_send_batch().
+ * @buf:   The message to send.
+ * @len:   Length of 'buf' in bytes.
+ * @addr:  The destination address.
+ * @cnt:   Set to the number of bytes sent, or to a negative error code.
+ */
+struct sk_txbuf {
+	void *buf;
+	int len;
+	struct address *addr;
+	int cnt;
+};
+
+/**
+ * Send a number of messages to their respective destinations using as
+ * few calls to SENDMMSG(2) as possible. A message that fails to go out
+ * does not hold back the ones following it.
+ * @param fd  An open socket.
+ * @param tx  Array of messages to send.
+ * @param n   Number of messages in 'tx', at most @ref SK_TX_BATCH_MAX.
+ * @return    The number of messages sent successfully.
+ */
+int sk_send_batch(int fd, struct sk_txbuf *tx, int n);
+
+/**
+ * Opens another UDP socket on the same local address and port as a
+ * given socket, sharing them via SO_REUSEPORT. The new socket is meant
+ * for transmission only: it joins no multicast groups. If 'fd' has
+ * transmit time stamping enabled, the new socket gets it too, along
+ * with SOF_TIMESTAMPING_OPT_ID.
+ * @param fd      A bound UDP socket with SO_REUSEPORT set.
+ * @param device  The name of the network interface to bind to.
+ * @return        An open socket on success, -1 otherwise.
+ */
+int sk_reuseport_open(int fd, const char *device);
+
+/**
+ * Steers all of the datagrams arriving at a SO_REUSEPORT group to one
+ * of its members. The group is the one 'fd' belongs to, so the sockets
+ * of each port must be bound to the port's device before bind() in
+ * order to form a group of their own.
+ * @param fd     A bound UDP socket with SO_REUSEPORT set.
+ * @param index  The position of the receiving socket within the group,
+ *               in the order the sockets joined it.
+ * @return       Zero on success, non-zero otherwise.
+ */
+int sk_reuseport_steer(int fd, int index);
+
+/**
+ * Collects one transmit time stamp from the error queue of a socket
+ * without blocking. The socket must have been set up while
+ * @ref sk_tx_async was enabled, so that every time stamp carries the
+ * SOF_TIMESTAMPING_OPT_ID key of the packet it belongs to.
+ * @param fd    An open socket.
+ * @param hwts  Pointer to a buffer to receive the time stamp.
+ * @param key   Pointer to a buffer to receive the key of the packet.
+ * @return      Zero on success, -EAGAIN if the error queue is empty,
+ *              or another negative error code otherwise.
+ */
+int sk_receive_txts(int fd, struct hw_timestamp *hwts, uint32_t *key);
+
 /**
  * Set DSCP value for socket.
  * @param fd     An open socket.
@@ -142,6 +254,13 @@ extern int sk_tx_timeout;
  */
 extern int sk_check_fupsync;
 
+/**
+ * Requests SOF_TIMESTAMPING_OPT_ID keyed transmit time stamps, so that
+ * they may be collected later on using sk_receive_txts(). This does not
+ * apply to one-step time stamping.
+ */
+extern int sk_tx_async;
+
 /**
  * Hardware time-stamp setting mode
  */
@@ -0,0 +1,220 @@
+/**
+ * @file state_shm.c
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "print.h"
+#include "state_shm.h"
+
+#define STATE_SHM_MAGIC		0x50545053 /* "PTPS" */
+#define STATE_SHM_VERSION	1
+
+/* Give up reading after this many snapshots changed under our feet. */
+#define STATE_SHM_RETRIES	100
+
+/*
+ * The snapshot is guarded by a sequence lock. The writer makes the
+ * sequence number odd while it updates the snapshot and even again
+ * when it is done. A reader retries until it sees the same even
+ * number before and after copying the snapshot.
+ */
+struct state_shm_region {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t seq;
+	struct state_shm_snapshot snap;
+};
+
+struct state_shm {
+	struct state_shm_region *region;
+	int writer;
+};
+
+static struct state_shm *state_shm_map(const char *name, int writer)
+{
+	struct state_shm *s;
+	struct stat st;
+	void *addr;
+	int fd;
+
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		return NULL;
+	}
+	s->writer = writer;
+
+	/*
+	 * The writer never reuses an existing object, as anyone might
+	 * have created it. Readers only trust an object which belongs
+	 * to root or to themselves and which nobody else can modify.
+	 */
+	if (writer) {
+		if (shm_unlink(name) && errno != ENOENT) {
+			pr_err("failed to remove shared memory %s: %m", name);
+			goto no_open;
+		}
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	} else {
+		fd = shm_open(name, O_RDONLY, 0);
+	}
+	if (fd < 0) {
+		if (writer) {
+			pr_err("failed to open shared memory %s: %m", name);
+		}
+		goto no_open;
+	}
+	if (writer && ftruncate(fd, sizeof(*s->region))) {
+		pr_err("failed to size shared memory %s: %m", name);
+		goto no_map;
+	}
+	if (!writer && (fstat(fd, &st) || st.st_size < sizeof(*s->region))) {
+		goto no_map;
+	}
+	if (!writer && ((st.st_uid && st.st_uid != geteuid()) ||
+			st.st_mode & (S_IWGRP | S_IWOTH))) {
+		pr_err("shared memory %s is not owned by a trusted user "
+		       "or is writable by others", name);
+		goto no_map;
+	}
+	addr = mmap(NULL, sizeof(*s->region),
+		    writer ? PROT_READ | PROT_WRITE : PROT_READ,
+		    MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) {
+		pr_err("failed to map shared memory %s: %m", name);
+		goto no_map;
+	}
+	close(fd);
+	s->region = addr;
+	return s;
+no_map:
+	close(fd);
+no_open:
+	free(s);
+	return NULL;
+}
+
+struct state_shm *state_shm_create(const char *name)
+{
+	struct state_shm_region *r;
+	struct state_shm *s;
+
+	s = state_shm_map(name, 1);
+	if (!s) {
+		return NULL;
+	}
+	r = s->region;
+
+	/* Readers may map the object before it is initialized. */
+	__atomic_store_n(&r->seq, r->seq | 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memset(&r->snap, 0, sizeof(r->snap));
+	r->size = sizeof(*r);
+	r->version = STATE_SHM_VERSION;
+	r->magic = STATE_SHM_MAGIC;
+	__atomic_store_n(&r->seq, r->seq + 1, __ATOMIC_RELEASE);
+
+	return s;
+}
+
+struct state_shm *state_shm_open(const char *name)
+{
+	struct state_shm *s;
+
+	s = state_shm_map(name, 0);
+	if (!s) {
+		return NULL;
+	}
+	if (s->region->magic != STATE_SHM_MAGIC ||
+	    s->region->version != STATE_SHM_VERSION ||
+	    s->region->size != sizeof(*s->region)) {
+		pr_err("shared memory %s has an unknown layout", name);
+		state_shm_destroy(s);
+		return NULL;
+	}
+	return s;
+}
+
+void state_shm_destroy(struct state_shm *s)
+{
+	struct state_shm_snapshot snap;
+
+	if (s->writer) {
+		memset(&snap, 0, sizeof(snap));
+		state_shm_publish(s, &snap);
+	}
+	munmap(s->region, sizeof(*s->region));
+	free(s);
+}
+
+void state_shm_publish(struct state_shm *s, struct state_shm_snapshot *snap)
+{
+	struct state_shm_region *r = s->region;
+	size_t len = state_shm_snapshot_size(snap);
+	uint32_t seq = r->seq;
+
+	if (len == state_shm_snapshot_size(&r->snap) &&
+	    !memcmp(&r->snap, snap, len)) {
+		return;
+	}
+	__atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&r->snap, snap, len);
+	__atomic_store_n(&r->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+int state_shm_read(struct state_shm *s, struct state_shm_snapshot *snap)
+{
+	struct state_shm_region *r = s->region;
+	uint32_t seq;
+	int i;
+
+	for (i = 0; i < STATE_SHM_RETRIES; i++) {
+		seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			continue;
+		}
+		memcpy(snap, &r->snap, offsetof(struct state_shm_snapshot, port));
+		memcpy(snap->port, r->snap.port,
+		       state_shm_snapshot_size(snap) -
+		       offsetof(struct state_shm_snapshot, port));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq) {
+			return snap->alive ? 0 : -1;
+		}
+	}
+	return -1;
+}
+
+size_t state_shm_snapshot_size(struct state_shm_snapshot *snap)
+{
+	unsigned int n = snap->numberPorts;
+
+	if (n > STATE_SHM_MAX_PORTS) {
+		n = STATE_SHM_MAX_PORTS;
+	}
+	return offsetof(struct state_shm_snapshot, port) +
+		n * sizeof(struct state_shm_port);
+}
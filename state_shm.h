@@ -0,0 +1,108 @@
+/**
+ * @file state_shm.h
+ * @brief Publishes the state of ptp4l to local programs via shared memory.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
+ */
+#ifndef HAVE_STATE_SHM_H
+#define HAVE_STATE_SHM_H
+
+#include <stdint.h>
+
+#include "ddt.h"
+#include "ds.h"
+#include "interface.h"
+
+/* Ports with higher numbers are left out of the snapshot. */
+#define STATE_SHM_MAX_PORTS 64
+
+struct state_shm_port {
+	struct PortIdentity portIdentity;
+	uint8_t             port_state;
+	uint8_t             timestamping;
+	char                interface[MAX_IFNAME_SIZE + 1];
+};
+
+/*
+ * The state of the clock as seen by the readers. All of the fields are
+ * in host byte order. The entry of a port is found at the index of its
+ * number less one.
+ */
+struct state_shm_snapshot {
+	uint32_t                alive;
+	UInteger16              numberPorts;
+	struct ClockIdentity    clockIdentity;
+	struct parentDS         parent;
+	struct timePropertiesDS timeprop;
+	int                     servo_state;
+	int64_t                 master_offset;
+	int64_t                 path_delay;
+	double                  freq;
+	struct state_shm_port   port[STATE_SHM_MAX_PORTS];
+};
+
+struct state_shm;
+
+/**
+ * Creates the shared memory object and maps it for writing. Any
+ * existing object of the same name is removed first.
+ * @param name  The name of the object, as for shm_open(3).
+ * @return      A pointer to a new state_shm on success, NULL otherwise.
+ */
+struct state_shm *state_shm_create(const char *name);
+
+/**
+ * Maps an existing shared memory object for reading. The object must
+ * belong to root or to the effective user, and it must not be writable
+ * by the group or by others.
+ * @param name  The name of the object, as for shm_open(3).
+ * @return      A pointer to a new state_shm on success, NULL otherwise.
+ */
+struct state_shm *state_shm_open(const char *name);
+
+/**
+ * Unmaps a shared memory object. The writer's object is left in place,
+ * marked as no longer alive, so that readers know to open the object
+ * of the next instance of the writer.
+ * @param s  A pointer obtained via state_shm_create() or state_shm_open().
+ */
+void state_shm_destroy(struct state_shm *s);
+
+/**
+ * Publishes a snapshot, unless it equals the one published last. Any
+ * padding in the snapshot must be cleared.
+ * @param s     A pointer obtained via state_shm_create().
+ * @param snap  The snapshot to publish.
+ */
+void state_shm_publish(struct state_shm *s, struct state_shm_snapshot *snap);
+
+/**
+ * Reads a consistent copy of the latest snapshot, without making any
+ * system calls.
+ * @param s     A pointer obtained via state_shm_open().
+ * @param snap  Returns the snapshot.
+ * @return      Zero on success, or -1 if the writer is not running.
+ */
+int state_shm_read(struct state_shm *s, struct state_shm_snapshot *snap);
+
+/**
+ * Returns the number of bytes of a snapshot which are in use.
+ * @param snap  The snapshot.
+ * @return      The size of the header and of the entries of the ports.
+ */
+size_t state_shm_snapshot_size(struct state_shm_snapshot *snap);
+
+#endif
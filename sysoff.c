@@ -18,6 +18,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <linux/ptp_clock.h>
@@ -27,6 +28,39 @@
 
 #define NS_PER_SEC 1000000000LL
 
+/*
+ * The adaptive mode learns the distribution of the shortest read
+ * interval of the recent measurements. The spread between the median
+ * and the 10th percentile is the jitter a sample may show and still be
+ * as good as the best one, and measurements whose best interval lies
+ * too far above the 90th percentile are rejected.
+ */
+#define ADAPT_WINDOW		128
+#define ADAPT_LOW_PCT		10
+#define ADAPT_MID_PCT		50
+#define ADAPT_HIGH_PCT		90
+/* The number of samples is revised after this many measurements. */
+#define ADAPT_BLOCK		16
+/* More samples are taken when this many measurements found a good one late. */
+#define ADAPT_MAX_LATE		2
+#define ADAPT_MIN_SAMPLES	2
+
+struct sysoff_adapt {
+	int64_t window[ADAPT_WINDOW];
+	int64_t sorted[ADAPT_WINDOW];
+	unsigned int head;
+	unsigned int len;
+	int samples;
+	int max_samples;
+	/* state of the current block of measurements */
+	int block;
+	int late;
+	int need;
+	/* counters since the last call of sysoff_adapt_stats() */
+	struct sysoff_adapt_stats stats;
+	int64_t samples_sum;
+};
+
 static int64_t pctns(struct ptp_clock_time *t)
 {
 	return t->sec * NS_PER_SEC + t->nsec;
@@ -45,52 +79,42 @@ static int sysoff_precise(int fd, int64_t *result, uint64_t *ts)
 	return SYSOFF_PRECISE;
 }
 
-static int64_t sysoff_estimate(struct ptp_clock_time *pct, int extended,
-			       int n_samples, uint64_t *ts, int64_t *delay)
+static int sysoff_estimate(struct ptp_clock_time *pct, int extended,
+			   int n_samples, struct sysoff_adapt *adapt,
+			   int64_t *result, uint64_t *ts, int64_t *delay)
 {
-	int64_t t1, t2, tp;
-	int64_t interval, timestamp, offset;
-	int64_t shortest_interval, best_timestamp, best_offset;
-	int i = 0;
+	int64_t t1[PTP_MAX_SAMPLES], t2[PTP_MAX_SAMPLES], tp[PTP_MAX_SAMPLES];
+	int64_t interval[PTP_MAX_SAMPLES];
+	int i, best = 0;
 
-	if (extended) {
-		t1 = pctns(&pct[3*i]);
-		tp = pctns(&pct[3*i+1]);
-		t2 = pctns(&pct[3*i+2]);
-	} else {
-		t1 = pctns(&pct[2*i]);
-		tp = pctns(&pct[2*i+1]);
-		t2 = pctns(&pct[2*i+2]);
-	}
-	shortest_interval = t2 - t1;
-	best_timestamp = (t2 + t1) / 2;
-	best_offset = best_timestamp - tp;
-
-	for (i = 1; i < n_samples; i++) {
+	for (i = 0; i < n_samples; i++) {
 		if (extended) {
-			t1 = pctns(&pct[3*i]);
-			tp = pctns(&pct[3*i+1]);
-			t2 = pctns(&pct[3*i+2]);
+			t1[i] = pctns(&pct[3*i]);
+			tp[i] = pctns(&pct[3*i+1]);
+			t2[i] = pctns(&pct[3*i+2]);
 		} else {
-			t1 = pctns(&pct[2*i]);
-			tp = pctns(&pct[2*i+1]);
-			t2 = pctns(&pct[2*i+2]);
+			t1[i] = pctns(&pct[2*i]);
+			tp[i] = pctns(&pct[2*i+1]);
+			t2[i] = pctns(&pct[2*i+2]);
 		}
-		interval = t2 - t1;
-		timestamp = (t2 + t1) / 2;
-		offset = timestamp - tp;
-		if (interval < shortest_interval) {
-			shortest_interval = interval;
-			best_timestamp = timestamp;
-			best_offset = offset;
+		interval[i] = t2[i] - t1[i];
+		if (interval[i] < interval[best]) {
+			best = i;
+		}
+	}
+	if (adapt) {
+		best = sysoff_adapt_select(adapt, interval, n_samples);
+		if (best < 0) {
+			return SYSOFF_REJECTED;
 		}
 	}
-	*ts = best_timestamp;
-	*delay = shortest_interval;
-	return best_offset;
+	*ts = (t2[best] + t1[best]) / 2;
+	*delay = interval[best];
+	*result = *ts - tp[best];
+	return 0;
 }
 
-static int sysoff_extended(int fd, int n_samples,
+static int sysoff_extended(int fd, int n_samples, struct sysoff_adapt *adapt,
 			   int64_t *result, uint64_t *ts, int64_t *delay)
 {
 	struct ptp_sys_offset_extended pso;
@@ -100,11 +124,14 @@ static int sysoff_extended(int fd, int n_samples,
 		pr_debug("ioctl PTP_SYS_OFFSET_EXTENDED: %m");
 		return SYSOFF_RUN_TIME_MISSING;
 	}
-	*result = sysoff_estimate(&pso.ts[0][0], 1, n_samples, ts, delay);
+	if (sysoff_estimate(&pso.ts[0][0], 1, n_samples, adapt,
+			    result, ts, delay)) {
+		return SYSOFF_REJECTED;
+	}
 	return SYSOFF_EXTENDED;
 }
 
-static int sysoff_basic(int fd, int n_samples,
+static int sysoff_basic(int fd, int n_samples, struct sysoff_adapt *adapt,
 			int64_t *result, uint64_t *ts, int64_t *delay)
 {
 	struct ptp_sys_offset pso;
@@ -114,21 +141,34 @@ static int sysoff_basic(int fd, int n_samples,
 		perror("ioctl PTP_SYS_OFFSET");
 		return SYSOFF_RUN_TIME_MISSING;
 	}
-	*result = sysoff_estimate(pso.ts, 0, n_samples, ts, delay);
+	if (sysoff_estimate(pso.ts, 0, n_samples, adapt, result, ts, delay)) {
+		return SYSOFF_REJECTED;
+	}
 	return SYSOFF_BASIC;
 }
 
 int sysoff_measure(int fd, int method, int n_samples,
 		   int64_t *result, uint64_t *ts, int64_t *delay)
 {
+	return sysoff_measure_adaptive(fd, method, n_samples, NULL,
+				       result, ts, delay);
+}
+
+int sysoff_measure_adaptive(int fd, int method, int n_samples,
+			    struct sysoff_adapt *adapt,
+			    int64_t *result, uint64_t *ts, int64_t *delay)
+{
+	if (adapt) {
+		n_samples = sysoff_adapt_samples(adapt);
+	}
 	switch (method) {
 	case SYSOFF_PRECISE:
 		*delay = 0;
 		return sysoff_precise(fd, result, ts);
 	case SYSOFF_EXTENDED:
-		return sysoff_extended(fd, n_samples, result, ts, delay);
+		return sysoff_extended(fd, n_samples, adapt, result, ts, delay);
 	case SYSOFF_BASIC:
-		return sysoff_basic(fd, n_samples, result, ts, delay);
+		return sysoff_basic(fd, n_samples, adapt, result, ts, delay);
 	}
 	return SYSOFF_RUN_TIME_MISSING;
 }
@@ -154,3 +194,134 @@ int sysoff_probe(int fd, int n_samples)
 
 	return SYSOFF_RUN_TIME_MISSING;
 }
+
+struct sysoff_adapt *sysoff_adapt_create(int n_samples)
+{
+	struct sysoff_adapt *a;
+
+	a = calloc(1, sizeof(*a));
+	if (!a) {
+		return NULL;
+	}
+	a->max_samples = PTP_MAX_SAMPLES;
+	a->samples = n_samples;
+	if (a->samples < ADAPT_MIN_SAMPLES) {
+		a->samples = ADAPT_MIN_SAMPLES;
+	} else if (a->samples > a->max_samples) {
+		a->samples = a->max_samples;
+	}
+	return a;
+}
+
+void sysoff_adapt_destroy(struct sysoff_adapt *a)
+{
+	free(a);
+}
+
+int sysoff_adapt_samples(struct sysoff_adapt *a)
+{
+	return a->samples;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+	const int64_t *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y ? 1 : 0;
+}
+
+static int64_t percentile(struct sysoff_adapt *a, int pct)
+{
+	return a->sorted[(a->len - 1) * pct / 100];
+}
+
+static void adapt_samples(struct sysoff_adapt *a, int first, int n)
+{
+	int samples = a->samples;
+
+	/*
+	 * A good sample showing up only in the last quarter of a
+	 * measurement hints that more samples would find a better one.
+	 */
+	if (first >= n - n / 4) {
+		a->late++;
+	}
+	if (first + 1 > a->need) {
+		a->need = first + 1;
+	}
+	if (++a->block < ADAPT_BLOCK) {
+		return;
+	}
+	if (a->late >= ADAPT_MAX_LATE) {
+		samples += samples / 4 + 1;
+	} else if (a->need + 1 < samples) {
+		samples--;
+	}
+	if (samples < ADAPT_MIN_SAMPLES) {
+		samples = ADAPT_MIN_SAMPLES;
+	} else if (samples > a->max_samples) {
+		samples = a->max_samples;
+	}
+	if (samples != a->samples) {
+		pr_debug("sysoff: %d samples per measurement", samples);
+		a->samples = samples;
+	}
+	a->block = 0;
+	a->late = 0;
+	a->need = 0;
+}
+
+int sysoff_adapt_select(struct sysoff_adapt *a, int64_t *interval, int n)
+{
+	int64_t low, mid, high, jitter;
+	int i, best = 0, reject = 0;
+
+	for (i = 1; i < n; i++) {
+		if (interval[i] < interval[best]) {
+			best = i;
+		}
+	}
+
+	if (a->len >= ADAPT_BLOCK) {
+		memcpy(a->sorted, a->window, a->len * sizeof(a->window[0]));
+		qsort(a->sorted, a->len, sizeof(a->sorted[0]), cmp_int64);
+		low = percentile(a, ADAPT_LOW_PCT);
+		mid = percentile(a, ADAPT_MID_PCT);
+		high = percentile(a, ADAPT_HIGH_PCT);
+		jitter = mid - low;
+		a->stats.jitter = jitter;
+		a->stats.reject_limit = high + (high - low);
+
+		for (i = 0; i < n; i++) {
+			if (interval[i] <= interval[best] + jitter) {
+				break;
+			}
+		}
+		adapt_samples(a, i, n);
+		reject = interval[best] > a->stats.reject_limit;
+	}
+
+	a->window[a->head] = interval[best];
+	a->head = (a->head + 1) % ADAPT_WINDOW;
+	if (a->len < ADAPT_WINDOW) {
+		a->len++;
+	}
+
+	a->stats.measurements++;
+	a->samples_sum += n;
+	if (reject) {
+		a->stats.rejected++;
+		return -1;
+	}
+	return best;
+}
+
+void sysoff_adapt_stats(struct sysoff_adapt *a, struct sysoff_adapt_stats *s)
+{
+	*s = a->stats;
+	s->samples = a->stats.measurements ?
+		(double)a->samples_sum / a->stats.measurements : 0.0;
+	a->stats.measurements = 0;
+	a->stats.rejected = 0;
+	a->samples_sum = 0;
+}
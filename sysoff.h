@@ -22,6 +22,7 @@
 #include "missing.h"
 
 enum {
+	SYSOFF_REJECTED = -2,
 	SYSOFF_RUN_TIME_MISSING = -1,
 	SYSOFF_PRECISE,
 	SYSOFF_EXTENDED,
@@ -48,3 +49,73 @@ int sysoff_probe(int fd, int n_samples);
  */
 int sysoff_measure(int fd, int method, int n_samples,
 		   int64_t *result, uint64_t *ts, int64_t *delay);
+
+struct sysoff_adapt;
+
+struct sysoff_adapt_stats {
+	unsigned int measurements; /* since the last sysoff_adapt_stats() */
+	unsigned int rejected;	   /* likewise */
+	double samples;		   /* mean number of samples per measurement */
+	int64_t jitter;		   /* slack of a good sample over the best one */
+	int64_t reject_limit;	   /* best read interval of a rejected one */
+};
+
+/**
+ * Creates the state of the adaptive mode, in which the number of
+ * samples per measurement follows the distribution of the read
+ * intervals, and measurements whose best sample is far slower than
+ * usual are rejected.
+ * @param n_samples  The initial number of samples per reading.
+ * @return           A pointer to a new sysoff_adapt on success, NULL otherwise.
+ */
+struct sysoff_adapt *sysoff_adapt_create(int n_samples);
+
+/**
+ * Destroys the state of the adaptive mode.
+ * @param a  A pointer obtained via sysoff_adapt_create().
+ */
+void sysoff_adapt_destroy(struct sysoff_adapt *a);
+
+/**
+ * Returns the number of samples the next measurement should take.
+ * @param a  A pointer obtained via sysoff_adapt_create().
+ * @return   A number between 2 and PTP_MAX_SAMPLES.
+ */
+int sysoff_adapt_samples(struct sysoff_adapt *a);
+
+/**
+ * Picks the sample with the shortest read interval out of a
+ * measurement, learns from the intervals, and adjusts the number of
+ * samples.
+ * @param a         A pointer obtained via sysoff_adapt_create().
+ * @param interval  The read intervals of the samples in nanoseconds.
+ * @param n         The number of samples.
+ * @return          The index of the chosen sample, or -1 if the
+ *                  measurement is to be rejected.
+ */
+int sysoff_adapt_select(struct sysoff_adapt *a, int64_t *interval, int n);
+
+/**
+ * Returns the statistics of the adaptive mode and clears its counters.
+ * @param a  A pointer obtained via sysoff_adapt_create().
+ * @param s  Returns the statistics.
+ */
+void sysoff_adapt_stats(struct sysoff_adapt *a, struct sysoff_adapt_stats *s);
+
+/**
+ * Measure the offset between a PHC and the system time, optionally
+ * in the adaptive mode.
+ * @param fd         An open file descriptor to a PHC device.
+ * @param method     A non-negative SYSOFF_ value returned by sysoff_probe().
+ * @param n_samples  The number of consecutive readings to make, unless
+ *                   'adapt' is given.
+ * @param adapt      The state of the adaptive mode, or NULL.
+ * @param result     The estimated offset in nanoseconds.
+ * @param ts         The system time corresponding to the 'result'.
+ * @param delay      The delay in reading of the clock in nanoseconds.
+ * @return  One of the SYSOFF_ enumeration values. SYSOFF_REJECTED means
+ *          that the measurement was too slow to be trusted.
+ */
+int sysoff_measure_adaptive(int fd, int method, int n_samples,
+			    struct sysoff_adapt *adapt,
+			    int64_t *result, uint64_t *ts, int64_t *delay);
@@ -23,6 +23,9 @@
 #include "tc.h"
 #include "tmv.h"
 
+/* The most egress ports whose time stamps are gathered together. */
+#define TC_MAX_PORTS 64
+
 enum tc_match {
 	TC_MISMATCH,
 	TC_SYNC_FUP,
@@ -51,6 +54,59 @@ static struct tc_txd *tc_allocate(void)
 	return txd;
 }
 
+/*
+ * Hashes the fields that tc_match_syfup() and tc_match_delay() compare,
+ * so that a message and its mate always land in the same bucket.
+ */
+static struct tch *tc_bucket(struct port *p, int ingress_port,
+			     UInteger16 seqid, struct PortIdentity *pid)
+{
+	uint32_t h = 2166136261U;
+	unsigned char *buf;
+	unsigned int i;
+
+	h = (h ^ (ingress_port & 0xff)) * 16777619U;
+	h = (h ^ (ingress_port >> 8)) * 16777619U;
+	h = (h ^ (seqid & 0xff)) * 16777619U;
+	h = (h ^ (seqid >> 8)) * 16777619U;
+	buf = (unsigned char *) pid;
+	for (i = 0; i < sizeof(*pid); i++) {
+		h = (h ^ buf[i]) * 16777619U;
+	}
+	h ^= h >> 16;
+
+	return &p->tc_hash[h % TC_HASH_SIZE];
+}
+
+/* Remembers a message transmitted on port 'p' that came in on port 'q'. */
+static int tc_stash(struct port *q, struct port *p, struct ptp_message *msg,
+		    tmv_t residence)
+{
+	struct tc_txd *txd = tc_allocate();
+
+	if (!txd) {
+		return -1;
+	}
+	msg_get(msg);
+	txd->msg = msg;
+	txd->residence = residence;
+	txd->ingress_port = portnum(q);
+	TAILQ_INSERT_TAIL(&p->tc_transmitted, txd, list);
+	LIST_INSERT_HEAD(tc_bucket(p, txd->ingress_port,
+				   msg->header.sequenceId,
+				   &msg->header.sourcePortIdentity),
+			 txd, hash);
+	return 0;
+}
+
+static void tc_release(struct port *p, struct tc_txd *txd)
+{
+	TAILQ_REMOVE(&p->tc_transmitted, txd, list);
+	LIST_REMOVE(txd, hash);
+	msg_put(txd->msg);
+	tc_recycle(txd);
+}
+
 static int tc_blocked(struct port *q, struct port *p, struct ptp_message *m)
 {
 	enum port_state s;
@@ -120,21 +176,14 @@ static int tc_blocked(struct port *q, struct port *p, struct ptp_message *m)
 static void tc_complete_request(struct port *q, struct port *p,
 				struct ptp_message *req, tmv_t residence)
 {
-	struct tc_txd *txd = tc_allocate();
-	if (!txd) {
-		port_dispatch(p, EV_FAULT_DETECTED, 0);
-		return;
-	}
 #ifdef DEBUG
 	pr_err("stash delay request from port %hd to %hd seqid %hu residence %lu",
 	       portnum(q), portnum(p), ntohs(req->header.sequenceId),
 	       (unsigned long) tmv_to_nanoseconds(residence));
 #endif
-	msg_get(req);
-	txd->msg = req;
-	txd->residence = residence;
-	txd->ingress_port = portnum(q);
-	TAILQ_INSERT_TAIL(&p->tc_transmitted, txd, list);
+	if (tc_stash(q, p, req, residence)) {
+		port_dispatch(p, EV_FAULT_DETECTED, 0);
+	}
 }
 
 static void tc_complete_response(struct port *q, struct port *p,
@@ -149,7 +198,9 @@ static void tc_complete_response(struct port *q, struct port *p,
 	pr_err("complete delay response from port %hd to %hd seqid %hu",
 	       portnum(q), portnum(p), ntohs(resp->header.sequenceId));
 #endif
-	TAILQ_FOREACH(txd, &q->tc_transmitted, list) {
+	LIST_FOREACH(txd, tc_bucket(q, portnum(p), resp->header.sequenceId,
+				    &resp->delay_resp.requestingPortIdentity),
+		     hash) {
 		type = tc_match_delay(portnum(p), resp, txd);
 		if (type == TC_DELAY_REQRESP) {
 			residence = txd->residence;
@@ -169,9 +220,7 @@ static void tc_complete_response(struct port *q, struct port *p,
 	}
 	/* Restore original correction value for next egress port. */
 	resp->header.correction = host2net64(c1);
-	TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-	msg_put(txd->msg);
-	tc_recycle(txd);
+	tc_release(q, txd);
 }
 
 static void tc_complete_syfup(struct port *q, struct port *p,
@@ -183,7 +232,8 @@ static void tc_complete_syfup(struct port *q, struct port *p,
 	Integer64 c1, c2;
 	int cnt;
 
-	TAILQ_FOREACH(txd, &p->tc_transmitted, list) {
+	LIST_FOREACH(txd, tc_bucket(p, portnum(q), msg->header.sequenceId,
+				    &msg->header.sourcePortIdentity), hash) {
 		type = tc_match_syfup(portnum(q), msg, txd);
 		switch (type) {
 		case TC_MISMATCH:
@@ -205,16 +255,9 @@ static void tc_complete_syfup(struct port *q, struct port *p,
 	}
 
 	if (type == TC_MISMATCH) {
-		txd = tc_allocate();
-		if (!txd) {
+		if (tc_stash(q, p, msg, residence)) {
 			port_dispatch(p, EV_FAULT_DETECTED, 0);
-			return;
 		}
-		msg_get(msg);
-		txd->msg = msg;
-		txd->residence = residence;
-		txd->ingress_port = portnum(q);
-		TAILQ_INSERT_TAIL(&p->tc_transmitted, txd, list);
 		return;
 	}
 
@@ -230,9 +273,7 @@ static void tc_complete_syfup(struct port *q, struct port *p,
 	}
 	/* Restore original correction value for next egress port. */
 	fup->header.correction = host2net64(c1);
-	TAILQ_REMOVE(&p->tc_transmitted, txd, list);
-	msg_put(txd->msg);
-	tc_recycle(txd);
+	tc_release(p, txd);
 }
 
 static void tc_complete(struct port *q, struct port *p,
@@ -263,13 +304,89 @@ static int tc_current(struct ptp_message *m, struct timespec now)
 	return t2 - t1 < tmo;
 }
 
-static int tc_fwd_event(struct port *q, struct ptp_message *msg)
+static void tc_fwd_complete(struct port *q, struct port *p,
+			    struct ptp_message *msg, tmv_t ingress, tmv_t egress)
 {
-	tmv_t egress, ingress = msg->hwts.ts, residence;
-	struct port *p;
-	int cnt, err;
+	tmv_t residence;
 	double rr;
 
+	residence = tmv_sub(egress, ingress);
+	rr = clock_rate_ratio(q->clock);
+	if (rr != 1.0) {
+		residence = dbl_tmv(tmv_dbl(residence) * rr);
+	}
+	tc_complete(q, p, msg, residence);
+}
+
+static int tc_txts_complete(struct port *p, struct txts_slot *s, tmv_t ts)
+{
+	tc_fwd_complete(s->ingress, p, s->msg, s->msg->hwts.ts, ts);
+	return 0;
+}
+
+/*
+ * Waits for the transmit time stamps of the ports that have no time
+ * stamp table, completing each port as soon as its own time stamp
+ * shows up rather than in port order.
+ */
+static void tc_fwd_gather(struct port *q, struct ptp_message *msg,
+			  struct port **pending, int n)
+{
+	struct pollfd pfd[TC_MAX_PORTS];
+	struct timespec start, now;
+	tmv_t egress, ingress = msg->hwts.ts;
+	int cnt, err, i, left, tmo;
+
+	for (i = 0; i < n; i++) {
+		pfd[i].fd = pending[i]->fda.fd[FD_EVENT];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	left = n;
+
+	while (left) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		tmo = sk_tx_timeout - ((now.tv_sec - start.tv_sec) * 1000 +
+				       (now.tv_nsec - start.tv_nsec) / 1000000);
+		cnt = sk_poll_txts(pfd, n, tmo > 0 ? tmo : 0);
+		if (cnt < 1) {
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			if (!pfd[i].revents) {
+				continue;
+			}
+			/* Each port is only waited upon once. */
+			pfd[i].fd = -1;
+			left--;
+			err = transport_txts(&pending[i]->fda, msg);
+			if (err || !msg_sots_valid(msg)) {
+				pr_err("failed to fetch txts on port %hd to %hd event",
+				       portnum(q), portnum(pending[i]));
+				port_dispatch(pending[i], EV_FAULT_DETECTED, 0);
+				continue;
+			}
+			ts_add(&msg->hwts.ts, pending[i]->tx_timestamp_offset);
+			egress = msg->hwts.ts;
+			tc_fwd_complete(q, pending[i], msg, ingress, egress);
+		}
+		msg->hwts.ts = ingress;
+	}
+	for (i = 0; i < n; i++) {
+		if (pfd[i].fd < 0) {
+			continue;
+		}
+		pr_err("timed out fetching txts on port %hd to %hd event",
+		       portnum(q), portnum(pending[i]));
+		port_dispatch(pending[i], EV_FAULT_DETECTED, 0);
+	}
+}
+
+static int tc_fwd_event(struct port *q, struct ptp_message *msg)
+{
+	struct port *p, *pending[TC_MAX_PORTS];
+	struct txts_slot *s;
+	int cnt, n = 0;
+
 	clock_gettime(CLOCK_MONOTONIC, &msg->ts.host);
 
 	/* First send the event message out. */
@@ -282,31 +399,22 @@ static int tc_fwd_event(struct port *q, struct ptp_message *msg)
 			pr_err("failed to forward event from port %hd to %hd",
 				portnum(q), portnum(p));
 			port_dispatch(p, EV_FAULT_DETECTED, 0);
+		} else if (p->tx_async) {
+			s = port_txts_track(p, msg, tc_txts_complete);
+			s->ingress = q;
+		} else {
+			pending[n++] = p;
+			if (n == TC_MAX_PORTS) {
+				tc_fwd_gather(q, msg, pending, n);
+				n = 0;
+			}
 		}
 	}
 
-	/* Go back and gather the transmit time stamps. */
-	for (p = clock_first_port(q->clock); p; p = LIST_NEXT(p, list)) {
-		if (tc_blocked(q, p, msg)) {
-			continue;
-		}
-		err = transport_txts(&p->fda, msg);
-		if (err || !msg_sots_valid(msg)) {
-			pr_err("failed to fetch txts on port %hd to %hd event",
-				portnum(q), portnum(p));
-			port_dispatch(p, EV_FAULT_DETECTED, 0);
-			continue;
-		}
-		ts_add(&msg->hwts.ts, p->tx_timestamp_offset);
-		egress = msg->hwts.ts;
-		residence = tmv_sub(egress, ingress);
-		rr = clock_rate_ratio(q->clock);
-		if (rr != 1.0) {
-			residence = dbl_tmv(tmv_dbl(residence) * rr);
-		}
-		tc_complete(q, p, msg, residence);
+	/* Then gather the time stamps in whatever order they arrive. */
+	if (n) {
+		tc_fwd_gather(q, msg, pending, n);
 	}
-
 	return 0;
 }
 
@@ -374,9 +482,7 @@ void tc_flush(struct port *q)
 	struct tc_txd *txd;
 
 	while ((txd = TAILQ_FIRST(&q->tc_transmitted)) != NULL) {
-		TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-		msg_put(txd->msg);
-		tc_recycle(txd);
+		tc_release(q, txd);
 	}
 }
 
@@ -507,8 +613,6 @@ void tc_prune(struct port *q)
 		if (tc_current(txd->msg, now)) {
 			break;
 		}
-		TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-		msg_put(txd->msg);
-		tc_recycle(txd);
+		tc_release(q, txd);
 	}
 }
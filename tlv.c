@@ -25,6 +25,7 @@
 #include "port.h"
 #include "tlv.h"
 #include "msg.h"
+#include "util.h"
 
 #define HTONS(x) (x) = htons(x)
 #define HTONL(x) (x) = htonl(x)
@@ -39,6 +40,19 @@ uint8_t ieee8021_id[3] = { IEEE_802_1_COMMITTEE };
 static TAILQ_HEAD(tlv_pool, tlv_extra) tlv_pool =
 	TAILQ_HEAD_INITIALIZER(tlv_pool);
 
+#define TLV_ALIGN 64
+#define TLV_STRIDE \
+	((sizeof(struct tlv_extra) + TLV_ALIGN - 1) & ~(TLV_ALIGN - 1))
+
+static struct {
+	int total;
+	int count;
+	int capacity;
+	unsigned int exhausted;
+	void *slab;
+	size_t slab_len;
+} tlv_pool_stats;
+
 static void scaled_ns_n2h(ScaledNs *sns)
 {
 	sns->nanoseconds_msb = ntohs(sns->nanoseconds_msb);
@@ -110,6 +124,34 @@ static bool tlv_array_invalid(struct TLV *tlv, size_t base_size, size_t item_siz
 	return (tlv->length == expected_length) ? false : true;
 }
 
+/*
+ * Byte swaps the records of UNICAST_SERVICE_PACING_NP, which is the
+ * same operation in either direction, and returns their total length,
+ * or -1 if they overrun the given length.
+ */
+static int pacing_flip(struct unicast_service_pacing_np *usp, int n,
+		       int data_len)
+{
+	struct unicast_pacing_np *rec;
+	int i, j, len = sizeof(*usp);
+
+	for (i = 0; i < n; i++) {
+		rec = (struct unicast_pacing_np *) ((uint8_t *) usp + len);
+		if (len + (int) sizeof(*rec) > data_len) {
+			return -1;
+		}
+		len += sizeof(*rec) + rec->numberSlots * sizeof(rec->fanout[0]);
+		if (len > data_len) {
+			return -1;
+		}
+		rec->numberClients = ntohs(rec->numberClients);
+		for (j = 0; j < rec->numberSlots; j++) {
+			rec->fanout[j] = ntohs(rec->fanout[j]);
+		}
+	}
+	return len;
+}
+
 static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 			 struct tlv_extra *extra)
 {
@@ -121,9 +163,11 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 	struct port_ds_np *pdsnp;
 	struct time_status_np *tsn;
 	struct grandmaster_settings_np *gsn;
+	struct message_pool_np *mpn;
 	struct subscribe_events_np *sen;
 	struct port_properties_np *ppn;
 	struct port_stats_np *psn;
+	struct unicast_service_pacing_np *usp;
 	struct mgmt_clock_description *cd;
 	int extra_len = 0, len;
 	uint8_t *buf;
@@ -289,6 +333,19 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 		scaled_ns_n2h(&tsn->lastGmPhaseChange);
 		tsn->gmPresent = ntohl(tsn->gmPresent);
 		break;
+	case TLV_MESSAGE_POOL_NP:
+		if (data_len != sizeof(struct message_pool_np))
+			goto bad_length;
+		mpn = (struct message_pool_np *) m->data;
+		mpn->msg_capacity = ntohl(mpn->msg_capacity);
+		mpn->msg_total = ntohl(mpn->msg_total);
+		mpn->msg_free = ntohl(mpn->msg_free);
+		mpn->msg_exhausted = ntohl(mpn->msg_exhausted);
+		mpn->tlv_capacity = ntohl(mpn->tlv_capacity);
+		mpn->tlv_total = ntohl(mpn->tlv_total);
+		mpn->tlv_free = ntohl(mpn->tlv_free);
+		mpn->tlv_exhausted = ntohl(mpn->tlv_exhausted);
+		break;
 	case TLV_GRANDMASTER_SETTINGS_NP:
 		if (data_len != sizeof(struct grandmaster_settings_np))
 			goto bad_length;
@@ -326,6 +383,17 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 			ntohs(psn->portIdentity.portNumber);
 		extra_len = sizeof(struct port_stats_np);
 		break;
+	case TLV_UNICAST_SERVICE_PACING_NP:
+		if (data_len < sizeof(struct unicast_service_pacing_np))
+			goto bad_length;
+		usp = (struct unicast_service_pacing_np *) m->data;
+		usp->portIdentity.portNumber =
+			ntohs(usp->portIdentity.portNumber);
+		usp->numberIntervals = ntohs(usp->numberIntervals);
+		extra_len = pacing_flip(usp, usp->numberIntervals, data_len);
+		if (extra_len < 0)
+			goto bad_length;
+		break;
 	case TLV_SAVE_IN_NON_VOLATILE_STORAGE:
 	case TLV_RESET_NON_VOLATILE_STORAGE:
 	case TLV_INITIALIZE:
@@ -357,9 +425,11 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 	struct port_ds_np *pdsnp;
 	struct time_status_np *tsn;
 	struct grandmaster_settings_np *gsn;
+	struct message_pool_np *mpn;
 	struct subscribe_events_np *sen;
 	struct port_properties_np *ppn;
 	struct port_stats_np *psn;
+	struct unicast_service_pacing_np *usp;
 	struct mgmt_clock_description *cd;
 	switch (m->id) {
 	case TLV_CLOCK_DESCRIPTION:
@@ -413,6 +483,17 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 		scaled_ns_h2n(&tsn->lastGmPhaseChange);
 		tsn->gmPresent = htonl(tsn->gmPresent);
 		break;
+	case TLV_MESSAGE_POOL_NP:
+		mpn = (struct message_pool_np *) m->data;
+		mpn->msg_capacity = htonl(mpn->msg_capacity);
+		mpn->msg_total = htonl(mpn->msg_total);
+		mpn->msg_free = htonl(mpn->msg_free);
+		mpn->msg_exhausted = htonl(mpn->msg_exhausted);
+		mpn->tlv_capacity = htonl(mpn->tlv_capacity);
+		mpn->tlv_total = htonl(mpn->tlv_total);
+		mpn->tlv_free = htonl(mpn->tlv_free);
+		mpn->tlv_exhausted = htonl(mpn->tlv_exhausted);
+		break;
 	case TLV_GRANDMASTER_SETTINGS_NP:
 		gsn = (struct grandmaster_settings_np *) m->data;
 		gsn->clockQuality.offsetScaledLogVariance =
@@ -437,6 +518,13 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 		psn->portIdentity.portNumber =
 			htons(psn->portIdentity.portNumber);
 		break;
+	case TLV_UNICAST_SERVICE_PACING_NP:
+		usp = (struct unicast_service_pacing_np *) m->data;
+		pacing_flip(usp, usp->numberIntervals, m->length);
+		usp->portIdentity.portNumber =
+			htons(usp->portIdentity.portNumber);
+		usp->numberIntervals = htons(usp->numberIntervals);
+		break;
 	}
 }
 
@@ -785,8 +873,15 @@ struct tlv_extra *tlv_extra_alloc(void)
 
 	if (extra) {
 		TAILQ_REMOVE(&tlv_pool, extra, list);
+		tlv_pool_stats.count--;
+	} else if (tlv_pool_stats.slab) {
+		/* A fixed pool never grows. */
+		tlv_pool_stats.exhausted++;
 	} else {
 		extra = calloc(1, sizeof(*extra));
+		if (extra) {
+			tlv_pool_stats.total++;
+		}
 	}
 	return extra;
 }
@@ -795,16 +890,60 @@ void tlv_extra_cleanup(void)
 {
 	struct tlv_extra *extra;
 
+	if (tlv_pool_stats.slab) {
+		TAILQ_INIT(&tlv_pool);
+		slab_unmap(tlv_pool_stats.slab, tlv_pool_stats.slab_len);
+		memset(&tlv_pool_stats, 0, sizeof(tlv_pool_stats));
+		return;
+	}
 	while ((extra = TAILQ_FIRST(&tlv_pool)) != NULL) {
 		TAILQ_REMOVE(&tlv_pool, extra, list);
 		free(extra);
+		tlv_pool_stats.total--;
+		tlv_pool_stats.count--;
 	}
 }
 
+void tlv_extra_pool_stats(struct message_pool_np *mp)
+{
+	mp->tlv_capacity = tlv_pool_stats.capacity;
+	mp->tlv_total = tlv_pool_stats.total;
+	mp->tlv_free = tlv_pool_stats.count;
+	mp->tlv_exhausted = tlv_pool_stats.exhausted;
+}
+
 void tlv_extra_recycle(struct tlv_extra *extra)
 {
 	memset(extra, 0, sizeof(*extra));
 	TAILQ_INSERT_HEAD(&tlv_pool, extra, list);
+	tlv_pool_stats.count++;
+}
+
+int tlv_extra_reserve(int count, int flags)
+{
+	unsigned char *base;
+	size_t len;
+	int i;
+
+	if (!count || tlv_pool_stats.slab || tlv_pool_stats.total) {
+		return 0;
+	}
+	len = (size_t) count * TLV_STRIDE;
+	base = slab_map(&len, flags);
+	if (!base) {
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		TAILQ_INSERT_TAIL(&tlv_pool,
+				  (struct tlv_extra *) (base + i * TLV_STRIDE),
+				  list);
+	}
+	tlv_pool_stats.slab = base;
+	tlv_pool_stats.slab_len = len;
+	tlv_pool_stats.capacity = count;
+	tlv_pool_stats.total = count;
+	tlv_pool_stats.count = count;
+	return 0;
 }
 
 int tlv_post_recv(struct tlv_extra *extra)
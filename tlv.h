@@ -100,6 +100,8 @@ enum management_action {
 #define TLV_GRANDMASTER_SETTINGS_NP			0xC001
 #define TLV_SUBSCRIBE_EVENTS_NP				0xC003
 #define TLV_SYNCHRONIZATION_UNCERTAIN_NP		0xC006
+/* IDs from 0xC0F0 on are kept clear of those assigned upstream. */
+#define TLV_MESSAGE_POOL_NP				0xC0F0
 
 /* Port management ID values */
 #define TLV_NULL_MANAGEMENT				0x0000
@@ -125,6 +127,7 @@ enum management_action {
 #define TLV_PORT_DATA_SET_NP				0xC002
 #define TLV_PORT_PROPERTIES_NP				0xC004
 #define TLV_PORT_STATS_NP				0xC005
+#define TLV_UNICAST_SERVICE_PACING_NP			0xC0F1
 
 /* Management error ID values */
 #define TLV_RESPONSE_TOO_BIG				0x0001
@@ -324,6 +327,17 @@ struct grandmaster_settings_np {
 	Enumeration8 time_source;
 } PACKED;
 
+struct message_pool_np {
+	UInteger32    msg_capacity; /* zero when grown on demand */
+	UInteger32    msg_total;
+	UInteger32    msg_free;
+	UInteger32    msg_exhausted;
+	UInteger32    tlv_capacity; /* zero when grown on demand */
+	UInteger32    tlv_total;
+	UInteger32    tlv_free;
+	UInteger32    tlv_exhausted;
+} PACKED;
+
 struct port_ds_np {
 	UInteger32    neighborPropDelayThresh; /*nanoseconds*/
 	Integer32     asCapable;
@@ -349,6 +363,20 @@ struct port_stats_np {
 	struct PortStats stats;
 } PACKED;
 
+/* The clients of one message interval, counted per transmission slot. */
+struct unicast_pacing_np {
+	Integer8      logInterMessagePeriod;
+	UInteger8     numberSlots;
+	UInteger16    numberClients;
+	UInteger16    fanout[0];	/* numberSlots entries */
+} PACKED;
+
+struct unicast_service_pacing_np {
+	struct PortIdentity portIdentity;
+	UInteger16    numberIntervals;
+	Octet         data[0];	/* numberIntervals unicast_pacing_np records */
+} PACKED;
+
 #define PROFILE_ID_LEN 6
 
 struct mgmt_clock_description {
@@ -383,6 +411,21 @@ struct tlv_extra *tlv_extra_alloc(void);
  */
 void tlv_extra_cleanup(void);
 
+/**
+ * Preallocates a fixed number of tlv_extra structures. Once the cache
+ * is reserved, @ref tlv_extra_alloc() fails instead of growing it.
+ * @param count  The number of structures, or zero to grow on demand.
+ * @param flags  Bit mask of the SLAB_ flags from util.h.
+ * @return       Zero on success, non-zero otherwise.
+ */
+int tlv_extra_reserve(int count, int flags);
+
+/**
+ * Reports the occupancy of the tlv_extra cache.
+ * @param mp  Returns the TLV fields of the pool statistics.
+ */
+void tlv_extra_pool_stats(struct message_pool_np *mp);
+
 /**
  * Frees a tlv_extra structure.
  * @param extra  Pointer to the structure to free.
@@ -42,6 +42,32 @@ int transport_recv(struct transport *t, int fd, struct ptp_message *msg)
 	return t->recv(t, fd, msg, sizeof(msg->data), &msg->address, &msg->hwts);
 }
 
+int transport_recv_batch(struct transport *t, int fd,
+			 struct ptp_message **msg, int *cnt, int n)
+{
+	struct sk_rxbuf rx[SK_RX_BATCH_MAX];
+	int i, num;
+
+	if (!t->recv_batch || n < 2) {
+		cnt[0] = transport_recv(t, fd, msg[0]);
+		return cnt[0] < 0 ? cnt[0] : 1;
+	}
+	if (n > SK_RX_BATCH_MAX) {
+		n = SK_RX_BATCH_MAX;
+	}
+	for (i = 0; i < n; i++) {
+		rx[i].buf = msg[i];
+		rx[i].buflen = sizeof(msg[i]->data);
+		rx[i].addr = &msg[i]->address;
+		rx[i].hwts = &msg[i]->hwts;
+	}
+	num = t->recv_batch(t, fd, rx, n);
+	for (i = 0; i < num; i++) {
+		cnt[i] = rx[i].cnt;
+	}
+	return num;
+}
+
 int transport_send(struct transport *t, struct fdarray *fda,
 		   enum transport_event event, struct ptp_message *msg)
 {
@@ -66,6 +92,42 @@ int transport_sendto(struct transport *t, struct fdarray *fda,
 	return t->send(t, fda, event, 0, msg, len, &msg->address, &msg->hwts);
 }
 
+int transport_sendto_batch(struct transport *t, struct fdarray *fda,
+			   enum transport_event event,
+			   struct ptp_message **msg, int *cnt, int n)
+{
+	struct sk_txbuf tx[SK_TX_BATCH_MAX];
+	int i, num = 0;
+
+	if (n > SK_TX_BATCH_MAX) {
+		n = SK_TX_BATCH_MAX;
+	}
+	/*
+	 * Only those messages whose time stamps, if any, are collected
+	 * later on may share a system call.
+	 */
+	if (!t->send_batch ||
+	    (event != TRANS_GENERAL && event != TRANS_DEFER_EVENT)) {
+		for (i = 0; i < n; i++) {
+			cnt[i] = transport_sendto(t, fda, event, msg[i]);
+			if (cnt[i] > 0) {
+				num++;
+			}
+		}
+		return num;
+	}
+	for (i = 0; i < n; i++) {
+		tx[i].buf = msg[i];
+		tx[i].len = ntohs(msg[i]->header.messageLength);
+		tx[i].addr = &msg[i]->address;
+	}
+	num = t->send_batch(t, fda, event, tx, n);
+	for (i = 0; i < n; i++) {
+		cnt[i] = tx[i].cnt;
+	}
+	return num;
+}
+
 int transport_txts(struct fdarray *fda,
 		   struct ptp_message *msg)
 {
@@ -77,6 +139,12 @@ int transport_txts(struct fdarray *fda,
 	return cnt > 0 ? 0 : cnt;
 }
 
+int transport_txts_async(struct fdarray *fda, struct hw_timestamp *hwts,
+			 uint32_t *key)
+{
+	return sk_receive_txts(fda->fd[FD_EVENT], hwts, key);
+}
+
 int transport_physical_addr(struct transport *t, uint8_t *addr)
 {
 	if (t->physical_addr) {
@@ -62,6 +62,21 @@ int transport_open(struct transport *t, struct interface *iface,
 
 int transport_recv(struct transport *t, int fd, struct ptp_message *msg);
 
+/**
+ * Receives up to a given number of PTP messages with one system call,
+ * provided that the transport supports it. Otherwise, exactly one
+ * message is received just as with transport_recv().
+ * @param t    The transport.
+ * @param fd   The descriptor to read from.
+ * @param msg  Array of allocated messages to receive into.
+ * @param cnt  Array set to the length of each message received, or to
+ *             a negative error code for messages that were not valid.
+ * @param n    The number of entries in 'msg' and 'cnt'.
+ * @return     The number of messages received, or a negative error code.
+ */
+int transport_recv_batch(struct transport *t, int fd,
+			 struct ptp_message **msg, int *cnt, int n);
+
 /**
  * Sends the PTP message using the given transport. The message is sent to
  * the default (usually multicast) address, any address field in the
@@ -101,6 +116,22 @@ int transport_peer(struct transport *t, struct fdarray *fda,
 int transport_sendto(struct transport *t, struct fdarray *fda,
 		     enum transport_event event, struct ptp_message *msg);
 
+/**
+ * Sends a number of PTP messages, each to the address field of the
+ * message itself, using as few system calls as the transport allows.
+ * @param t	The transport.
+ * @param fda	The array of descriptors filled in by transport_open.
+ * @param event	One of the @ref transport_event enumeration values.
+ * @param msg	Array of messages to send.
+ * @param cnt	Array receiving the number of bytes sent for each message,
+ *		or a negative error code.
+ * @param n	Number of messages in 'msg', at most @ref SK_TX_BATCH_MAX.
+ * @return	The number of messages sent successfully.
+ */
+int transport_sendto_batch(struct transport *t, struct fdarray *fda,
+			   enum transport_event event,
+			   struct ptp_message **msg, int *cnt, int n);
+
 /**
  * Fetches the transmit time stamp for a PTP message that was sent
  * with the TRANS_DEFER_EVENT flag.
@@ -113,6 +144,22 @@ int transport_sendto(struct transport *t, struct fdarray *fda,
 int transport_txts(struct fdarray *fda,
 		   struct ptp_message *msg);
 
+/**
+ * Collects the next pending transmit time stamp, if any, without
+ * waiting for it. Only usable when the transport was opened while
+ * @ref sk_tx_async was enabled.
+ *
+ * @param fda	The array of descriptors filled in by transport_open.
+ * @param hwts	Receives the time stamp. The type field must be set
+ *              by the caller.
+ * @param key	Receives the SOF_TIMESTAMPING_OPT_ID key of the packet,
+ *              counting the event messages sent since transport_open.
+ * @return	Zero on success, -EAGAIN if no time stamp is pending, or
+ *              another negative value in case of an error.
+ */
+int transport_txts_async(struct fdarray *fda, struct hw_timestamp *hwts,
+			 uint32_t *key);
+
 /**
  * Returns the transport's type.
  */
@@ -24,6 +24,7 @@
 
 #include "address.h"
 #include "fd.h"
+#include "sk.h"
 #include "transport.h"
 
 struct transport {
@@ -38,10 +39,16 @@ struct transport {
 	int (*recv)(struct transport *t, int fd, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts);
 
+	int (*recv_batch)(struct transport *t, int fd,
+			  struct sk_rxbuf *rx, int n);
+
 	int (*send)(struct transport *t, struct fdarray *fda,
 		    enum transport_event event, int peer, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts);
 
+	int (*send_batch)(struct transport *t, struct fdarray *fda,
+			  enum transport_event event, struct sk_txbuf *tx, int n);
+
 	void (*release)(struct transport *t);
 
 	int (*physical_addr)(struct transport *t, uint8_t *addr);
@@ -95,39 +95,44 @@ static int clock_compute_state(struct ts2phc_private *priv,
 #define node_to_ts2phc(node) \
 	container_of(node, struct ts2phc_private, node)
 
-static int ts2phc_recv_subscribed(struct pmc_node *node,
-				  struct ptp_message *msg, int excluded)
+static void ts2phc_port_state(struct pmc_node *node,
+			      struct PortIdentity *pid, int state)
 {
 	struct ts2phc_private *priv = node_to_ts2phc(node);
-	int mgt_id, state;
-	struct portDS *pds;
 	struct port *port;
 	struct clock *clock;
 
+	port = port_get(priv, pid->portNumber);
+	if (!port) {
+		pr_info("received data for unknown port %s", pid2str(pid));
+		return;
+	}
+	state = normalize_state(state);
+	if (port->state != state) {
+		pr_info("port %s changed state", pid2str(pid));
+		port->state = state;
+		clock = port->clock;
+		state = clock_compute_state(priv, clock);
+		if (clock->state != state || clock->new_state) {
+			clock->new_state = state;
+			priv->state_changed = 1;
+		}
+	}
+}
+
+static int ts2phc_recv_subscribed(struct pmc_node *node,
+				  struct ptp_message *msg, int excluded)
+{
+	struct portDS *pds;
+	int mgt_id;
+
 	mgt_id = get_mgt_id(msg);
 	if (mgt_id == excluded)
 		return 0;
 	switch (mgt_id) {
 	case TLV_PORT_DATA_SET:
 		pds = get_mgt_data(msg);
-		port = port_get(priv, pds->portIdentity.portNumber);
-		if (!port) {
-			pr_info("received data for unknown port %s",
-				pid2str(&pds->portIdentity));
-			return 1;
-		}
-		state = normalize_state(pds->portState);
-		if (port->state != state) {
-			pr_info("port %s changed state",
-				pid2str(&pds->portIdentity));
-			port->state = state;
-			clock = port->clock;
-			state = clock_compute_state(priv, clock);
-			if (clock->state != state || clock->new_state) {
-				clock->new_state = state;
-				priv->state_changed = 1;
-			}
-		}
+		ts2phc_port_state(node, &pds->portIdentity, pds->portState);
 		return 1;
 	}
 	return 0;
@@ -663,6 +668,7 @@ int main(int argc, char *argv[])
 			ts2phc_cleanup(&priv);
 			return -1;
 		}
+		priv.node.port_state_changed = ts2phc_port_state;
 		err = auto_init_ports(&priv);
 		if (err) {
 			ts2phc_cleanup(&priv);
@@ -0,0 +1,342 @@
+/**
+ * @file  twheel.c
+ * @brief Implements a hierarchical timing wheel driven by one timerfd.
+ * @note  Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "missing.h"
+#include "print.h"
+#include "twheel.h"
+
+/*
+ * One tick is 2^16 nanoseconds, or about 65 microseconds. Each level
+ * covers 64 times the span of the level below it, so that six levels
+ * reach out to about 52 days.
+ */
+#define TW_TICK_SHIFT	16
+#define TW_TICK		(1ULL << TW_TICK_SHIFT)
+#define TW_BITS		6
+#define TW_SIZE		(1 << TW_BITS)
+#define TW_MASK		(TW_SIZE - 1)
+#define TW_LEVELS	6
+#define TW_MAX_DELTA	((1ULL << (TW_BITS * TW_LEVELS)) - 1)
+
+enum {
+	TW_IDLE,
+	TW_QUEUED,
+	TW_EXPIRED,
+};
+
+LIST_HEAD(tw_list, twheel_timer);
+
+struct twheel {
+	struct tw_list slot[TW_LEVELS][TW_SIZE];
+	/* Slots that might be occupied, cleared lazily. */
+	uint64_t occupied[TW_LEVELS];
+	struct tw_list expired;
+	/* The next tick to be processed. */
+	uint64_t tick;
+	/* The tick programmed into the timer, or zero if disarmed. */
+	uint64_t armed;
+	int pending;
+	int fd;
+};
+
+static uint64_t tw_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int tw_settime(struct twheel *w, uint64_t tick)
+{
+	struct itimerspec tmo;
+	uint64_t ns = tick << TW_TICK_SHIFT;
+
+	memset(&tmo, 0, sizeof(tmo));
+	tmo.it_value.tv_sec = ns / 1000000000ULL;
+	tmo.it_value.tv_nsec = ns % 1000000000ULL;
+	if (timerfd_settime(w->fd, TFD_TIMER_ABSTIME, &tmo, NULL)) {
+		pr_err("twheel: timerfd_settime failed: %m");
+		return -1;
+	}
+	w->armed = tick;
+	return 0;
+}
+
+static void tw_enqueue(struct twheel *w, struct twheel_timer *t)
+{
+	uint64_t delta;
+	int index, level;
+
+	delta = t->tick - w->tick;
+	if (delta > TW_MAX_DELTA) {
+		t->tick = w->tick + TW_MAX_DELTA;
+		delta = TW_MAX_DELTA;
+	}
+	for (level = 0; level < TW_LEVELS - 1; level++) {
+		if (delta < 1ULL << (TW_BITS * (level + 1))) {
+			break;
+		}
+	}
+	index = (t->tick >> (TW_BITS * level)) & TW_MASK;
+	LIST_INSERT_HEAD(&w->slot[level][index], t, list);
+	w->occupied[level] |= 1ULL << index;
+	t->state = TW_QUEUED;
+}
+
+/* Re-files the timers of a higher level slot once its time has come. */
+static void tw_cascade(struct twheel *w, int level, int index)
+{
+	struct twheel_timer *next, *t;
+
+	t = LIST_FIRST(&w->slot[level][index]);
+	LIST_INIT(&w->slot[level][index]);
+	w->occupied[level] &= ~(1ULL << index);
+
+	for (; t; t = next) {
+		next = LIST_NEXT(t, list);
+		tw_enqueue(w, t);
+	}
+}
+
+/* Finds the earliest tick among the timers of the given slot. */
+static int tw_slot_min(struct twheel *w, int level, int index, uint64_t *min)
+{
+	struct twheel_timer *t;
+
+	if (LIST_EMPTY(&w->slot[level][index])) {
+		w->occupied[level] &= ~(1ULL << index);
+		return 0;
+	}
+	LIST_FOREACH(t, &w->slot[level][index], list) {
+		if (t->tick < *min) {
+			*min = t->tick;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Finds the earliest deadline on the wheel. Within each level, the
+ * slots following the current position hold ever later timers, and
+ * so only the first occupied one need be searched. The current slot
+ * itself may hold timers of either this lap or the next one.
+ */
+static uint64_t tw_next(struct twheel *w)
+{
+	uint64_t bits, min = UINT64_MAX;
+	int index, level, pos, shift;
+
+	for (level = 0; level < TW_LEVELS; level++) {
+		pos = (w->tick >> (TW_BITS * level)) & TW_MASK;
+		tw_slot_min(w, level, pos, &min);
+		while (1) {
+			bits = w->occupied[level] & ~(1ULL << pos);
+			if (!bits) {
+				break;
+			}
+			shift = (pos + 1) & TW_MASK;
+			bits = (bits >> shift) | (bits << ((TW_SIZE - shift) & TW_MASK));
+			index = (pos + 1 + __builtin_ctzll(bits)) & TW_MASK;
+			if (tw_slot_min(w, level, index, &min)) {
+				break;
+			}
+		}
+	}
+	return min;
+}
+
+static int tw_program(struct twheel *w)
+{
+	struct itimerspec tmo;
+	uint64_t next;
+
+	if (!w->pending) {
+		if (!w->armed) {
+			return 0;
+		}
+		memset(&tmo, 0, sizeof(tmo));
+		w->armed = 0;
+		return timerfd_settime(w->fd, TFD_TIMER_ABSTIME, &tmo, NULL);
+	}
+	next = tw_next(w);
+	if (next == w->armed) {
+		return 0;
+	}
+	return tw_settime(w, next);
+}
+
+/* public methods */
+
+struct twheel *twheel_create(void)
+{
+	struct twheel *w;
+	int i, j;
+
+	w = calloc(1, sizeof(*w));
+	if (!w) {
+		return NULL;
+	}
+	for (i = 0; i < TW_LEVELS; i++) {
+		for (j = 0; j < TW_SIZE; j++) {
+			LIST_INIT(&w->slot[i][j]);
+		}
+	}
+	LIST_INIT(&w->expired);
+
+	w->fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (w->fd < 0) {
+		pr_err("twheel: timerfd_create failed: %m");
+		free(w);
+		return NULL;
+	}
+	w->tick = tw_now() >> TW_TICK_SHIFT;
+	return w;
+}
+
+void twheel_destroy(struct twheel *w)
+{
+	close(w->fd);
+	free(w);
+}
+
+int twheel_fd(struct twheel *w)
+{
+	return w->fd;
+}
+
+void twheel_timer_init(struct twheel_timer *t, struct twheel *w,
+		       void *owner, int id)
+{
+	memset(t, 0, sizeof(*t));
+	t->wheel = w;
+	t->owner = owner;
+	t->id = id;
+	t->state = TW_IDLE;
+}
+
+int twheel_arm(struct twheel_timer *t, uint64_t ns)
+{
+	if (!ns) {
+		twheel_cancel(t);
+		return 0;
+	}
+	return twheel_arm_abs(t, tw_now() + ns);
+}
+
+int twheel_arm_abs(struct twheel_timer *t, uint64_t expires)
+{
+	struct twheel *w = t->wheel;
+
+	if (!w) {
+		errno = EINVAL;
+		return -1;
+	}
+	twheel_cancel(t);
+	if (!expires) {
+		return 0;
+	}
+	/* Round up, so that timers never expire early. */
+	t->tick = (expires + TW_TICK - 1) >> TW_TICK_SHIFT;
+
+	if (!w->pending) {
+		w->tick = tw_now() >> TW_TICK_SHIFT;
+	}
+	if (t->tick < w->tick) {
+		LIST_INSERT_HEAD(&w->expired, t, list);
+		t->state = TW_EXPIRED;
+		return 0;
+	}
+	tw_enqueue(w, t);
+	w->pending++;
+
+	if (w->armed && w->armed <= t->tick) {
+		return 0;
+	}
+	return tw_settime(w, t->tick);
+}
+
+void twheel_cancel(struct twheel_timer *t)
+{
+	switch (t->state) {
+	case TW_QUEUED:
+		t->wheel->pending--;
+		/* fall through */
+	case TW_EXPIRED:
+		LIST_REMOVE(t, list);
+		break;
+	}
+	t->state = TW_IDLE;
+}
+
+int twheel_run(struct twheel *w)
+{
+	uint64_t bits, expirations, next, now;
+	struct twheel_timer *t;
+	int i, index;
+
+	if (read(w->fd, &expirations, sizeof(expirations)) < 0) {
+		pr_err("twheel: read failed: %m");
+		return -1;
+	}
+	w->armed = 0;
+	now = tw_now() >> TW_TICK_SHIFT;
+
+	while (w->pending && w->tick <= now) {
+		index = w->tick & TW_MASK;
+		if (!index) {
+			for (i = 1; i < TW_LEVELS; i++) {
+				index = (w->tick >> (TW_BITS * i)) & TW_MASK;
+				tw_cascade(w, i, index);
+				if (index) {
+					break;
+				}
+			}
+			index = 0;
+		}
+		while ((t = LIST_FIRST(&w->slot[0][index])) != NULL) {
+			LIST_REMOVE(t, list);
+			LIST_INSERT_HEAD(&w->expired, t, list);
+			t->state = TW_EXPIRED;
+			w->pending--;
+		}
+		w->occupied[0] &= ~(1ULL << index);
+
+		/* Skip ahead to the next occupied slot or the next lap. */
+		bits = index < TW_MASK ? w->occupied[0] >> (index + 1) : 0;
+		if (bits) {
+			next = w->tick + 1 + __builtin_ctzll(bits);
+		} else {
+			next = (w->tick | TW_MASK) + 1;
+		}
+		w->tick = next < now + 1 ? next : now + 1;
+	}
+	return tw_program(w);
+}
+
+struct twheel_timer *twheel_expired(struct twheel *w)
+{
+	return LIST_FIRST(&w->expired);
+}
@@ -0,0 +1,111 @@
+/**
+ * @file  twheel.h
+ * @brief Implements a hierarchical timing wheel driven by one timerfd.
+ * @note  Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
+ */
+#ifndef HAVE_TWHEEL_H
+#define HAVE_TWHEEL_H
+
+#include <stdint.h>
+#include <sys/queue.h>
+
+struct twheel;
+
+/*
+ * A timer behaves like a timerfd polled for POLLIN: once it expires,
+ * it stays on the wheel's list of expired timers until it is either
+ * armed again or canceled.
+ */
+struct twheel_timer {
+	LIST_ENTRY(twheel_timer) list;
+	struct twheel *wheel;
+	void *owner;
+	int id;
+	int state;
+	uint64_t tick;
+};
+
+/**
+ * Creates a new timing wheel.
+ * @return  A pointer to a new timing wheel on success, NULL otherwise.
+ */
+struct twheel *twheel_create(void);
+
+/**
+ * Destroys a timing wheel. All of its timers must have been canceled.
+ * @param w  A pointer obtained via twheel_create().
+ */
+void twheel_destroy(struct twheel *w);
+
+/**
+ * Obtains the timerfd that becomes readable whenever timers are due.
+ * @param w  A pointer obtained via twheel_create().
+ * @return   The wheel's file descriptor.
+ */
+int twheel_fd(struct twheel *w);
+
+/**
+ * Prepares a timer for use with a given wheel.
+ * @param t      The timer to initialize.
+ * @param w      A pointer obtained via twheel_create(), or NULL.
+ * @param owner  Opaque pointer for the use of the wheel's owner.
+ * @param id     Number for the use of the wheel's owner.
+ */
+void twheel_timer_init(struct twheel_timer *t, struct twheel *w,
+		       void *owner, int id);
+
+/**
+ * Arms a timer to expire after a given amount of time. A value of
+ * zero disarms the timer, just as with timerfd_settime(2).
+ * @param t   A timer initialized via twheel_timer_init().
+ * @param ns  The relative expiration time in nanoseconds.
+ * @return    Zero on success, non-zero otherwise.
+ */
+int twheel_arm(struct twheel_timer *t, uint64_t ns);
+
+/**
+ * Arms a timer to expire at a given time. A value of zero disarms the
+ * timer, just as with timerfd_settime(2).
+ * @param t        A timer initialized via twheel_timer_init().
+ * @param expires  The CLOCK_MONOTONIC expiration time in nanoseconds.
+ * @return         Zero on success, non-zero otherwise.
+ */
+int twheel_arm_abs(struct twheel_timer *t, uint64_t expires);
+
+/**
+ * Disarms a timer and clears its expiration, if any.
+ * @param t  A timer initialized via twheel_timer_init().
+ */
+void twheel_cancel(struct twheel_timer *t);
+
+/**
+ * Moves all of the timers that are due onto the list of expired
+ * timers. Call this when the wheel's file descriptor is readable.
+ * @param w  A pointer obtained via twheel_create().
+ * @return   Zero on success, non-zero otherwise.
+ */
+int twheel_run(struct twheel *w);
+
+/**
+ * Obtains the first expired timer. The others follow via their list
+ * entries.
+ * @param w  A pointer obtained via twheel_create().
+ * @return   The first expired timer, or NULL if there are none.
+ */
+struct twheel_timer *twheel_expired(struct twheel *w);
+
+#endif
@@ -91,7 +91,7 @@ static int udp_close(struct transport *t, struct fdarray *fda)
 }
 
 static int open_socket(const char *name, struct in_addr mc_addr[2], short port,
-		       int ttl)
+		       int ttl, int reuseport)
 {
 	struct sockaddr_in addr;
 	int fd, index, on = 1;
@@ -114,14 +114,26 @@ static int open_socket(const char *name, struct in_addr mc_addr[2], short port,
 		pr_err("setsockopt SO_REUSEADDR failed: %m");
 		goto no_option;
 	}
-	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr))) {
-		pr_err("bind failed: %m");
+	if (reuseport &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) {
+		pr_err("setsockopt SO_REUSEPORT failed: %m");
 		goto no_option;
 	}
+	/*
+	 * Bind to the device first, so that the SO_REUSEPORT group is
+	 * private to this port, with this socket as its first member.
+	 */
 	if (setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, name, strlen(name))) {
 		pr_err("setsockopt SO_BINDTODEVICE failed: %m");
 		goto no_option;
 	}
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		pr_err("bind failed: %m");
+		goto no_option;
+	}
+	if (reuseport && sk_reuseport_steer(fd, 0)) {
+		goto no_option;
+	}
 	if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl))) {
 		pr_err("setsockopt IP_MULTICAST_TTL failed: %m");
 		goto no_option;
@@ -156,9 +168,11 @@ static int udp_open(struct transport *t, struct interface *iface,
 	struct udp *udp = container_of(t, struct udp, t);
 	const char *name = interface_name(iface);
 	uint8_t event_dscp, general_dscp;
-	int efd, gfd, ttl;
+	int efd, gfd, reuseport, ttl;
 
 	ttl = config_get_int(t->cfg, name, "udp_ttl");
+	reuseport = config_get_int(t->cfg, name, "unicast_listen") &&
+		config_get_int(t->cfg, name, "unicast_service_threads");
 	udp->mac.len = 0;
 	sk_interface_macaddr(name, &udp->mac);
 
@@ -171,11 +185,11 @@ static int udp_open(struct transport *t, struct interface *iface,
 	if (!inet_aton(PTP_PDELAY_MCAST_IPADDR, &mcast_addr[MC_PDELAY]))
 		return -1;
 
-	efd = open_socket(name, mcast_addr, EVENT_PORT, ttl);
+	efd = open_socket(name, mcast_addr, EVENT_PORT, ttl, reuseport);
 	if (efd < 0)
 		goto no_event;
 
-	gfd = open_socket(name, mcast_addr, GENERAL_PORT, ttl);
+	gfd = open_socket(name, mcast_addr, GENERAL_PORT, ttl, reuseport);
 	if (gfd < 0)
 		goto no_general;
 
@@ -213,6 +227,12 @@ static int udp_recv(struct transport *t, int fd, void *buf, int buflen,
 	return sk_receive(fd, buf, buflen, addr, hwts, MSG_DONTWAIT);
 }
 
+static int udp_recv_batch(struct transport *t, int fd,
+			  struct sk_rxbuf *rx, int n)
+{
+	return sk_receive_batch(fd, rx, n);
+}
+
 static int udp_send(struct transport *t, struct fdarray *fda,
 		    enum transport_event event, int peer, void *buf, int len,
 		    struct address *addr, struct hw_timestamp *hwts)
@@ -264,6 +284,19 @@ static int udp_send(struct transport *t, struct fdarray *fda,
 	return event == TRANS_EVENT ? sk_receive(fd, junk, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
 }
 
+static int udp_send_batch(struct transport *t, struct fdarray *fda,
+			  enum transport_event event, struct sk_txbuf *tx, int n)
+{
+	int fd, i;
+
+	fd = event == TRANS_GENERAL ? fda->fd[FD_GENERAL] : fda->fd[FD_EVENT];
+
+	for (i = 0; i < n; i++) {
+		tx[i].addr->sin.sin_port = htons(event ? EVENT_PORT : GENERAL_PORT);
+	}
+	return sk_send_batch(fd, tx, n);
+}
+
 static void udp_release(struct transport *t)
 {
 	struct udp *udp = container_of(t, struct udp, t);
@@ -302,7 +335,9 @@ struct transport *udp_transport_create(void)
 	udp->t.close = udp_close;
 	udp->t.open  = udp_open;
 	udp->t.recv  = udp_recv;
+	udp->t.recv_batch = udp_recv_batch;
 	udp->t.send  = udp_send;
+	udp->t.send_batch = udp_send_batch;
 	udp->t.release = udp_release;
 	udp->t.physical_addr = udp_physical_addr;
 	udp->t.protocol_addr = udp_protocol_addr;
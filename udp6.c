@@ -102,7 +102,7 @@ static int udp6_close(struct transport *t, struct fdarray *fda)
 }
 
 static int open_socket_ipv6(const char *name, struct in6_addr mc_addr[2], short port,
-			    int *interface_index, int hop_limit)
+			    int *interface_index, int hop_limit, int reuseport)
 {
 	struct sockaddr_in6 addr;
 	int fd, index, on = 1;
@@ -127,14 +127,26 @@ static int open_socket_ipv6(const char *name, struct in6_addr mc_addr[2], short
 		pr_err("setsockopt SO_REUSEADDR failed: %m");
 		goto no_option;
 	}
-	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr))) {
-		pr_err("bind failed: %m");
+	if (reuseport &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))) {
+		pr_err("setsockopt SO_REUSEPORT failed: %m");
 		goto no_option;
 	}
+	/*
+	 * Bind to the device first, so that the SO_REUSEPORT group is
+	 * private to this port, with this socket as its first member.
+	 */
 	if (setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, name, strlen(name))) {
 		pr_err("setsockopt SO_BINDTODEVICE failed: %m");
 		goto no_option;
 	}
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		pr_err("bind failed: %m");
+		goto no_option;
+	}
+	if (reuseport && sk_reuseport_steer(fd, 0)) {
+		goto no_option;
+	}
 	if (setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hop_limit,
 		       sizeof(hop_limit))) {
 		pr_err("setsockopt IPV6_MULTICAST_HOPS failed: %m");
@@ -166,9 +178,11 @@ static int udp6_open(struct transport *t, struct interface *iface,
 	struct udp6 *udp6 = container_of(t, struct udp6, t);
 	const char *name = interface_name(iface);
 	uint8_t event_dscp, general_dscp;
-	int efd, gfd, hop_limit;
+	int efd, gfd, hop_limit, reuseport;
 
 	hop_limit = config_get_int(t->cfg, name, "udp_ttl");
+	reuseport = config_get_int(t->cfg, name, "unicast_listen") &&
+		config_get_int(t->cfg, name, "unicast_service_threads");
 	udp6->mac.len = 0;
 	sk_interface_macaddr(name, &udp6->mac);
 
@@ -187,12 +201,12 @@ static int udp6_open(struct transport *t, struct interface *iface,
 		return -1;
 
 	efd = open_socket_ipv6(name, udp6->mc6_addr, EVENT_PORT, &udp6->index,
-			       hop_limit);
+			       hop_limit, reuseport);
 	if (efd < 0)
 		goto no_event;
 
 	gfd = open_socket_ipv6(name, udp6->mc6_addr, GENERAL_PORT, &udp6->index,
-			       hop_limit);
+			       hop_limit, reuseport);
 	if (gfd < 0)
 		goto no_general;
 
@@ -230,6 +244,12 @@ static int udp6_recv(struct transport *t, int fd, void *buf, int buflen,
 	return sk_receive(fd, buf, buflen, addr, hwts, MSG_DONTWAIT);
 }
 
+static int udp6_recv_batch(struct transport *t, int fd,
+			  struct sk_rxbuf *rx, int n)
+{
+	return sk_receive_batch(fd, rx, n);
+}
+
 static int udp6_send(struct transport *t, struct fdarray *fda,
 		     enum transport_event event, int peer, void *buf, int len,
 		     struct address *addr, struct hw_timestamp *hwts)
@@ -279,6 +299,20 @@ static int udp6_send(struct transport *t, struct fdarray *fda,
 	return event == TRANS_EVENT ? sk_receive(fd, junk, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
 }
 
+static int udp6_send_batch(struct transport *t, struct fdarray *fda,
+			   enum transport_event event, struct sk_txbuf *tx, int n)
+{
+	int fd, i;
+
+	fd = event == TRANS_GENERAL ? fda->fd[FD_GENERAL] : fda->fd[FD_EVENT];
+
+	for (i = 0; i < n; i++) {
+		tx[i].addr->sin6.sin6_port = htons(event ? EVENT_PORT : GENERAL_PORT);
+		tx[i].len += 2; /* for UDP checksum corrections */
+	}
+	return sk_send_batch(fd, tx, n);
+}
+
 static void udp6_release(struct transport *t)
 {
 	struct udp6 *udp6 = container_of(t, struct udp6, t);
@@ -318,7 +352,9 @@ struct transport *udp6_transport_create(void)
 	udp6->t.close   = udp6_close;
 	udp6->t.open    = udp6_open;
 	udp6->t.recv    = udp6_recv;
+	udp6->t.recv_batch = udp6_recv_batch;
 	udp6->t.send    = udp6_send;
+	udp6->t.send_batch = udp6_send_batch;
 	udp6->t.release = udp6_release;
 	udp6->t.physical_addr = udp6_physical_addr;
 	udp6->t.protocol_addr = udp6_protocol_addr;
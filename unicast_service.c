@@ -29,29 +29,59 @@
 #include "pqueue.h"
 #include "print.h"
 #include "unicast_service.h"
+#include "unicast_shard.h"
 #include "util.h"
 
 #define QUEUE_LEN 16
+#define MAX_SLOTS 64
+#define CLIENT_HASH_BITS 12
+#define CLIENT_HASH_SIZE (1 << CLIENT_HASH_BITS)
+#define MAX_SHARDS 64
 
 struct unicast_client_address {
 	LIST_ENTRY(unicast_client_address) list;
+	LIST_ENTRY(unicast_client_address) hash;
+	struct unicast_service_interval *interval;
 	struct PortIdentity portIdentity;
 	unsigned int message_types;
+	int shard;
+	int slot;
 	struct address addr;
 	time_t grant_tmo;
+	/* The deadline under which the record is filed for expiry. */
+	time_t expiry;
+	/* The position of the record in the expiry queue. */
+	int expiry_pos;
 };
 
+/*
+ * The clients of an interval are spread over a number of slots, each
+ * served in turn at its own fraction of the message period.
+ */
 struct unicast_service_interval {
-	LIST_HEAD(uca, unicast_client_address) clients;
+	LIST_HEAD(uca, unicast_client_address) clients[MAX_SLOTS];
+	int fanout[MAX_SLOTS];
 	LIST_ENTRY(unicast_service_interval) list;
 	struct timespec incr;
 	struct timespec tmo;
 	int log_period;
+	int nclients;
+	int nslots;
+	int slot;
 };
 
 struct unicast_service {
 	LIST_HEAD(usi, unicast_service_interval) intervals;
+	/* Every client record, indexed by the client's address. */
+	LIST_HEAD(uch, unicast_client_address) clients[CLIENT_HASH_SIZE];
 	struct pqueue *queue;
+	/* Every client record, ordered by grant deadline. */
+	struct pqueue *expiry;
+	int nslots;
+	/* Transmit threads, each serving a fixed share of the clients. */
+	struct unicast_shard *shard[MAX_SHARDS];
+	int nshards;
+	int next_shard;
 };
 
 static struct timespec log_to_timespec(int log_seconds);
@@ -80,6 +110,83 @@ static int attach_grant(struct ptp_message *msg,
 	return 0;
 }
 
+/*
+ * Hashes the part of the address that addreq() compares, so that all
+ * of the records of one client land in the same bucket.
+ */
+static struct uch *client_bucket(struct port *p, struct address *a)
+{
+	uint32_t h = 2166136261U;
+	unsigned char *buf;
+	int i, len;
+
+	switch (transport_type(p->trp)) {
+	case TRANS_UDP_IPV4:
+		buf = (unsigned char *) &a->sin.sin_addr;
+		len = sizeof(a->sin.sin_addr);
+		break;
+	case TRANS_UDP_IPV6:
+		buf = (unsigned char *) &a->sin6.sin6_addr;
+		len = sizeof(a->sin6.sin6_addr);
+		break;
+	case TRANS_IEEE_802_3:
+		buf = (unsigned char *) &a->sll.sll_addr;
+		len = MAC_LEN;
+		break;
+	default:
+		len = 0;
+		break;
+	}
+	for (i = 0; i < len; i++) {
+		h = (h ^ buf[i]) * 16777619U;
+	}
+	h ^= h >> CLIENT_HASH_BITS;
+
+	return &p->unicast_service->clients[h & (CLIENT_HASH_SIZE - 1)];
+}
+
+static void client_free(struct unicast_client_address *client)
+{
+	client->interval->fanout[client->slot]--;
+	client->interval->nclients--;
+	LIST_REMOVE(client, list);
+	LIST_REMOVE(client, hash);
+	free(client);
+}
+
+/*
+ * Retires a client record ahead of its deadline, taking it off the
+ * expiry queue so that grant/cancel churn does not pile up records.
+ */
+static void client_drop(struct port *p, struct unicast_client_address *client)
+{
+	pqueue_remove(p->unicast_service->expiry, client);
+	client_free(client);
+}
+
+static int compare_expiry(void *ain, void *bin)
+{
+	struct unicast_client_address *a, *b;
+
+	a = (struct unicast_client_address *) ain;
+	b = (struct unicast_client_address *) bin;
+
+	if (a->expiry < b->expiry) {
+		return 1;
+	}
+	if (b->expiry < a->expiry) {
+		return -1;
+	}
+	return 0;
+}
+
+static int *expiry_position(void *d)
+{
+	struct unicast_client_address *client = d;
+
+	return &client->expiry_pos;
+}
+
 static int compare_timeout(void *ain, void *bin)
 {
 	struct unicast_service_interval *a, *b;
@@ -91,14 +198,43 @@ static int compare_timeout(void *ain, void *bin)
 }
 
 static void initialize_interval(struct unicast_service_interval *interval,
-				int log_period)
+				int log_period, int nslots)
 {
-	LIST_INIT(&interval->clients);
-	interval->incr = log_to_timespec(log_period);
+	struct timespec period;
+	uint64_t ns;
+	int i;
+
+	for (i = 0; i < MAX_SLOTS; i++) {
+		LIST_INIT(&interval->clients[i]);
+	}
+	/* Each slot gets an equal share of the message period. */
+	period = log_to_timespec(log_period);
+	ns = (period.tv_sec * NS_PER_SEC + period.tv_nsec) / nslots;
+	interval->incr.tv_sec = ns / NS_PER_SEC;
+	interval->incr.tv_nsec = ns % NS_PER_SEC;
 	clock_gettime(CLOCK_MONOTONIC, &interval->tmo);
 	interval->tmo.tv_nsec += 10000000;
 	timespec_normalize(&interval->tmo);
 	interval->log_period = log_period;
+	interval->nslots = nslots;
+}
+
+static void interval_add_client(struct unicast_service_interval *interval,
+				struct unicast_client_address *client)
+{
+	int i, slot = 0;
+
+	/* Place the new client into the least crowded slot. */
+	for (i = 1; i < interval->nslots; i++) {
+		if (interval->fanout[i] < interval->fanout[slot]) {
+			slot = i;
+		}
+	}
+	client->interval = interval;
+	client->slot = slot;
+	interval->fanout[slot]++;
+	interval->nclients++;
+	LIST_INSERT_HEAD(&interval->clients[slot], client, list);
 }
 
 static void interval_increment(struct unicast_service_interval *i)
@@ -157,29 +293,100 @@ static void timespec_normalize(struct timespec *ts)
 	}
 }
 
+/*
+ * Hands the clients of the current slot over to the transmit threads.
+ * The messages are built once, and the threads fill in the address
+ * and sequence number of each client.
+ */
+static int unicast_service_shard_clients(struct port *p,
+					 struct unicast_service_interval *interval)
+{
+	struct ptp_message *announce = NULL, *fup = NULL, *sync = NULL;
+	struct unicast_service *srv = p->unicast_service;
+	struct unicast_client_address *client;
+	UInteger16 announce_seq, sync_seq;
+	int err = 0, i;
+
+	client = LIST_FIRST(&interval->clients[interval->slot]);
+	if (!client || !port_capable(p)) {
+		return 0;
+	}
+	announce = port_announce_create(p, &client->addr);
+	if (!announce) {
+		return -1;
+	}
+	if (!port_sync_incapable(p)) {
+		sync = port_sync_create(p, &client->addr);
+		if (!sync) {
+			err = -1;
+			goto out;
+		}
+		if (msg_pre_send(sync)) {
+			err = -1;
+			goto out;
+		}
+		fup = port_followup_create(p, sync);
+		if (!fup || msg_pre_send(fup)) {
+			err = -1;
+			goto out;
+		}
+	}
+	if (msg_pre_send(announce)) {
+		err = -1;
+		goto out;
+	}
+	for (i = 0; i < srv->nshards; i++) {
+		unicast_shard_begin(srv->shard[i], announce, sync, fup);
+	}
+	LIST_FOREACH(client, &interval->clients[interval->slot], list) {
+		announce_seq = sync_seq = 0;
+		if (client->message_types & (1 << ANNOUNCE)) {
+			announce_seq = p->seqnum.announce++;
+		}
+		if (sync && client->message_types & (1 << SYNC)) {
+			sync_seq = p->seqnum.sync++;
+		}
+		if (unicast_shard_add(srv->shard[client->shard], &client->addr,
+				      announce_seq, sync_seq,
+				      sync ? client->message_types :
+				      client->message_types & ~(1 << SYNC))) {
+			err = -1;
+		}
+	}
+	for (i = 0; i < srv->nshards; i++) {
+		if (unicast_shard_end(srv->shard[i])) {
+			err = -1;
+		}
+		unicast_shard_stats(srv->shard[i], &p->stats);
+	}
+out:
+	msg_put(announce);
+	if (sync) {
+		msg_put(sync);
+	}
+	if (fup) {
+		msg_put(fup);
+	}
+	return err;
+}
+
 static int unicast_service_clients(struct port *p,
 				   struct unicast_service_interval *interval)
 {
-	struct unicast_client_address *client, *next;
-	struct timespec now;
+	struct unicast_client_address *client;
 	int err = 0;
 
-	err = clock_gettime(CLOCK_MONOTONIC, &now);
-	if (err) {
-		pr_err("clock_gettime failed: %m");
-		return err;
+	pr_debug("interval 2^%d slot %d of %d serves %d clients",
+		 interval->log_period, interval->slot, interval->nslots,
+		 interval->fanout[interval->slot]);
+
+	if (p->unicast_service->shard[0]) {
+		return unicast_service_shard_clients(p, interval);
 	}
-	LIST_FOREACH_SAFE(client, &interval->clients, list, next) {
+
+	LIST_FOREACH(client, &interval->clients[interval->slot], list) {
 		pr_debug("%s wants 0x%x", pid2str(&client->portIdentity),
 			 client->message_types);
-		if (now.tv_sec > client->grant_tmo) {
-			pr_debug("%s service of 0x%x expired",
-				 pid2str(&client->portIdentity),
-				 client->message_types);
-			LIST_REMOVE(client, list);
-			free(client);
-			continue;
-		}
 		if (client->message_types & (1 << ANNOUNCE)) {
 			if (port_tx_announce(p, &client->addr)) {
 				err = -1;
@@ -215,23 +422,56 @@ static void unicast_service_extend(struct unicast_client_address *client,
 	}
 }
 
+/*
+ * Removes the records whose grants have run out, re-filing those that
+ * were extended in the meantime.
+ */
+static void unicast_service_reap(struct port *p, struct timespec *now)
+{
+	struct unicast_client_address *client;
+
+	while ((client = pqueue_peek(p->unicast_service->expiry)) != NULL) {
+		if (now->tv_sec <= client->expiry) {
+			break;
+		}
+		client = pqueue_extract(p->unicast_service->expiry);
+
+		if (now->tv_sec <= client->grant_tmo) {
+			client->expiry = client->grant_tmo;
+			/* There is room for it, having just been extracted. */
+			pqueue_insert(p->unicast_service->expiry, client);
+			continue;
+		}
+		pr_debug("%s service of 0x%x expired",
+			 pid2str(&client->portIdentity), client->message_types);
+		client_free(client);
+	}
+}
+
 static int unicast_service_rearm_timer(struct port *p)
 {
 	struct unicast_service_interval *interval;
-	struct itimerspec tmo;
-	int fd;
+	struct unicast_client_address *client;
+	uint64_t expiry, tmo = 0;
 
-	fd = p->fda.fd[FD_UNICAST_SRV_TIMER];
-	memset(&tmo, 0, sizeof(tmo));
 	interval = pqueue_peek(p->unicast_service->queue);
 	if (interval) {
-		tmo.it_value = interval->tmo;
+		tmo = interval->tmo.tv_sec * NS_PER_SEC + interval->tmo.tv_nsec;
+	}
+	client = pqueue_peek(p->unicast_service->expiry);
+	if (client) {
+		expiry = (client->expiry + 1) * NS_PER_SEC;
+		if (!tmo || expiry < tmo) {
+			tmo = expiry;
+		}
+	}
+	if (tmo) {
 		pr_debug("arming timer tmo={%lld,%ld}",
-			 (long long)interval->tmo.tv_sec, interval->tmo.tv_nsec);
+			 (long long)(tmo / NS_PER_SEC), (long)(tmo % NS_PER_SEC));
 	} else {
 		pr_debug("stopping unicast service timer");
 	}
-	return timerfd_settime(fd, TFD_TIMER_ABSTIME, &tmo, NULL);
+	return twheel_arm_abs(port_timer(p, FD_UNICAST_SRV_TIMER), tmo);
 }
 
 static int unicast_service_reply(struct port *p, struct ptp_message *dst,
@@ -259,6 +499,41 @@ out:
 	return err;
 }
 
+/*
+ * The transmit threads share the port's UDP ports, and they only know
+ * how to send two step Sync messages without any extra TLVs.
+ */
+static int unicast_service_threads_ok(struct port *p)
+{
+	struct config *cfg = clock_config(p->clock);
+
+	switch (transport_type(p->trp)) {
+	case TRANS_UDP_IPV4:
+	case TRANS_UDP_IPV6:
+		break;
+	default:
+		pr_err("port %hu: unicast_service_threads requires UDP",
+		       portnum(p));
+		return 0;
+	}
+	switch (p->timestamping) {
+	case TS_SOFTWARE:
+	case TS_HARDWARE:
+	case TS_LEGACY_HW:
+		break;
+	default:
+		pr_err("port %hu: unicast_service_threads requires "
+		       "two step time stamping", portnum(p));
+		return 0;
+	}
+	if (config_get_int(cfg, p->name, "follow_up_info")) {
+		pr_err("port %hu: unicast_service_threads does not support "
+		       "follow_up_info", portnum(p));
+		return 0;
+	}
+	return 1;
+}
+
 /* public methods */
 
 int unicast_service_add(struct port *p, struct ptp_message *m,
@@ -267,6 +542,7 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 	struct unicast_client_address *client = NULL, *ctmp, *next;
 	struct unicast_service_interval *interval = NULL, *itmp;
 	struct request_unicast_xmit_tlv *req;
+	struct uch *bucket;
 	unsigned int mask;
 	uint8_t mtype;
 
@@ -290,36 +566,33 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 	}
 
 	LIST_FOREACH(itmp, &p->unicast_service->intervals, list) {
-		/*
-		 * Remember the interval of interest.
-		 */
 		if (itmp->log_period == req->logInterMessagePeriod) {
 			interval = itmp;
+			break;
 		}
-		/*
-		 * Find any client records, and remove any stale contract.
-		 */
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, next) {
-			if (!addreq(transport_type(p->trp),
-				    &ctmp->addr, &m->address)) {
-				continue;
-			}
-			if (interval == itmp) {
-				if (ctmp->message_types & mask) {
-					/* Contract is unchanged. */
-					unicast_service_extend(ctmp, req);
-					return SERVICE_GRANTED;
-				}
-				/* This is the one to use. */
-				client = ctmp;
-				continue;
-			}
-			/* Clear any stale contracts. */
-			ctmp->message_types &= ~mask;
-			if (!ctmp->message_types) {
-				LIST_REMOVE(ctmp, list);
-				free(ctmp);
+	}
+	/*
+	 * Find any client records, and remove any stale contract.
+	 */
+	bucket = client_bucket(p, &m->address);
+	LIST_FOREACH_SAFE(ctmp, bucket, hash, next) {
+		if (!addreq(transport_type(p->trp), &ctmp->addr, &m->address)) {
+			continue;
+		}
+		if (ctmp->interval == interval) {
+			if (ctmp->message_types & mask) {
+				/* Contract is unchanged. */
+				unicast_service_extend(ctmp, req);
+				return SERVICE_GRANTED;
 			}
+			/* This is the one to use. */
+			client = ctmp;
+			continue;
+		}
+		/* Clear any stale contracts. */
+		ctmp->message_types &= ~mask;
+		if (!ctmp->message_types) {
+			client_drop(p, ctmp);
 		}
 	}
 
@@ -336,44 +609,59 @@ int unicast_service_add(struct port *p, struct ptp_message *m,
 	client->portIdentity = m->header.sourcePortIdentity;
 	client->message_types = mask;
 	client->addr = m->address;
+	if (p->unicast_service->nshards) {
+		client->shard = p->unicast_service->next_shard++ %
+			p->unicast_service->nshards;
+	}
 	unicast_service_extend(client, req);
+	client->expiry = client->grant_tmo;
+
+	if (pqueue_insert(p->unicast_service->expiry, client)) {
+		free(client);
+		return SERVICE_DENIED;
+	}
 
 	if (!interval) {
 		interval = calloc(1, sizeof(*interval));
 		if (!interval) {
+			pqueue_remove(p->unicast_service->expiry, client);
 			free(client);
 			return SERVICE_DENIED;
 		}
-		initialize_interval(interval, req->logInterMessagePeriod);
+		initialize_interval(interval, req->logInterMessagePeriod,
+				    p->unicast_service->nslots);
 		LIST_INSERT_HEAD(&p->unicast_service->intervals, interval, list);
 		if (pqueue_insert(p->unicast_service->queue, interval)) {
 			LIST_REMOVE(interval, list);
 			free(interval);
+			pqueue_remove(p->unicast_service->expiry, client);
 			free(client);
 			return SERVICE_DENIED;
 		}
-		unicast_service_rearm_timer(p);
 	}
-	LIST_INSERT_HEAD(&interval->clients, client, list);
+	interval_add_client(interval, client);
+	LIST_INSERT_HEAD(bucket, client, hash);
+	unicast_service_rearm_timer(p);
 	return SERVICE_GRANTED;
 }
 
 void unicast_service_cleanup(struct port *p)
 {
 	struct unicast_service_interval *itmp, *inext;
-	struct unicast_client_address *ctmp, *cnext;
+	struct unicast_client_address *ctmp;
 
 	if (!p->unicast_service) {
 		return;
 	}
+	unicast_service_stop(p);
 	LIST_FOREACH_SAFE(itmp, &p->unicast_service->intervals, list, inext) {
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, cnext) {
-			LIST_REMOVE(ctmp, list);
-			free(ctmp);
-		}
 		LIST_REMOVE(itmp, list);
 		free(itmp);
 	}
+	while ((ctmp = pqueue_extract(p->unicast_service->expiry)) != NULL) {
+		free(ctmp);
+	}
+	pqueue_destroy(p->unicast_service->expiry);
 	pqueue_destroy(p->unicast_service->queue);
 	free(p->unicast_service);
 }
@@ -399,6 +687,7 @@ int unicast_service_grant(struct port *p, struct ptp_message *m,
 int unicast_service_initialize(struct port *p)
 {
 	struct config *cfg = clock_config(p->clock);
+	int i;
 
 	if (!config_get_int(cfg, p->name, "unicast_listen")) {
 		return 0;
@@ -411,12 +700,33 @@ int unicast_service_initialize(struct port *p)
 		return -1;
 	}
 	LIST_INIT(&p->unicast_service->intervals);
+	for (i = 0; i < CLIENT_HASH_SIZE; i++) {
+		LIST_INIT(&p->unicast_service->clients[i]);
+	}
 
-	p->unicast_service->queue = pqueue_create(QUEUE_LEN, compare_timeout);
+	p->unicast_service->queue = pqueue_create(QUEUE_LEN, compare_timeout, NULL);
 	if (!p->unicast_service->queue) {
 		free(p->unicast_service);
 		return -1;
 	}
+	p->unicast_service->expiry = pqueue_create(QUEUE_LEN, compare_expiry,
+						  expiry_position);
+	if (!p->unicast_service->expiry) {
+		pqueue_destroy(p->unicast_service->queue);
+		free(p->unicast_service);
+		return -1;
+	}
+	p->unicast_service->nslots =
+		config_get_int(cfg, p->name, "unicast_service_slots");
+	p->unicast_service->nshards =
+		config_get_int(cfg, p->name, "unicast_service_threads");
+	if (p->unicast_service->nshards && !unicast_service_threads_ok(p)) {
+		pqueue_destroy(p->unicast_service->expiry);
+		pqueue_destroy(p->unicast_service->queue);
+		free(p->unicast_service);
+		p->unicast_service = NULL;
+		return -1;
+	}
 	p->inhibit_multicast_service =
 		config_get_int(cfg, p->name, "inhibit_multicast_service");
 
@@ -426,9 +736,8 @@ int unicast_service_initialize(struct port *p)
 void unicast_service_remove(struct port *p, struct ptp_message *m,
 			    struct tlv_extra *extra)
 {
-	struct unicast_client_address *ctmp, *next;
 	struct cancel_unicast_xmit_tlv *cancel;
-	struct unicast_service_interval *itmp;
+	struct unicast_client_address *ctmp;
 	unsigned int mask;
 	uint8_t mtype;
 
@@ -452,20 +761,79 @@ void unicast_service_remove(struct port *p, struct ptp_message *m,
 		return;
 	}
 
-	LIST_FOREACH(itmp, &p->unicast_service->intervals, list) {
-		LIST_FOREACH_SAFE(ctmp, &itmp->clients, list, next) {
-			if (!addreq(transport_type(p->trp),
-				    &ctmp->addr, &m->address)) {
-				continue;
-			}
-			if (ctmp->message_types & mask) {
-				ctmp->message_types &= ~mask;
-				if (!ctmp->message_types) {
-					LIST_REMOVE(ctmp, list);
-					free(ctmp);
-				}
-				return;
+	LIST_FOREACH(ctmp, client_bucket(p, &m->address), hash) {
+		if (!addreq(transport_type(p->trp), &ctmp->addr, &m->address)) {
+			continue;
+		}
+		if (ctmp->message_types & mask) {
+			ctmp->message_types &= ~mask;
+			if (!ctmp->message_types) {
+				client_drop(p, ctmp);
 			}
+			return;
+		}
+	}
+}
+
+int unicast_service_pacing(struct port *p, uint8_t *buf, int len, int *n)
+{
+	struct unicast_service_interval *interval;
+	struct unicast_pacing_np *rec;
+	int i, size, used = 0;
+
+	*n = 0;
+	if (!p->unicast_service) {
+		return 0;
+	}
+	LIST_FOREACH(interval, &p->unicast_service->intervals, list) {
+		size = sizeof(*rec) + interval->nslots * sizeof(rec->fanout[0]);
+		if (used + size > len) {
+			break;
+		}
+		rec = (struct unicast_pacing_np *) (buf + used);
+		rec->logInterMessagePeriod = interval->log_period;
+		rec->numberSlots = interval->nslots;
+		rec->numberClients = interval->nclients;
+		for (i = 0; i < interval->nslots; i++) {
+			rec->fanout[i] = interval->fanout[i];
+		}
+		used += size;
+		(*n)++;
+	}
+	return used;
+}
+
+int unicast_service_start(struct port *p)
+{
+	struct unicast_service *srv = p->unicast_service;
+	int i;
+
+	if (!srv || !srv->nshards) {
+		return 0;
+	}
+	for (i = 0; i < srv->nshards; i++) {
+		srv->shard[i] = unicast_shard_create(p);
+		if (!srv->shard[i]) {
+			unicast_service_stop(p);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void unicast_service_stop(struct port *p)
+{
+	struct unicast_service *srv = p->unicast_service;
+	int i;
+
+	if (!srv) {
+		return;
+	}
+	for (i = 0; i < srv->nshards; i++) {
+		if (srv->shard[i]) {
+			unicast_shard_stats(srv->shard[i], &p->stats);
+			unicast_shard_destroy(srv->shard[i]);
+			srv->shard[i] = NULL;
 		}
 	}
 }
@@ -481,6 +849,8 @@ int unicast_service_timer(struct port *p)
 	}
 	clock_gettime(CLOCK_MONOTONIC, &now);
 
+	unicast_service_reap(p, &now);
+
 	switch (p->state) {
 	case PS_INITIALIZING:
 	case PS_FAULTY:
@@ -497,6 +867,12 @@ int unicast_service_timer(struct port *p)
 		break;
 	}
 
+	/*
+	 * Gather the messages for all of the expiring intervals, so
+	 * that they go out in as few system calls as possible.
+	 */
+	port_tx_batch_begin(p);
+
 	while ((interval = pqueue_peek(p->unicast_service->queue)) != NULL) {
 
 		pr_debug("peek i={2^%d} tmo={%lld,%ld}", interval->log_period,
@@ -511,7 +887,9 @@ int unicast_service_timer(struct port *p)
 			err = -1;
 		}
 
-		if (LIST_EMPTY(&interval->clients)) {
+		interval->slot = (interval->slot + 1) % interval->nslots;
+
+		if (!interval->nclients) {
 			pr_debug("retire interval 2^%d", interval->log_period);
 			LIST_REMOVE(interval, list);
 			free(interval);
@@ -524,6 +902,9 @@ int unicast_service_timer(struct port *p)
 		pqueue_insert(p->unicast_service->queue, interval);
 	}
 
+	if (port_tx_batch_end(p)) {
+		err = -1;
+	}
 	if (unicast_service_rearm_timer(p)) {
 		err = -1;
 	}
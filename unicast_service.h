@@ -80,6 +80,32 @@ int unicast_service_initialize(struct port *p);
 void unicast_service_remove(struct port *p, struct ptp_message *m,
 			    struct tlv_extra *extra);
 
+/**
+ * Describes how the clients of each message interval are spread over
+ * the transmission slots, as unicast_pacing_np records in host byte
+ * order. Intervals whose record does not fit are left out.
+ * @param p      The port in question.
+ * @param buf    Receives the records.
+ * @param len    The size of the buffer in bytes.
+ * @param n      Receives the number of records.
+ * @return       The number of bytes used.
+ */
+int unicast_service_pacing(struct port *p, uint8_t *buf, int len, int *n);
+
+/**
+ * Starts the transmit threads of a port's unicast service, if any
+ * were configured. The port's transport must be open.
+ * @param p      The port in question.
+ * @return       Zero on success, non-zero otherwise.
+ */
+int unicast_service_start(struct port *p);
+
+/**
+ * Stops the transmit threads of a port's unicast service.
+ * @param p      The port in question.
+ */
+void unicast_service_stop(struct port *p);
+
 /**
  * Handles the unicast service timer, sending messages according to schedule.
  * @param p      The port in question.
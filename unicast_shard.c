@@ -0,0 +1,418 @@
+/**
+ * @file unicast_shard.c
+ * @brief Transmits unicast service messages from worker threads.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <unistd.h>
+
+#include "port_private.h"
+#include "print.h"
+#include "sk.h"
+#include "transport.h"
+#include "unicast_shard.h"
+
+/* The most work that may wait for a thread that falls behind. */
+#define MAX_JOBS 1024
+
+enum {
+	TMPL_ANNOUNCE,
+	TMPL_SYNC,
+	TMPL_FUP,
+	N_TMPL,
+};
+
+struct shard_dest {
+	struct address addr;
+	UInteger16 announce_seq;
+	UInteger16 sync_seq;
+	unsigned int types;
+};
+
+/*
+ * The messages for up to one batch of clients, together with their
+ * templates in wire format.
+ */
+struct shard_job {
+	STAILQ_ENTRY(shard_job) list;
+	struct message_data tmpl[N_TMPL];
+	int tmpl_len[N_TMPL];
+	struct shard_dest dest[SK_TX_BATCH_MAX];
+	int len;
+};
+
+struct unicast_shard {
+	pthread_t worker;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	/* Protected by the mutex. */
+	STAILQ_HEAD(shard_jobs, shard_job) jobs;
+	int njobs;
+	int quit;
+	struct PortStats stats;
+	/* Used only by the worker thread. */
+	struct transport *trp;
+	struct fdarray fda;
+	enum timestamp_type timestamping;
+	Integer64 tx_timestamp_offset;
+	uint32_t txts_key;
+	struct ptp_message *scratch;
+	UInteger16 portnum;
+	/* Used only by the owner of the shard. */
+	struct ptp_message *tmpl[N_TMPL];
+	struct shard_job *job;
+};
+
+static void shard_prepare(struct shard_job *job, int index,
+			  struct shard_dest *dest, UInteger16 seq,
+			  struct ptp_message *m)
+{
+	memcpy(&m->data, &job->tmpl[index], job->tmpl_len[index]);
+	m->header.sequenceId = htons(seq);
+	m->address = dest->addr;
+}
+
+static void shard_send(struct unicast_shard *s, enum transport_event event,
+		       struct ptp_message **m, int *cnt, int n,
+		       struct PortStats *stats)
+{
+	int i;
+
+	if (!n) {
+		return;
+	}
+	transport_sendto_batch(s->trp, &s->fda, event, m, cnt, n);
+
+	for (i = 0; i < n; i++) {
+		if (cnt[i] > 0) {
+			stats->txMsgType[msg_type(m[i])]++;
+		} else {
+			pr_err("port %hu: send %s failed", s->portnum,
+			       msg_type_string(msg_type(m[i])));
+		}
+	}
+}
+
+static void shard_run(struct unicast_shard *s, struct shard_job *job,
+		      struct PortStats *stats)
+{
+	int cnt[SK_TX_BATCH_MAX], pending[SK_TX_BATCH_MAX];
+	struct ptp_message *m[SK_TX_BATCH_MAX];
+	unsigned char done[SK_TX_BATCH_MAX];
+	struct shard_dest *dest;
+	struct hw_timestamp hwts;
+	struct pollfd pfd;
+	uint32_t base, key;
+	int err, i, n, got, nsync;
+	struct Timestamp ts;
+
+	/* Announce messages go out first. */
+	for (i = 0, n = 0; i < job->len; i++) {
+		dest = &job->dest[i];
+		if (dest->types & (1 << ANNOUNCE)) {
+			m[n] = &s->scratch[n];
+			shard_prepare(job, TMPL_ANNOUNCE, dest,
+				      dest->announce_seq, m[n]);
+			n++;
+		}
+	}
+	shard_send(s, TRANS_GENERAL, m, cnt, n, stats);
+
+	for (i = 0, n = 0; i < job->len; i++) {
+		dest = &job->dest[i];
+		if (dest->types & (1 << SYNC)) {
+			m[n] = &s->scratch[n];
+			shard_prepare(job, TMPL_SYNC, dest, dest->sync_seq, m[n]);
+			pending[n] = i;
+			n++;
+		}
+	}
+	if (!n) {
+		return;
+	}
+	shard_send(s, TRANS_DEFER_EVENT, m, cnt, n, stats);
+
+	/* Only the packets that went out consume a time stamp key. */
+	base = s->txts_key;
+	for (i = 0, nsync = 0; i < n; i++) {
+		if (cnt[i] > 0) {
+			pending[nsync++] = pending[i];
+		}
+	}
+	s->txts_key += nsync;
+	memset(done, 0, sizeof(done));
+
+	/* Answer each time stamp with a follow up, all sent together. */
+	hwts.type = s->timestamping;
+	pfd.fd = s->fda.fd[FD_EVENT];
+	pfd.events = POLLPRI;
+	got = 0;
+	n = 0;
+	while (got < nsync) {
+		err = transport_txts_async(&s->fda, &hwts, &key);
+		if (err == -EAGAIN) {
+			if (poll(&pfd, 1, sk_tx_timeout) < 1) {
+				pr_err("port %hu: missing timestamp on %d "
+				       "transmitted sync messages",
+				       s->portnum, nsync - got);
+				break;
+			}
+			continue;
+		} else if (err) {
+			break;
+		}
+		i = (int32_t) (key - base);
+		if (i < 0 || i >= nsync || done[i]) {
+			pr_debug("port %hu: dropping stale tx timestamp %u",
+				 s->portnum, key);
+			continue;
+		}
+		done[i] = 1;
+		got++;
+
+		ts_add(&hwts.ts, s->tx_timestamp_offset);
+		ts = tmv_to_Timestamp(hwts.ts);
+
+		dest = &job->dest[pending[i]];
+		m[n] = &s->scratch[n];
+		shard_prepare(job, TMPL_FUP, dest, dest->sync_seq, m[n]);
+		m[n]->follow_up.preciseOriginTimestamp.seconds_msb =
+			htons(ts.seconds_msb);
+		m[n]->follow_up.preciseOriginTimestamp.seconds_lsb =
+			htonl(ts.seconds_lsb);
+		m[n]->follow_up.preciseOriginTimestamp.nanoseconds =
+			htonl(ts.nanoseconds);
+		n++;
+	}
+	shard_send(s, TRANS_GENERAL, m, cnt, n, stats);
+}
+
+static void *shard_thread(void *arg)
+{
+	struct unicast_shard *s = arg;
+	struct PortStats stats;
+	struct shard_job *job;
+	int i;
+
+	pthread_mutex_lock(&s->mutex);
+	while (1) {
+		while (!s->quit && STAILQ_EMPTY(&s->jobs)) {
+			pthread_cond_wait(&s->cond, &s->mutex);
+		}
+		if (s->quit) {
+			break;
+		}
+		job = STAILQ_FIRST(&s->jobs);
+		STAILQ_REMOVE_HEAD(&s->jobs, list);
+		s->njobs--;
+		pthread_mutex_unlock(&s->mutex);
+
+		memset(&stats, 0, sizeof(stats));
+		shard_run(s, job, &stats);
+		free(job);
+
+		pthread_mutex_lock(&s->mutex);
+		for (i = 0; i < MAX_MESSAGE_TYPES; i++) {
+			s->stats.txMsgType[i] += stats.txMsgType[i];
+		}
+	}
+	pthread_mutex_unlock(&s->mutex);
+	return NULL;
+}
+
+static int shard_post(struct unicast_shard *s)
+{
+	struct shard_job *job = s->job;
+	int err = 0;
+
+	if (!job) {
+		return 0;
+	}
+	s->job = NULL;
+
+	pthread_mutex_lock(&s->mutex);
+	if (s->njobs < MAX_JOBS) {
+		STAILQ_INSERT_TAIL(&s->jobs, job, list);
+		s->njobs++;
+		pthread_cond_signal(&s->cond);
+		job = NULL;
+	} else {
+		err = -1;
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	if (job) {
+		pr_err("port %hu: transmit thread overrun", s->portnum);
+		free(job);
+	}
+	return err;
+}
+
+/* public methods */
+
+struct unicast_shard *unicast_shard_create(struct port *p)
+{
+	const char *name = interface_name(p->iface);
+	struct unicast_shard *s;
+	sigset_t all, old;
+	int i;
+
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		return NULL;
+	}
+	s->scratch = calloc(SK_TX_BATCH_MAX, sizeof(*s->scratch));
+	if (!s->scratch) {
+		goto no_scratch;
+	}
+	for (i = 0; i < N_POLLFD; i++) {
+		s->fda.fd[i] = -1;
+	}
+	s->fda.fd[FD_EVENT] = sk_reuseport_open(p->fda.fd[FD_EVENT], name);
+	if (s->fda.fd[FD_EVENT] < 0) {
+		goto no_event;
+	}
+	s->fda.fd[FD_GENERAL] = sk_reuseport_open(p->fda.fd[FD_GENERAL], name);
+	if (s->fda.fd[FD_GENERAL] < 0) {
+		goto no_general;
+	}
+	s->trp = p->trp;
+	s->timestamping = p->timestamping;
+	s->tx_timestamp_offset = p->tx_timestamp_offset;
+	s->portnum = portnum(p);
+	STAILQ_INIT(&s->jobs);
+	pthread_mutex_init(&s->mutex, NULL);
+	pthread_cond_init(&s->cond, NULL);
+
+	/* Leave the signals to the main thread. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	i = pthread_create(&s->worker, NULL, shard_thread, s);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (i) {
+		pr_err("port %hu: failed to create transmit thread: %s",
+		       portnum(p), strerror(i));
+		goto no_thread;
+	}
+	return s;
+
+no_thread:
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->mutex);
+	close(s->fda.fd[FD_GENERAL]);
+no_general:
+	close(s->fda.fd[FD_EVENT]);
+no_event:
+	free(s->scratch);
+no_scratch:
+	free(s);
+	return NULL;
+}
+
+void unicast_shard_destroy(struct unicast_shard *s)
+{
+	struct shard_job *job;
+
+	pthread_mutex_lock(&s->mutex);
+	s->quit = 1;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+	pthread_join(s->worker, NULL);
+
+	while ((job = STAILQ_FIRST(&s->jobs)) != NULL) {
+		STAILQ_REMOVE_HEAD(&s->jobs, list);
+		free(job);
+	}
+	free(s->job);
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->mutex);
+	close(s->fda.fd[FD_GENERAL]);
+	close(s->fda.fd[FD_EVENT]);
+	free(s->scratch);
+	free(s);
+}
+
+void unicast_shard_begin(struct unicast_shard *s, struct ptp_message *announce,
+			 struct ptp_message *sync, struct ptp_message *fup)
+{
+	s->tmpl[TMPL_ANNOUNCE] = announce;
+	s->tmpl[TMPL_SYNC] = sync;
+	s->tmpl[TMPL_FUP] = fup;
+}
+
+int unicast_shard_add(struct unicast_shard *s, struct address *addr,
+		      UInteger16 announce_seq, UInteger16 sync_seq,
+		      unsigned int types)
+{
+	struct shard_dest *dest;
+	struct shard_job *job;
+	int i, len;
+
+	if (!s->job) {
+		job = malloc(sizeof(*job));
+		if (!job) {
+			return -1;
+		}
+		for (i = 0; i < N_TMPL; i++) {
+			len = 0;
+			if (s->tmpl[i]) {
+				len = ntohs(s->tmpl[i]->header.messageLength);
+				memcpy(&job->tmpl[i], &s->tmpl[i]->data, len);
+			}
+			job->tmpl_len[i] = len;
+		}
+		job->len = 0;
+		s->job = job;
+	}
+	job = s->job;
+	dest = &job->dest[job->len++];
+	dest->addr = *addr;
+	dest->announce_seq = announce_seq;
+	dest->sync_seq = sync_seq;
+	dest->types = types;
+
+	if (job->len == SK_TX_BATCH_MAX) {
+		return shard_post(s);
+	}
+	return 0;
+}
+
+int unicast_shard_end(struct unicast_shard *s)
+{
+	int err = shard_post(s);
+
+	memset(s->tmpl, 0, sizeof(s->tmpl));
+	return err;
+}
+
+void unicast_shard_stats(struct unicast_shard *s, struct PortStats *stats)
+{
+	int i;
+
+	pthread_mutex_lock(&s->mutex);
+	for (i = 0; i < MAX_MESSAGE_TYPES; i++) {
+		stats->txMsgType[i] += s->stats.txMsgType[i];
+		s->stats.txMsgType[i] = 0;
+	}
+	pthread_mutex_unlock(&s->mutex);
+}
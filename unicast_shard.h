@@ -0,0 +1,85 @@
+/**
+ * @file unicast_shard.h
+ * @brief Transmits unicast service messages from worker threads.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
+ */
+#ifndef HAVE_UNICAST_SHARD_H
+#define HAVE_UNICAST_SHARD_H
+
+#include "address.h"
+#include "ddt.h"
+
+struct port;
+struct ptp_message;
+struct unicast_shard;
+
+/**
+ * Creates a worker thread that transmits on behalf of a port, using
+ * its own pair of sockets sharing the port's UDP ports. The port's
+ * transport must be open.
+ * @param p  The port on whose behalf the worker transmits.
+ * @return   A pointer to a new worker on success, NULL otherwise.
+ */
+struct unicast_shard *unicast_shard_create(struct port *p);
+
+/**
+ * Stops a worker thread, dropping any work still queued, and closes
+ * its sockets.
+ * @param s  A pointer obtained via unicast_shard_create().
+ */
+void unicast_shard_destroy(struct unicast_shard *s);
+
+/**
+ * Begins a transmission pass. The given messages serve as templates
+ * for the messages of the pass. They must have passed msg_pre_send()
+ * and remain valid until unicast_shard_end().
+ * @param s         A pointer obtained via unicast_shard_create().
+ * @param announce  Template Announce message, or NULL.
+ * @param sync      Template Sync message, or NULL.
+ * @param fup       Template Follow_Up message, required with 'sync'.
+ */
+void unicast_shard_begin(struct unicast_shard *s, struct ptp_message *announce,
+			 struct ptp_message *sync, struct ptp_message *fup);
+
+/**
+ * Adds a destination to the current transmission pass.
+ * @param s             A pointer obtained via unicast_shard_create().
+ * @param addr          The address of the client.
+ * @param announce_seq  The sequence number of the client's Announce.
+ * @param sync_seq      The sequence number of the client's Sync.
+ * @param types         Bit mask of the message types to send.
+ * @return              Zero on success, non-zero otherwise.
+ */
+int unicast_shard_add(struct unicast_shard *s, struct address *addr,
+		      UInteger16 announce_seq, UInteger16 sync_seq,
+		      unsigned int types);
+
+/**
+ * Ends a transmission pass, handing any remaining work to the thread.
+ * @param s  A pointer obtained via unicast_shard_create().
+ * @return   Zero on success, non-zero otherwise.
+ */
+int unicast_shard_end(struct unicast_shard *s);
+
+/**
+ * Moves the transmit counters of a worker into the port's statistics.
+ * @param s      A pointer obtained via unicast_shard_create().
+ * @param stats  The statistics to update.
+ */
+void unicast_shard_stats(struct unicast_shard *s, struct PortStats *stats);
+
+#endif
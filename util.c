@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "address.h"
 #include "phc.h"
@@ -749,3 +750,37 @@ int rate_limited(int interval, time_t *last)
 
 	return 0;
 }
+
+void *slab_map(size_t *len, int flags)
+{
+	size_t huge = 2 * 1024 * 1024;
+	void *mem = MAP_FAILED;
+
+	if (flags & SLAB_HUGEPAGES) {
+		*len = (*len + huge - 1) & ~(huge - 1);
+		mem = mmap(NULL, *len, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (mem == MAP_FAILED) {
+			pr_warning("huge pages unavailable, using normal pages");
+		}
+	}
+	if (mem == MAP_FAILED) {
+		mem = mmap(NULL, *len, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+	if (mem == MAP_FAILED) {
+		pr_err("failed to map %zu bytes: %m", *len);
+		return NULL;
+	}
+	if ((flags & SLAB_MLOCK) && mlock(mem, *len)) {
+		pr_err("failed to lock %zu bytes: %m", *len);
+		munmap(mem, *len);
+		return NULL;
+	}
+	return mem;
+}
+
+void slab_unmap(void *mem, size_t len)
+{
+	munmap(mem, len);
+}
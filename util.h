@@ -455,4 +455,27 @@ void parray_extend(void ***a, ...);
  */
 int rate_limited(int interval, time_t *last);
 
+/** Back a slab with huge pages, falling back to normal pages. */
+#define SLAB_HUGEPAGES	(1 << 0)
+/** Lock a slab into memory. */
+#define SLAB_MLOCK	(1 << 1)
+
+/**
+ * Maps an anonymous, zeroed region of memory for a fixed size pool.
+ *
+ * @param len    Pointer to the size of the region in bytes. On return,
+ *               holds the size actually mapped.
+ * @param flags  Bit mask of the SLAB_ flags.
+ * @return       Pointer to the region on success, NULL otherwise.
+ */
+void *slab_map(size_t *len, int flags);
+
+/**
+ * Releases a region obtained via @ref slab_map().
+ *
+ * @param mem  Pointer to the region.
+ * @param len  The size returned by @ref slab_map().
+ */
+void slab_unmap(void *mem, size_t len);
+
 #endif